@@ -0,0 +1,396 @@
+#include "Analyzer.h"
+#include "CpuDispatch.h"
+#include "DataGenerator.h"
+#include "DataStructure.h"
+#include "FieldParsers.h"
+#include "JsonWriter.h"
+#include "Parallel.h"
+#include "mio.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Micro-benchmarks for the parse helpers, the tokenizers and the main aggregations, run
+// at several data sizes. Every benchmark reports its best and median time over a number
+// of repetitions, with throughput in rows/s and bytes/s, and a checksum so results can
+// be compared between builds.
+
+namespace {
+
+    struct BenchmarkOptions {
+        std::vector<size_t> sizes = { 10000, 100000, 1000000 };
+        size_t repetitions = 5;
+        // Empty runs every benchmark; otherwise only those whose name contains one of these.
+        std::vector<std::string> filters;
+        // Rows are taken from this file, repeated as needed, instead of being generated.
+        std::string inputFile;
+        bool json = false;
+        unsigned threadCount = 0;
+        bool cpuLevelSet = false;
+        CpuLevel cpuLevel = CpuLevel::SCALAR;
+    };
+
+    struct BenchmarkResult {
+        std::string name;
+        size_t rows = 0;
+        // Bytes the benchmark reads: field or line text for the parsers, the in-memory
+        // rows for the aggregations.
+        size_t bytes = 0;
+        double bestSeconds = 0.0;
+        double medianSeconds = 0.0;
+        uint64_t checksum = 0;
+
+        double rowsPerSecond() const { return bestSeconds > 0.0 ? rows / bestSeconds : 0.0; }
+        double bytesPerSecond() const { return bestSeconds > 0.0 ? bytes / bestSeconds : 0.0; }
+    };
+
+    // One data size. The views point into text, so a dataset is filled in place and never moved.
+    struct Dataset {
+        std::string text;
+        std::vector<std::string_view> lines;
+        std::array<std::vector<std::string_view>, NUM_COLUMNS> fields;
+        std::vector<ECommerceEvent> events;
+        EventColumns columns;
+    };
+
+    // Repeats the data rows of the file (everything after the header) until rowCount rows.
+    bool copyRows(std::string& text, const std::string& fileName, size_t rowCount) {
+        try {
+            mio::mmap_source data(fileName);
+            std::string_view body(data.data(), data.size());
+            const size_t firstNewline = body.find('\n');
+            body.remove_prefix(firstNewline == std::string_view::npos ? body.size() : firstNewline + 1);
+
+            size_t rows = 0;
+            while (rows < rowCount) {
+                std::string_view rest = body;
+                size_t copied = 0;
+                while (!rest.empty() && rows < rowCount) {
+                    const size_t newline = rest.find('\n');
+                    const size_t length = newline == std::string_view::npos ? rest.size() : newline + 1;
+                    text.append(rest.data(), length);
+                    if (newline == std::string_view::npos) text += '\n';
+                    rest.remove_prefix(length);
+                    rows++;
+                    copied++;
+                }
+                if (copied == 0) break;
+            }
+            return true;
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Cannot read " << fileName << ": " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+    bool buildDataset(Dataset& data, const BenchmarkOptions& options, size_t rowCount) {
+        data.text.reserve(rowCount * 150);
+        if (options.inputFile.empty()) {
+            GeneratorOptions generatorOptions;
+            generatorOptions.rows = rowCount;
+            DataGenerator(generatorOptions).generate(data.text);
+        }
+        else if (!copyRows(data.text, options.inputFile, rowCount)) return false;
+
+        const CpuDispatch& cpu = cpuDispatch();
+        std::string_view rest = data.text;
+        data.lines.reserve(rowCount);
+        for (auto& column : data.fields) column.reserve(rowCount);
+        data.events.reserve(rowCount);
+        while (!rest.empty()) {
+            const std::string_view line = nextLine(rest, cpu);
+            data.lines.push_back(line);
+
+            std::array<std::string_view, NUM_COLUMNS> fields;
+            splitFields(line, cpu, fields);
+            for (size_t column = 0; column < NUM_COLUMNS; ++column) data.fields[column].push_back(fields[column]);
+
+            ECommerceEvent event;
+            if (!parseLine(line, cpu, event)) continue;
+            data.columns.eventTypes.push_back(static_cast<uint8_t>(event.eventType));
+            data.columns.prices.push_back(event.price);
+            data.events.push_back(event);
+        }
+        return true;
+    }
+
+    size_t totalSize(const std::vector<std::string_view>& views) {
+        size_t bytes = 0;
+        for (std::string_view view : views) bytes += view.size();
+        return bytes;
+    }
+
+    template<typename Run>
+    BenchmarkResult measure(const char* name, size_t rows, size_t bytes, size_t repetitions, Run&& run) {
+        BenchmarkResult result;
+        result.name = name;
+        result.rows = rows;
+        result.bytes = bytes;
+        std::vector<double> seconds;
+        for (size_t i = 0; i < std::max<size_t>(1, repetitions); ++i) {
+            const auto start = std::chrono::steady_clock::now();
+            const uint64_t checksum = run();
+            const auto end = std::chrono::steady_clock::now();
+            seconds.push_back(std::chrono::duration<double>(end - start).count());
+            result.checksum = checksum;
+        }
+        std::sort(seconds.begin(), seconds.end());
+        result.bestSeconds = seconds.front();
+        result.medianSeconds = seconds[seconds.size() / 2];
+        return result;
+    }
+
+    bool selected(const BenchmarkOptions& options, std::string_view name) {
+        if (options.filters.empty()) return true;
+        for (const auto& filter : options.filters) {
+            if (name.find(filter) != std::string_view::npos) return true;
+        }
+        return false;
+    }
+
+    void runBenchmarks(const Dataset& data, const BenchmarkOptions& options, std::vector<BenchmarkResult>& results) {
+        const CpuDispatch& cpu = cpuDispatch();
+        const size_t rows = data.lines.size();
+        const size_t repetitions = options.repetitions;
+        auto add = [&](const char* name, size_t benchmarkRows, size_t bytes, auto&& run) {
+            if (selected(options, name)) results.push_back(measure(name, benchmarkRows, bytes, repetitions, run));
+        };
+
+        add("parseNumeric", rows, totalSize(data.fields[6]), [&] {
+            uint64_t checksum = 0;
+            for (std::string_view field : data.fields[6]) {
+                double price;
+                parseNumeric(price, field);
+                checksum += static_cast<uint64_t>(price * 100.0 + 0.5);
+            }
+            return checksum;
+        });
+        add("parseUint64", rows, totalSize(data.fields[2]), [&] {
+            uint64_t checksum = 0;
+            for (std::string_view field : data.fields[2]) {
+                uint64_t id;
+                cpu.parseUint64(id, field);
+                checksum += id;
+            }
+            return checksum;
+        });
+        add("parseTimestamp", rows, totalSize(data.fields[0]), [&] {
+            uint64_t checksum = 0;
+            for (std::string_view field : data.fields[0]) {
+                PurchaseTime time;
+                parseTimestamp(time, field);
+                checksum += static_cast<uint64_t>(time.day * 86400 + time.hour * 3600 + time.minute * 60 + time.second);
+            }
+            return checksum;
+        });
+        add("parseCategoryCode", rows, totalSize(data.fields[4]), [&] {
+            uint64_t checksum = 0;
+            for (std::string_view field : data.fields[4]) {
+                CategoryCode code;
+                parseCategoryCode(code, field);
+                checksum += code.code.size() + code.subcode.size() + code.secondarySubcode.size();
+            }
+            return checksum;
+        });
+        add("parseEventType", rows, totalSize(data.fields[1]), [&] {
+            uint64_t checksum = 0;
+            for (std::string_view field : data.fields[1]) checksum += static_cast<uint64_t>(parseEventType(field));
+            return checksum;
+        });
+        add("splitLines", rows, data.text.size(), [&] {
+            uint64_t checksum = 0;
+            std::string_view rest = data.text;
+            while (!rest.empty()) checksum += nextLine(rest, cpu).size();
+            return checksum;
+        });
+        add("splitFields", rows, totalSize(data.lines), [&] {
+            uint64_t checksum = 0;
+            std::array<std::string_view, NUM_COLUMNS> fields;
+            for (std::string_view line : data.lines) {
+                checksum += splitFields(line, cpu, fields) + fields[NUM_COLUMNS - 1].size();
+            }
+            return checksum;
+        });
+        add("parseLine", rows, totalSize(data.lines), [&] {
+            uint64_t checksum = 0;
+            for (std::string_view line : data.lines) {
+                ECommerceEvent event;
+                if (parseLine(line, cpu, event)) checksum += event.prodId + static_cast<uint64_t>(event.timestamp);
+            }
+            return checksum;
+        });
+
+        Analyzer analyzer;
+        const size_t eventRows = data.events.size();
+        add("getSummary", eventRows, eventRows * (sizeof(uint8_t) + sizeof(double)), [&] {
+            const AnalysisSummary summary = analyzer.getSummary(data.columns);
+            return static_cast<uint64_t>(summary.totalRevenue + 0.5) + summary.viewCount + summary.purchaseCount;
+        });
+        add("getProductStats", eventRows, eventRows * sizeof(ECommerceEvent), [&] {
+            const ProductStatsMap stats = analyzer.getProductStats(data.events);
+            uint64_t checksum = stats.size();
+            for (const auto& entry : stats) checksum += entry.second.purchaseCount;
+            return checksum;
+        });
+    }
+
+    void printText(std::ostream& out, const std::vector<BenchmarkResult>& results) {
+        out << std::left << std::setw(20) << "benchmark" << std::right << std::setw(10) << "rows"
+            << std::setw(12) << "best ms" << std::setw(12) << "median ms" << std::setw(12) << "Mrows/s"
+            << std::setw(10) << "MB/s" << "  checksum" << std::endl;
+        out << std::fixed;
+        for (const auto& result : results) {
+            out << std::left << std::setw(20) << result.name << std::right << std::setw(10) << result.rows
+                << std::setprecision(3) << std::setw(12) << result.bestSeconds * 1000.0
+                << std::setw(12) << result.medianSeconds * 1000.0
+                << std::setprecision(2) << std::setw(12) << result.rowsPerSecond() / 1e6
+                << std::setprecision(1) << std::setw(10) << result.bytesPerSecond() / 1e6
+                << "  " << result.checksum << std::endl;
+        }
+        out << std::defaultfloat;
+    }
+
+    void printJson(std::ostream& out, const BenchmarkOptions& options, const std::vector<BenchmarkResult>& results) {
+        JsonWriter json(out);
+        json.beginObject()
+            .field("cpuLevel", cpuLevelName(getCpuLevel()))
+            .field("threads", getThreadCount())
+            .field("repetitions", options.repetitions)
+            .field("input", options.inputFile.empty() ? std::string_view("generated") : std::string_view(options.inputFile))
+            .key("results").beginArray();
+        for (const auto& result : results) {
+            json.beginObject()
+                .field("name", result.name)
+                .field("rows", result.rows)
+                .field("bytes", result.bytes)
+                .field("bestSeconds", result.bestSeconds)
+                .field("medianSeconds", result.medianSeconds)
+                .field("rowsPerSecond", result.rowsPerSecond())
+                .field("bytesPerSecond", result.bytesPerSecond())
+                .field("checksum", result.checksum)
+                .endObject();
+        }
+        json.endArray().endObject();
+        out << std::endl;
+    }
+
+    template<typename T>
+    bool parseCount(std::string_view text, T& value) {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == std::errc() && result.ptr == text.data() + text.size() && value != 0;
+    }
+
+    std::vector<std::string_view> splitList(std::string_view list) {
+        std::vector<std::string_view> items;
+        while (!list.empty()) {
+            const size_t comma = list.find(',');
+            items.push_back(list.substr(0, comma));
+            list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+        }
+        return items;
+    }
+
+    void printUsage(std::ostream& out, const char* program) {
+        out << "Usage: " << program << " [options]\n"
+            << "\n"
+            << "  --sizes=<n,...>        Row counts to run at (default: 10000,100000,1000000).\n"
+            << "  --repetitions=<n>      Runs per benchmark; best and median are reported (default: 5).\n"
+            << "  --filter=<name,...>    Only benchmarks whose name contains one of these.\n"
+            << "  --input=<file.csv>     Take rows from this file, repeated as needed, instead of\n"
+            << "                         generating them.\n"
+            << "  --format=<text|json>   Result format on stdout (default: text).\n"
+            << "  --threads=<n>          Scheduler threads for the aggregations.\n"
+            << "  --cpu-level=<level>    scalar, sse4.2, avx2 or avx512.\n"
+            << "  --help                 Show this message.\n";
+    }
+
+    bool parseOptions(int argc, char* argv[], BenchmarkOptions& options, bool& showHelp) {
+        for (int i = 1; i < argc; ++i) {
+            const std::string_view argument = argv[i];
+            bool valid = true;
+            if (argument == "--help" || argument == "-h") {
+                showHelp = true;
+            }
+            else if (argument.substr(0, 8) == "--sizes=") {
+                options.sizes.clear();
+                for (std::string_view item : splitList(argument.substr(8))) {
+                    size_t size = 0;
+                    valid = valid && parseCount(item, size);
+                    options.sizes.push_back(size);
+                }
+                valid = valid && !options.sizes.empty();
+            }
+            else if (argument.substr(0, 14) == "--repetitions=") {
+                valid = parseCount(argument.substr(14), options.repetitions);
+            }
+            else if (argument.substr(0, 9) == "--filter=") {
+                for (std::string_view item : splitList(argument.substr(9))) options.filters.emplace_back(item);
+            }
+            else if (argument.substr(0, 8) == "--input=") {
+                options.inputFile = std::string(argument.substr(8));
+            }
+            else if (argument.substr(0, 9) == "--format=") {
+                options.json = argument.substr(9) == "json";
+                valid = options.json || argument.substr(9) == "text";
+            }
+            else if (argument.substr(0, 10) == "--threads=") {
+                valid = parseCount(argument.substr(10), options.threadCount);
+            }
+            else if (argument.substr(0, 12) == "--cpu-level=") {
+                valid = options.cpuLevelSet = parseCpuLevel(argument.substr(12), options.cpuLevel);
+            }
+            else {
+                valid = false;
+            }
+            if (!valid) {
+                std::cerr << "Invalid argument '" << argument << "'." << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    bool showHelp = false;
+    if (!parseOptions(argc, argv, options, showHelp)) {
+        printUsage(std::cerr, argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (showHelp) {
+        printUsage(std::cout, argv[0]);
+        return EXIT_SUCCESS;
+    }
+    if (options.threadCount != 0) setThreadCount(options.threadCount);
+    if (options.cpuLevelSet) setCpuLevel(options.cpuLevel);
+
+    // With JSON, stdout carries only the results.
+    std::ostream& log = options.json ? std::cerr : std::cout;
+    log << "CPU dispatch level: " << cpuLevelName(getCpuLevel()) << ", scheduler threads: " << getThreadCount()
+        << ", repetitions: " << options.repetitions << std::endl;
+
+    std::vector<BenchmarkResult> results;
+    for (size_t size : options.sizes) {
+        Dataset data;
+        if (!buildDataset(data, options, size)) return EXIT_FAILURE;
+        const size_t first = results.size();
+        runBenchmarks(data, options, results);
+        if (!options.json) {
+            log << std::endl << "--- " << size << " rows (" << data.text.size() / 1024 << " KB) ---" << std::endl;
+            printText(log, std::vector<BenchmarkResult>(results.begin() + first, results.end()));
+        }
+    }
+    if (options.json) printJson(std::cout, options, results);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,263 @@
+#include "AggregateState.h"
+#include "BinaryIO.h"
+#include "Hashing.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+    const char AGGREGATE_STATE_TAG[5] = "AGGS";
+    constexpr uint32_t AGGREGATE_STATE_VERSION = 1;
+    // Rows whose user and session hashes are collected before each HyperLogLog::addAll.
+    constexpr size_t HASH_BATCH = 256;
+
+    struct ProductRecord {
+        uint64_t prodId;
+        ProductStats stats;
+    };
+
+    struct BucketRecord {
+        int64_t start;
+        AnalysisSummary summary;
+    };
+
+    void addToProductStats(ProductStats& stats, const ECommerceEvent& event) {
+        switch (event.eventType) {
+        case EventType::VIEW:
+            stats.viewCount++;
+            break;
+        case EventType::CART:
+            stats.cartCount++;
+            break;
+        case EventType::PURCHASE:
+            stats.purchaseCount++;
+            stats.revenue += event.price;
+            break;
+        case EventType::REMOVE_FROM_CART:
+        case EventType::UNKNOWN:
+            break;
+        }
+    }
+
+    void mergeProductStats(ProductStats& target, const ProductStats& source) {
+        target.viewCount += source.viewCount;
+        target.cartCount += source.cartCount;
+        target.purchaseCount += source.purchaseCount;
+        target.revenue += source.revenue;
+    }
+
+}
+
+AggregateState::AggregateState(int64_t bucketSeconds, uint8_t distinctPrecision, size_t heavyHitterCount)
+    : bucketSeconds(bucketSeconds),
+    users(distinctPrecision),
+    sessions(distinctPrecision),
+    heavyHitterTracker(heavyHitterCount) {
+    if (bucketSeconds <= 0) {
+        throw std::invalid_argument("AggregateState bucket width must be positive");
+    }
+}
+
+void AggregateState::add(const ECommerceEvent& event) {
+    addExceptDistinct(event);
+    users.add(hashUint64(event.userId));
+    sessions.add(hashString(event.userSession));
+}
+
+void AggregateState::addExceptDistinct(const ECommerceEvent& event) {
+    rows++;
+    addToSummary(totals, event);
+    addToProductStats(products[event.prodId], event);
+    addToSummary(buckets[floorToBucket(event.timestamp, bucketSeconds)], event);
+    if (event.eventType == EventType::PURCHASE) purchasePriceSketch.add(event.price);
+    heavyHitterTracker.add(event);
+}
+
+void AggregateState::addRows(const std::vector<ECommerceEvent>& events, size_t begin, size_t end) {
+    std::array<uint64_t, HASH_BATCH> userHashes;
+    std::array<uint64_t, HASH_BATCH> sessionHashes;
+    for (size_t offset = begin; offset < end; offset += HASH_BATCH) {
+        const size_t batchSize = std::min(HASH_BATCH, end - offset);
+        for (size_t i = 0; i < batchSize; ++i) {
+            const ECommerceEvent& event = events[offset + i];
+            addExceptDistinct(event);
+            userHashes[i] = hashUint64(event.userId);
+            sessionHashes[i] = hashString(event.userSession);
+        }
+        users.addAll(userHashes.data(), batchSize);
+        sessions.addAll(sessionHashes.data(), batchSize);
+    }
+}
+
+void AggregateState::add(const std::vector<ECommerceEvent>& events, const std::string& sourceName) {
+    add(events, 0, events.size(), sourceName);
+}
+
+void AggregateState::add(const std::vector<ECommerceEvent>& events, size_t begin, size_t end, const std::string& sourceName) {
+    if (begin > end || end > events.size()) {
+        throw std::out_of_range("AggregateState row range is outside the events");
+    }
+    const size_t chunkCount = getThreadCount();
+    std::vector<AggregateState> partials(chunkCount, AggregateState(bucketSeconds, users.getPrecision(), heavyHitterTracker.getTopN()));
+    parallelChunks(end - begin, chunkCount, [&](size_t chunk, size_t chunkBegin, size_t chunkEnd) {
+        partials[chunk].addRows(events, begin + chunkBegin, begin + chunkEnd);
+        });
+    for (const auto& partial : partials) {
+        merge(partial);
+    }
+    if (!sourceName.empty()) sourceNames.push_back(sourceName);
+}
+
+void AggregateState::merge(const AggregateState& other) {
+    if (other.bucketSeconds != bucketSeconds || other.users.getPrecision() != users.getPrecision()) {
+        throw std::invalid_argument("Cannot merge aggregate states with different bucket widths or precisions");
+    }
+    rows += other.rows;
+    mergeSummary(totals, other.totals);
+    products.reserve(products.size() + other.products.size());
+    for (const auto& product : other.products) {
+        mergeProductStats(products[product.first], product.second);
+    }
+    for (const auto& bucket : other.buckets) {
+        mergeSummary(buckets[bucket.first], bucket.second);
+    }
+    users.merge(other.users);
+    sessions.merge(other.sessions);
+    purchasePriceSketch.merge(other.purchasePriceSketch);
+    heavyHitterTracker.merge(other.heavyHitterTracker);
+    sourceNames.insert(sourceNames.end(), other.sourceNames.begin(), other.sourceNames.end());
+}
+
+TimeSeries AggregateState::timeSeries(int64_t seriesBucketSeconds) const {
+    if (seriesBucketSeconds == 0) seriesBucketSeconds = bucketSeconds;
+    if (seriesBucketSeconds < 0 || seriesBucketSeconds % bucketSeconds != 0) {
+        throw std::invalid_argument("Series buckets must be a multiple of the state's bucket width");
+    }
+    TimeSeries series;
+    series.bucketSeconds = seriesBucketSeconds;
+    if (buckets.empty()) return series;
+
+    // The map is in time order, so each wider bucket is a run of consecutive entries.
+    for (const auto& bucket : buckets) {
+        const int64_t start = floorToBucket(bucket.first, seriesBucketSeconds);
+        if (series.bucketStarts.empty() || series.bucketStarts.back() != start) {
+            series.bucketStarts.push_back(start);
+            series.buckets.emplace_back();
+        }
+        mergeSummary(series.buckets.back(), bucket.second);
+    }
+    return series;
+}
+
+DistinctCounts AggregateState::distinctCounts() const {
+    DistinctCounts counts;
+    counts.users = users.estimate();
+    counts.sessions = sessions.estimate();
+    return counts;
+}
+
+bool AggregateState::hasSource(const std::string& sourceName) const {
+    return std::find(sourceNames.begin(), sourceNames.end(), sourceName) != sourceNames.end();
+}
+
+void AggregateState::addSource(const std::string& sourceName) {
+    if (!sourceName.empty()) sourceNames.push_back(sourceName);
+}
+
+std::string AggregateState::sourceNameFor(const std::string& filePath) {
+    std::error_code error;
+    const std::filesystem::path canonical = std::filesystem::weakly_canonical(std::filesystem::absolute(filePath, error), error);
+    return error ? filePath : canonical.generic_string();
+}
+
+void AggregateState::save(std::ostream& out) const {
+    writeHeader(out, AGGREGATE_STATE_TAG, AGGREGATE_STATE_VERSION);
+    writeValue(out, bucketSeconds);
+    writeValue(out, rows);
+    writeValue(out, totals);
+
+    std::vector<ProductRecord> productRecords;
+    productRecords.reserve(products.size());
+    for (const auto& product : products) {
+        productRecords.push_back({ product.first, product.second });
+    }
+    writeVector(out, productRecords);
+
+    std::vector<BucketRecord> bucketRecords;
+    bucketRecords.reserve(buckets.size());
+    for (const auto& bucket : buckets) {
+        bucketRecords.push_back({ bucket.first, bucket.second });
+    }
+    writeVector(out, bucketRecords);
+
+    users.save(out);
+    sessions.save(out);
+    purchasePriceSketch.save(out);
+    heavyHitterTracker.save(out);
+
+    writeValue(out, static_cast<uint64_t>(sourceNames.size()));
+    for (const auto& sourceName : sourceNames) {
+        writeString(out, sourceName);
+    }
+}
+
+bool AggregateState::load(std::istream& in) {
+    AggregateState stored;
+    std::vector<ProductRecord> productRecords;
+    std::vector<BucketRecord> bucketRecords;
+    uint64_t sourceCount = 0;
+    if (!readHeader(in, AGGREGATE_STATE_TAG, AGGREGATE_STATE_VERSION) ||
+        !readValue(in, stored.bucketSeconds) || stored.bucketSeconds <= 0 ||
+        !readValue(in, stored.rows) ||
+        !readValue(in, stored.totals) ||
+        !readVector(in, productRecords) ||
+        !readVector(in, bucketRecords) ||
+        !stored.users.load(in) ||
+        !stored.sessions.load(in) ||
+        stored.users.getPrecision() != stored.sessions.getPrecision() ||
+        !stored.purchasePriceSketch.load(in) ||
+        !stored.heavyHitterTracker.load(in) ||
+        !readValue(in, sourceCount) || sourceCount > (uint64_t{ 1 } << 20)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < sourceCount; ++i) {
+        std::string sourceName;
+        if (!readString(in, sourceName)) return false;
+        stored.sourceNames.push_back(std::move(sourceName));
+    }
+
+    stored.products.reserve(productRecords.size());
+    for (const auto& record : productRecords) {
+        stored.products.emplace(record.prodId, record.stats);
+    }
+    for (const auto& record : bucketRecords) {
+        stored.buckets.emplace(record.start, record.summary);
+    }
+    *this = std::move(stored);
+    return true;
+}
+
+bool AggregateState::saveToFile(const std::string& fileName) const {
+    std::ofstream out(fileName, std::ios::binary);
+    save(out);
+    if (!out) {
+        std::cerr << "Aggregate state error: could not write " << fileName << "." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool AggregateState::loadFromFile(const std::string& fileName) {
+    std::ifstream in(fileName, std::ios::binary);
+    if (!in || !load(in)) {
+        std::cerr << "Aggregate state error: could not read " << fileName << "." << std::endl;
+        return false;
+    }
+    return true;
+}
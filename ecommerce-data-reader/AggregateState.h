@@ -0,0 +1,80 @@
+#pragma once
+#include "Analyzer.h"
+#include "DataStructure.h"
+#include "HyperLogLog.h"
+#include "QuantileSketch.h"
+
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Running totals that grow batch by batch instead of being recomputed from every row:
+// the summary, per-product stats, time buckets, distinct user and session counts,
+// purchase price quantiles and heavy hitters. Adding a batch costs O(batch), states
+// built separately merge, and the whole state persists to a file, so a new day of
+// events only needs that day parsed:
+//
+//     AggregateState state;
+//     state.loadFromFile("november.state");
+//     state.add(dayEvents, "2019-12-01.csv");
+//     state.saveToFile("november.state");
+//
+// Every batch must be added exactly once; named sources make repeated inputs detectable,
+// one source per input file.
+class AggregateState {
+public:
+    explicit AggregateState(int64_t bucketSeconds = 3600, uint8_t distinctPrecision = 14, size_t heavyHitterCount = 10);
+
+    void add(const ECommerceEvent& event);
+    // Adds a batch on all threads. A non-empty sourceName is recorded in sources().
+    void add(const std::vector<ECommerceEvent>& events, const std::string& sourceName = "");
+    // Adds rows [begin, end) of events, such as the rows of one input among several.
+    void add(const std::vector<ECommerceEvent>& events, size_t begin, size_t end, const std::string& sourceName = "");
+    // Throws std::invalid_argument if the bucket width or sketch precision differ.
+    void merge(const AggregateState& other);
+
+    uint64_t rowCount() const { return rows; }
+    int64_t getBucketSeconds() const { return bucketSeconds; }
+    const AnalysisSummary& summary() const { return totals; }
+    const ProductStatsMap& productStats() const { return products; }
+    // Series over the buckets that have events. bucketSeconds must be a multiple of the
+    // width the state was built with; 0 means that width.
+    TimeSeries timeSeries(int64_t bucketSeconds = 0) const;
+    DistinctCounts distinctCounts() const;
+    const QuantileSketch& purchasePrices() const { return purchasePriceSketch; }
+    HeavyHitterReport heavyHitters() const { return heavyHitterTracker.report(); }
+    const std::vector<std::string>& sources() const { return sourceNames; }
+    bool hasSource(const std::string& sourceName) const;
+    // Records an input whose rows arrived through add(event) or merge().
+    void addSource(const std::string& sourceName);
+    // The name an input file is recorded under: its canonical absolute path, so the same
+    // file reached through another relative path or a link is still recognized.
+    static std::string sourceNameFor(const std::string& filePath);
+
+    void save(std::ostream& out) const;
+    // Replaces this state with a saved one; on failure the state is left unchanged.
+    bool load(std::istream& in);
+    bool saveToFile(const std::string& fileName) const;
+    bool loadFromFile(const std::string& fileName);
+
+private:
+    // Everything add() does except the distinct-count sketches.
+    void addExceptDistinct(const ECommerceEvent& event);
+    // Adds rows [begin, end), feeding the distinct-count sketches in batches.
+    void addRows(const std::vector<ECommerceEvent>& events, size_t begin, size_t end);
+
+    int64_t bucketSeconds;
+    uint64_t rows = 0;
+    AnalysisSummary totals;
+    ProductStatsMap products;
+    // Sparse by bucket start, so batches from any period can be added in any order.
+    std::map<int64_t, AnalysisSummary> buckets;
+    HyperLogLog users;
+    HyperLogLog sessions;
+    QuantileSketch purchasePriceSketch;
+    HeavyHitterTracker heavyHitterTracker;
+    std::vector<std::string> sourceNames;
+};
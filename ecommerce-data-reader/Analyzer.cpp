@@ -1,42 +1,432 @@
 #include "Analyzer.h"
+#include "BinaryIO.h"
+#include "GroupBy.h"
+#include "Hashing.h"
+#include "HyperLogLog.h"
+#include "Kernels.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include "Partitioning.h"
+#include "TopK.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <map>
+#include <stdexcept>
+
+namespace {
+
+    // Above this many buckets between the first and last event, getTimeSeries switches from
+    // per-thread arrays to per-thread maps of the buckets actually used.
+    constexpr uint64_t MAX_DENSE_TIME_BUCKETS = 1 << 16;
+
+    // Rows whose user and session hashes are collected before each HyperLogLog::addAll.
+    constexpr size_t HASH_BATCH = 256;
+
+    struct DistinctSketches {
+        HyperLogLog users;
+        HyperLogLog sessions;
+
+        explicit DistinctSketches(uint8_t precision) : users(precision), sessions(precision) {}
+
+        void add(const ECommerceEvent& event) {
+            users.add(hashUint64(event.userId));
+            sessions.add(hashString(event.userSession));
+        }
+
+        // Hashes a block of rows first and then feeds the sketches through addAll.
+        void addRows(const std::vector<ECommerceEvent>& events, size_t begin, size_t end) {
+            std::array<uint64_t, HASH_BATCH> userHashes;
+            std::array<uint64_t, HASH_BATCH> sessionHashes;
+            for (size_t offset = begin; offset < end; offset += HASH_BATCH) {
+                const size_t batchSize = std::min(HASH_BATCH, end - offset);
+                for (size_t i = 0; i < batchSize; ++i) {
+                    userHashes[i] = hashUint64(events[offset + i].userId);
+                    sessionHashes[i] = hashString(events[offset + i].userSession);
+                }
+                users.addAll(userHashes.data(), batchSize);
+                sessions.addAll(sessionHashes.data(), batchSize);
+            }
+        }
+
+        DistinctCounts estimate() const {
+            return { users.estimate(), sessions.estimate() };
+        }
+    };
+
+    // Keys are hash-partitioned across threads so each key's sketches exist exactly once,
+    // keeping memory at a few KB per key regardless of the thread count.
+    template<typename KeyFn>
+    std::unordered_map<uint64_t, DistinctCounts> distinctCountsByKey(const std::vector<ECommerceEvent>& events, uint8_t precision, KeyFn keyFn) {
+        if (precision < HyperLogLog::MIN_PRECISION || precision > HyperLogLog::MAX_PRECISION) {
+            throw std::invalid_argument("HyperLogLog precision must be between 4 and 18");
+        }
+        const size_t partitionCount = getThreadCount();
+        PartitionedRows rows = partitionRows(events, partitionCount, [&](const ECommerceEvent& event) {
+            return hashUint64(keyFn(event));
+            });
+
+        std::vector<std::unordered_map<uint64_t, DistinctCounts>> partials(partitionCount);
+        parallelChunks(partitionCount, partitionCount, [&](size_t chunk, size_t begin, size_t end) {
+            for (size_t partition = begin; partition < end; ++partition) {
+                std::unordered_map<uint64_t, DistinctSketches> sketches;
+                forEachPartitionRow(rows, partition, [&](uint32_t row) {
+                    const ECommerceEvent& event = events[row];
+                    auto it = sketches.try_emplace(keyFn(event), precision).first;
+                    it->second.add(event);
+                    });
+                for (const auto& entry : sketches) {
+                    partials[chunk].emplace(entry.first, entry.second.estimate());
+                }
+            }
+            });
+
+        std::unordered_map<uint64_t, DistinctCounts> result;
+        for (auto& partial : partials) {
+            result.insert(partial.begin(), partial.end());
+        }
+        return result;
+    }
+
+    template<typename Key>
+    std::unordered_map<std::string_view, PriceQuantiles> priceQuantilesByKey(const std::vector<ECommerceEvent>& events) {
+        auto grouped = GroupBy<Key, PurchasePriceQuantiles<>>::run(events);
+
+        std::unordered_map<std::string_view, PriceQuantiles> result;
+        for (const auto& group : grouped.states()) {
+            const QuantileSketch& sketch = std::get<0>(group.second);
+            if (sketch.count() == 0) continue;
+            result[group.first] = { sketch.count(), sketch.quantile(0.50), sketch.quantile(0.90), sketch.quantile(0.99) };
+        }
+        return result;
+    }
+
+    double scoreProduct(const ProductStats& stats, RankMetric metric) {
+        switch (metric) {
+        case RankMetric::CONVERSION_RATE:
+            return stats.viewCount == 0 ? 0.0 : static_cast<double>(stats.purchaseCount) / stats.viewCount * 100.0;
+        case RankMetric::PURCHASES:
+            return static_cast<double>(stats.purchaseCount);
+        case RankMetric::REVENUE:
+            return stats.revenue;
+        }
+        return 0.0;
+    }
+
+    struct RankedProductLess {
+        bool operator()(const RankedProduct& a, const RankedProduct& b) const {
+            if (a.score != b.score) return a.score < b.score;
+            return a.prodId > b.prodId;
+        }
+    };
+
+}
+
+// Candidate sets are kept several times larger than the report so that keys whose
+// estimates are close to the cut-off are not evicted early.
+HeavyHitterTracker::HeavyHitterTracker(size_t topN)
+    : topN(topN),
+    viewedProducts(topN * 4),
+    cartedProducts(topN * 4),
+    purchasedProducts(topN * 4),
+    activeUsers(topN * 4) {
+}
+
+void HeavyHitterTracker::add(const ECommerceEvent& event) {
+    switch (event.eventType) {
+    case EventType::VIEW:
+        viewedProducts.add(event.prodId);
+        break;
+    case EventType::CART:
+        cartedProducts.add(event.prodId);
+        break;
+    case EventType::PURCHASE:
+        purchasedProducts.add(event.prodId);
+        break;
+    case EventType::REMOVE_FROM_CART:
+    case EventType::UNKNOWN:
+        break;
+    }
+    activeUsers.add(event.userId);
+}
+
+void HeavyHitterTracker::merge(const HeavyHitterTracker& other) {
+    viewedProducts.merge(other.viewedProducts);
+    cartedProducts.merge(other.cartedProducts);
+    purchasedProducts.merge(other.purchasedProducts);
+    activeUsers.merge(other.activeUsers);
+}
+
+HeavyHitterReport HeavyHitterTracker::report() const {
+    return { viewedProducts.top(topN), cartedProducts.top(topN), purchasedProducts.top(topN), activeUsers.top(topN) };
+}
+
+void HeavyHitterTracker::save(std::ostream& out) const {
+    writeValue(out, static_cast<uint64_t>(topN));
+    viewedProducts.save(out);
+    cartedProducts.save(out);
+    purchasedProducts.save(out);
+    activeUsers.save(out);
+}
+
+bool HeavyHitterTracker::load(std::istream& in) {
+    uint64_t storedTopN = 0;
+    if (!readValue(in, storedTopN) ||
+        !viewedProducts.load(in) ||
+        !cartedProducts.load(in) ||
+        !purchasedProducts.load(in) ||
+        !activeUsers.load(in)) {
+        return false;
+    }
+    topN = static_cast<size_t>(storedTopN);
+    return true;
+}
 
 AnalysisSummary Analyzer::getSummary(const std::vector<ECommerceEvent>& events) {
+    METRIC_TIMER("analysis.summary");
     AnalysisSummary summary;
 
     for (const auto& event : events) {
-        switch (event.eventType) {
-        case EventType::VIEW:
-            summary.viewCount++;
-            break;
-        case EventType::CART:
-            summary.cartCount++;
-            break;
-        case EventType::REMOVE_FROM_CART:
-            summary.removeCount++;
-            break;
-        case EventType::PURCHASE:
-            summary.purchaseCount++;
-            summary.totalRevenue += event.price;
-            break;
-        case EventType::UNKNOWN:
-            break;
-        }
+        addToSummary(summary, event);
     }
     return summary;
 }
 
+AnalysisSummary Analyzer::getSummary(const EventColumns& columns) {
+    METRIC_TIMER("analysis.summaryColumns");
+    const size_t chunkCount = getThreadCount();
+    std::vector<AnalysisSummary> partials(chunkCount);
+    parallelChunks(columns.size(), chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+        const uint8_t* eventTypes = columns.eventTypes.data() + begin;
+        const EventTypeCounts counts = countEventTypes(eventTypes, end - begin);
+        AnalysisSummary& summary = partials[chunk];
+        summary.viewCount = counts[EventType::VIEW];
+        summary.cartCount = counts[EventType::CART];
+        summary.removeCount = counts[EventType::REMOVE_FROM_CART];
+        summary.purchaseCount = counts[EventType::PURCHASE];
+        summary.totalRevenue = sumPurchaseRevenue(eventTypes, columns.prices.data() + begin, end - begin);
+        });
+
+    AnalysisSummary summary;
+    for (const auto& partial : partials) {
+        mergeSummary(summary, partial);
+    }
+    return summary;
+}
+
+AnalysisSummary Analyzer::getSummary(const std::vector<ECommerceEvent>& events, RowRange rows) {
+    METRIC_TIMER("analysis.summaryRows");
+    AnalysisSummary summary;
+
+    for (uint32_t row : rows) {
+        addToSummary(summary, events[row]);
+    }
+    return summary;
+}
+
+AnalysisSummary Analyzer::getSummary(const std::vector<ECommerceEvent>& events, const ZoneMap& zones, const RangePredicate& predicate) {
+    METRIC_TIMER("analysis.summaryZones");
+    if (zones.getRowCount() != events.size()) {
+        throw std::invalid_argument("Zone map was built for a different event vector");
+    }
+    const std::vector<size_t> blocks = zones.candidateBlocks(predicate);
+    const size_t blockRows = zones.getBlockRows();
+    const size_t chunkCount = std::max<size_t>(1, std::min<size_t>(getThreadCount(), blocks.size()));
+
+    std::vector<AnalysisSummary> partials(chunkCount);
+    parallelChunks(blocks.size(), chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+        AnalysisSummary& summary = partials[chunk];
+        for (size_t i = begin; i < end; ++i) {
+            const size_t block = blocks[i];
+            const size_t first = block * blockRows;
+            const size_t last = std::min(events.size(), first + blockRows);
+            if (predicate.coversAll(zones.zone(block))) {
+                for (size_t row = first; row < last; ++row) addToSummary(summary, events[row]);
+            }
+            else {
+                for (size_t row = first; row < last; ++row) {
+                    if (predicate.matches(events[row])) addToSummary(summary, events[row]);
+                }
+            }
+        }
+        });
+
+    for (size_t chunk = 1; chunk < chunkCount; ++chunk) {
+        mergeSummary(partials[0], partials[chunk]);
+    }
+    return partials[0];
+}
+
 ProductStatsMap Analyzer::getProductStats(const std::vector<ECommerceEvent>& events) {
-    std::unordered_map <uint64_t, std::pair<size_t, size_t>> purchaseMap;
+    METRIC_TIMER("analysis.productStats");
+    auto grouped = GroupBy<ProductKey,
+        CountIf<EventType::VIEW>,
+        CountIf<EventType::CART>,
+        CountIf<EventType::PURCHASE>,
+        SumIf<EventType::PURCHASE, Price>>::run(events);
 
-    for (const auto& event : events) {
-        switch (event.eventType) {
-        case EventType::VIEW:
-            purchaseMap[event.prodId].first++;
-            break;
-        case EventType::PURCHASE:
-            purchaseMap[event.prodId].second++;
-            break;
+    ProductStatsMap statsMap;
+    statsMap.reserve(grouped.states().size());
+    for (const auto& group : grouped.states()) {
+        ProductStats& stats = statsMap[group.first];
+        std::tie(stats.viewCount, stats.cartCount, stats.purchaseCount, stats.revenue) = group.second;
+    }
+    return statsMap;
+}
+
+std::vector<RankedProduct> Analyzer::getTopProducts(const ProductStatsMap& stats, const TopKOptions& options) {
+    METRIC_TIMER("analysis.topProducts");
+    // Each thread selects its own top K from a disjoint range of hash buckets; the
+    // per-thread heaps are merged at the end, so no candidate list is ever fully sorted.
+    const size_t bucketCount = stats.bucket_count();
+    const size_t chunkCount = std::min<size_t>(getThreadCount(), bucketCount);
+
+    std::vector<TopK<RankedProduct, RankedProductLess>> partials(chunkCount, TopK<RankedProduct, RankedProductLess>(options.k));
+
+    parallelChunks(bucketCount, chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+        auto& topK = partials[chunk];
+        for (size_t bucket = begin; bucket < end; ++bucket) {
+            for (auto it = stats.begin(bucket); it != stats.end(bucket); ++it) {
+                const ProductStats& productStats = it->second;
+                if (productStats.viewCount <= options.viewThreshold || productStats.purchaseCount <= options.purchaseThreshold) {
+                    continue;
+                }
+                topK.push({ it->first, productStats, scoreProduct(productStats, options.metric) });
+            }
         }
+        });
+
+    TopK<RankedProduct, RankedProductLess> merged(options.k);
+    for (const auto& partial : partials) {
+        merged.merge(partial);
+    }
+    return merged.sortedDescending();
+}
+
+TimeSeries Analyzer::getTimeSeries(const std::vector<ECommerceEvent>& events, int64_t bucketSeconds) {
+    METRIC_TIMER("analysis.timeSeries");
+    TimeSeries series;
+    series.bucketSeconds = bucketSeconds;
+    if (events.empty() || bucketSeconds <= 0) return series;
+
+    const size_t chunkCount = getThreadCount();
+
+    std::vector<std::pair<int64_t, int64_t>> ranges(chunkCount,
+        { std::numeric_limits<int64_t>::max(), std::numeric_limits<int64_t>::min() });
+    parallelChunks(events.size(), chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+        auto range = ranges[chunk];
+        for (size_t row = begin; row < end; ++row) {
+            range.first = std::min(range.first, events[row].timestamp);
+            range.second = std::max(range.second, events[row].timestamp);
+        }
+        ranges[chunk] = range;
+        });
+
+    int64_t minTime = std::numeric_limits<int64_t>::max();
+    int64_t maxTime = std::numeric_limits<int64_t>::min();
+    for (const auto& range : ranges) {
+        minTime = std::min(minTime, range.first);
+        maxTime = std::max(maxTime, range.second);
+    }
+
+    const int64_t startTime = floorToBucket(minTime, bucketSeconds);
+    const uint64_t span = static_cast<uint64_t>(maxTime) - static_cast<uint64_t>(startTime);
+    if (span / static_cast<uint64_t>(bucketSeconds) < MAX_DENSE_TIME_BUCKETS) {
+        // Every thread fills a private dense bucket array, so the hot loop is one division
+        // and an indexed update with no sharing; the arrays are summed afterwards.
+        const size_t bucketCount = static_cast<size_t>(span / static_cast<uint64_t>(bucketSeconds)) + 1;
+        std::vector<std::vector<AnalysisSummary>> partials(chunkCount);
+        parallelChunks(events.size(), chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+            std::vector<AnalysisSummary> buckets(bucketCount);
+            for (size_t row = begin; row < end; ++row) {
+                const ECommerceEvent& event = events[row];
+                addToSummary(buckets[static_cast<size_t>((event.timestamp - startTime) / bucketSeconds)], event);
+            }
+            partials[chunk] = std::move(buckets);
+            });
+
+        for (size_t bucket = 0; bucket < bucketCount; ++bucket) {
+            AnalysisSummary summary;
+            for (const auto& partial : partials) {
+                if (!partial.empty()) mergeSummary(summary, partial[bucket]);
+            }
+            if (summaryEventCount(summary) == 0) continue;
+            series.bucketStarts.push_back(startTime + static_cast<int64_t>(bucket) * bucketSeconds);
+            series.buckets.push_back(summary);
+        }
+        return series;
+    }
+
+    // Too many buckets to allocate densely, e.g. narrow buckets over years of data: each
+    // thread keeps only the buckets it saw.
+    std::vector<std::unordered_map<int64_t, AnalysisSummary>> partials(chunkCount);
+    parallelChunks(events.size(), chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+        auto& buckets = partials[chunk];
+        for (size_t row = begin; row < end; ++row) {
+            addToSummary(buckets[floorToBucket(events[row].timestamp, bucketSeconds)], events[row]);
+        }
+        });
+    std::map<int64_t, AnalysisSummary> merged;
+    for (const auto& partial : partials) {
+        for (const auto& bucket : partial) {
+            mergeSummary(merged[bucket.first], bucket.second);
+        }
+    }
+    for (const auto& bucket : merged) {
+        series.bucketStarts.push_back(bucket.first);
+        series.buckets.push_back(bucket.second);
+    }
+    return series;
+}
+
+DistinctCounts Analyzer::getDistinctCounts(const std::vector<ECommerceEvent>& events, uint8_t precision) {
+    METRIC_TIMER("analysis.distinctCounts");
+    const size_t chunkCount = getThreadCount();
+    std::vector<DistinctSketches> partials(chunkCount, DistinctSketches(precision));
+    parallelChunks(events.size(), chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+        partials[chunk].addRows(events, begin, end);
+        });
+
+    for (size_t chunk = 1; chunk < chunkCount; ++chunk) {
+        partials[0].users.merge(partials[chunk].users);
+        partials[0].sessions.merge(partials[chunk].sessions);
+    }
+    return partials[0].estimate();
+}
+
+std::unordered_map<uint64_t, DistinctCounts> Analyzer::getDistinctCountsByProduct(const std::vector<ECommerceEvent>& events, uint8_t precision) {
+    METRIC_TIMER("analysis.distinctCountsByProduct");
+    return distinctCountsByKey(events, precision, [](const ECommerceEvent& event) { return event.prodId; });
+}
+
+std::unordered_map<uint64_t, DistinctCounts> Analyzer::getDistinctCountsByCategory(const std::vector<ECommerceEvent>& events, uint8_t precision) {
+    METRIC_TIMER("analysis.distinctCountsByCategory");
+    return distinctCountsByKey(events, precision, [](const ECommerceEvent& event) { return event.categoryId; });
+}
+
+std::unordered_map<std::string_view, PriceQuantiles> Analyzer::getPriceQuantilesByCategory(const std::vector<ECommerceEvent>& events) {
+    METRIC_TIMER("analysis.priceQuantilesByCategory");
+    return priceQuantilesByKey<TopCategoryKey>(events);
+}
+
+std::unordered_map<std::string_view, PriceQuantiles> Analyzer::getPriceQuantilesByBrand(const std::vector<ECommerceEvent>& events) {
+    METRIC_TIMER("analysis.priceQuantilesByBrand");
+    return priceQuantilesByKey<BrandKey>(events);
+}
+
+HeavyHitterReport Analyzer::getHeavyHitters(const std::vector<ECommerceEvent>& events, size_t topN) {
+    METRIC_TIMER("analysis.heavyHitters");
+    const size_t chunkCount = getThreadCount();
+    std::vector<HeavyHitterTracker> partials(chunkCount, HeavyHitterTracker(topN));
+    parallelChunks(events.size(), chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row) {
+            partials[chunk].add(events[row]);
+        }
+        });
+
+    for (size_t chunk = 1; chunk < chunkCount; ++chunk) {
+        partials[0].merge(partials[chunk]);
     }
-    return purchaseMap;
+    return partials[0].report();
 }
@@ -1,6 +1,11 @@
 #pragma once
 
+#include "CountMinSketch.h"
 #include "DataStructure.h"
+#include "EventIndex.h"
+#include "ZoneMap.h"
+#include <istream>
+#include <ostream>
 #include <vector>
 #include <string>
 #include <unordered_map>
@@ -14,11 +19,221 @@ struct AnalysisSummary {
     size_t purchaseCount = 0;
 };
 
-using ProductStatsMap = std::unordered_map<uint64_t, std::pair<size_t, size_t>>;
+inline void addToSummary(AnalysisSummary& summary, const ECommerceEvent& event) {
+    switch (event.eventType) {
+    case EventType::VIEW:
+        summary.viewCount++;
+        break;
+    case EventType::CART:
+        summary.cartCount++;
+        break;
+    case EventType::REMOVE_FROM_CART:
+        summary.removeCount++;
+        break;
+    case EventType::PURCHASE:
+        summary.purchaseCount++;
+        summary.totalRevenue += event.price;
+        break;
+    case EventType::UNKNOWN:
+        break;
+    }
+}
+
+inline size_t summaryEventCount(const AnalysisSummary& summary) {
+    return summary.viewCount + summary.cartCount + summary.removeCount + summary.purchaseCount;
+}
+
+inline void mergeSummary(AnalysisSummary& target, const AnalysisSummary& source) {
+    target.totalRevenue += source.totalRevenue;
+    target.viewCount += source.viewCount;
+    target.cartCount += source.cartCount;
+    target.removeCount += source.removeCount;
+    target.purchaseCount += source.purchaseCount;
+}
+
+// Per-bucket summaries of the buckets that have events, in time order; bucket i covers
+// [bucketStarts[i], bucketStarts[i] + bucketSeconds) in epoch seconds. Empty buckets are
+// left out, so a wide time range costs nothing for the gaps.
+struct TimeSeries {
+    int64_t bucketSeconds = 0;
+    std::vector<int64_t> bucketStarts;
+    std::vector<AnalysisSummary> buckets;
+};
+
+struct ProductStats {
+    size_t viewCount = 0;
+    size_t cartCount = 0;
+    size_t purchaseCount = 0;
+    double revenue = 0.0;
+};
+
+using ProductStatsMap = std::unordered_map<uint64_t, ProductStats>;
+
+enum class RankMetric {
+    CONVERSION_RATE,
+    PURCHASES,
+    REVENUE
+};
+
+struct TopKOptions {
+    size_t k = 10;
+    RankMetric metric = RankMetric::CONVERSION_RATE;
+    // Only products strictly above both thresholds are ranked.
+    size_t viewThreshold = 100;
+    size_t purchaseThreshold = 10;
+};
+
+struct RankedProduct {
+    uint64_t prodId = 0;
+    ProductStats stats;
+    double score = 0.0;
+};
+
+struct FunnelStats {
+    size_t sessionCount = 0;
+    size_t viewSessions = 0;
+    size_t cartSessions = 0;
+    size_t purchaseSessions = 0;
+    // Share of sessions that reached the earlier stage but not the next one.
+    double viewToCartDropOff = 0.0;
+    double cartToPurchaseDropOff = 0.0;
+    double medianViewToCartSeconds = 0.0;
+    double medianCartToPurchaseSeconds = 0.0;
+};
+
+struct SessionRecord {
+    std::string_view sessionId;
+    uint64_t userId = 0;
+    int64_t startTime = 0;
+    int64_t endTime = 0;
+    size_t viewCount = 0;
+    size_t cartCount = 0;
+    size_t removeCount = 0;
+    size_t purchaseCount = 0;
+    size_t distinctProductsViewed = 0;
+    double cartValue = 0.0;
+    double purchaseValue = 0.0;
+    bool converted = false;
+
+    int64_t durationSeconds() const { return endTime - startTime; }
+};
+
+// Approximate distinct counts from HyperLogLog sketches.
+struct DistinctCounts {
+    double users = 0.0;
+    double sessions = 0.0;
+};
+
+struct PriceQuantiles {
+    uint64_t purchaseCount = 0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+};
+
+// Approximate (key, count) leaders; counts may be overestimated but never underestimated.
+struct HeavyHitterReport {
+    std::vector<std::pair<uint64_t, uint64_t>> topViewedProducts;
+    std::vector<std::pair<uint64_t, uint64_t>> topCartedProducts;
+    std::vector<std::pair<uint64_t, uint64_t>> topPurchasedProducts;
+    std::vector<std::pair<uint64_t, uint64_t>> mostActiveUsers;
+};
+
+// Fixed-memory tracker for the most viewed, carted and purchased products and the most
+// active users. Events can be fed one at a time, and per-thread trackers merge.
+class HeavyHitterTracker {
+public:
+    explicit HeavyHitterTracker(size_t topN);
+
+    void add(const ECommerceEvent& event);
+    void merge(const HeavyHitterTracker& other);
+    HeavyHitterReport report() const;
+    size_t getTopN() const { return topN; }
+
+    void save(std::ostream& out) const;
+    bool load(std::istream& in);
+
+private:
+    size_t topN;
+    HeavyHitters viewedProducts;
+    HeavyHitters cartedProducts;
+    HeavyHitters purchasedProducts;
+    HeavyHitters activeUsers;
+};
+
+// Users grouped by the UTC calendar month of their first purchase. activeUsers[c][k] is
+// the number of users in cohort c who purchased k months after their first purchase
+// month, so activeUsers[c][0] is the cohort size. Cohort c starts at month
+// (firstYear, firstMonth) plus c months; rows are cut off at the last month in the data.
+struct CohortRetention {
+    int firstYear = 0;
+    int firstMonth = 0;
+    std::vector<std::vector<size_t>> activeUsers;
+
+    size_t cohortSize(size_t cohort) const { return activeUsers[cohort].empty() ? 0 : activeUsers[cohort][0]; }
+    double retentionRate(size_t cohort, size_t monthsLater) const {
+        const size_t size = cohortSize(cohort);
+        return size == 0 ? 0.0 : static_cast<double>(activeUsers[cohort][monthsLater]) / size;
+    }
+};
+
+struct CoOccurrenceOptions {
+    // Distinct products kept per session, in order of first appearance; a session with
+    // n products emits n * (n - 1) / 2 pairs, so this bounds the cost of bot-like sessions.
+    size_t maxProductsPerSession = 30;
+    size_t topPartnersPerProduct = 5;
+    // Pairs seen together in fewer sessions are dropped.
+    uint32_t minSessions = 2;
+};
+
+struct ProductPartner {
+    uint64_t prodId = 0;
+    uint32_t sessions = 0;
+};
+
+// Products carted or purchased in the same session. partners[p] lists the products that
+// most often share a session with p, most frequent first.
+struct CoOccurrenceReport {
+    std::unordered_map<uint64_t, std::vector<ProductPartner>> partners;
+    size_t sessionCount = 0;
+    size_t cappedSessions = 0;
+    size_t distinctPairs = 0;
+};
+
+// Category and brand breakdowns attribute each session to its entry (earliest) event.
+struct FunnelReport {
+    FunnelStats overall;
+    std::unordered_map<std::string_view, FunnelStats> byCategory;
+    std::unordered_map<std::string_view, FunnelStats> byBrand;
+};
 
 
 class Analyzer {
 public:
     AnalysisSummary getSummary(const std::vector<ECommerceEvent>& events);
+    // Summary over selected rows only, e.g. an index lookup or a filter result.
+    AnalysisSummary getSummary(const std::vector<ECommerceEvent>& events, RowRange rows);
+    // Summary of the rows matching the predicate; blocks the zone map rules out are skipped.
+    AnalysisSummary getSummary(const std::vector<ECommerceEvent>& events, const ZoneMap& zones, const RangePredicate& predicate);
+    // Same totals from the dense type and price columns, using the SIMD kernels.
+    AnalysisSummary getSummary(const EventColumns& columns);
     ProductStatsMap getProductStats(const std::vector<ECommerceEvent>& events);
+    std::vector<RankedProduct> getTopProducts(const ProductStatsMap& stats, const TopKOptions& options);
+    TimeSeries getTimeSeries(const std::vector<ECommerceEvent>& events, int64_t bucketSeconds);
+    FunnelReport getSessionFunnel(const std::vector<ECommerceEvent>& events);
+    // One record per userSession, in no particular order.
+    std::vector<SessionRecord> getSessions(const std::vector<ECommerceEvent>& events);
+    bool exportSessionsCsv(const std::vector<SessionRecord>& sessions, const std::string& fileName);
+    DistinctCounts getDistinctCounts(const std::vector<ECommerceEvent>& events, uint8_t precision = 14);
+    std::unordered_map<uint64_t, DistinctCounts> getDistinctCountsByProduct(const std::vector<ECommerceEvent>& events, uint8_t precision = 10);
+    std::unordered_map<uint64_t, DistinctCounts> getDistinctCountsByCategory(const std::vector<ECommerceEvent>& events, uint8_t precision = 12);
+    HeavyHitterReport getHeavyHitters(const std::vector<ECommerceEvent>& events, size_t topN = 10);
+    // Approximate purchase price percentiles; rank error is about 1.65% (see QuantileSketch).
+    std::unordered_map<std::string_view, PriceQuantiles> getPriceQuantilesByCategory(const std::vector<ECommerceEvent>& events);
+    std::unordered_map<std::string_view, PriceQuantiles> getPriceQuantilesByBrand(const std::vector<ECommerceEvent>& events);
+    // Monthly first-purchase cohorts and their repeat-purchase counts, in two passes that
+    // are linear in rows, over any number of months.
+    CohortRetention getCohortRetention(const std::vector<ECommerceEvent>& events);
+    // "Carted or bought together" pairs, counted once per session.
+    CoOccurrenceReport getCoOccurrence(const std::vector<ECommerceEvent>& events, const CoOccurrenceOptions& options = CoOccurrenceOptions());
 };
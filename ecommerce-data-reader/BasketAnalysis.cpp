@@ -0,0 +1,175 @@
+#include "Analyzer.h"
+#include "Hashing.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include "Partitioning.h"
+#include "TopK.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+namespace {
+
+    bool isBasketEvent(const ECommerceEvent& event) {
+        return event.eventType == EventType::CART || event.eventType == EventType::PURCHASE;
+    }
+
+    // Two dense product ordinals, smaller one in the high half.
+    uint64_t pairKey(uint32_t first, uint32_t second) {
+        return (static_cast<uint64_t>(first) << 32) | second;
+    }
+
+    struct ProductOrdinals {
+        std::unordered_map<uint64_t, uint32_t> byProduct;
+        std::vector<uint64_t> products;
+    };
+
+    ProductOrdinals numberBasketProducts(const std::vector<ECommerceEvent>& events) {
+        const size_t chunkCount = getThreadCount();
+        std::vector<std::unordered_set<uint64_t>> partials(chunkCount);
+        parallelChunks(events.size(), chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+            for (size_t row = begin; row < end; ++row) {
+                if (isBasketEvent(events[row])) partials[chunk].insert(events[row].prodId);
+            }
+            });
+
+        ProductOrdinals ordinals;
+        for (const auto& partial : partials) {
+            for (uint64_t prodId : partial) {
+                if (ordinals.byProduct.try_emplace(prodId, static_cast<uint32_t>(ordinals.products.size())).second) {
+                    ordinals.products.push_back(prodId);
+                }
+            }
+        }
+        return ordinals;
+    }
+
+    // Distinct products of one session in order of first appearance, at most limit of them.
+    // Returns false if the session had to be cut.
+    bool distinctProducts(const std::vector<uint32_t>& products, size_t limit, std::vector<uint32_t>& result) {
+        result = products;
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        if (result.size() <= limit) return true;
+
+        std::vector<uint32_t> distinct;
+        distinct.swap(result);
+        std::vector<char> taken(distinct.size(), 0);
+        for (uint32_t product : products) {
+            const size_t index = std::lower_bound(distinct.begin(), distinct.end(), product) - distinct.begin();
+            if (taken[index]) continue;
+            taken[index] = 1;
+            result.push_back(product);
+            if (result.size() == limit) break;
+        }
+        std::sort(result.begin(), result.end());
+        return false;
+    }
+
+    struct PartnerCandidate {
+        uint32_t product;
+        ProductPartner partner;
+    };
+
+    // Most sessions first; ties go to the smaller product id so results do not depend on
+    // the thread count.
+    struct PartnerLess {
+        bool operator()(const ProductPartner& a, const ProductPartner& b) const {
+            if (a.sessions != b.sessions) return a.sessions < b.sessions;
+            return a.prodId > b.prodId;
+        }
+    };
+
+}
+
+CoOccurrenceReport Analyzer::getCoOccurrence(const std::vector<ECommerceEvent>& events, const CoOccurrenceOptions& options) {
+    METRIC_TIMER("analysis.coOccurrence");
+    const size_t partitionCount = getThreadCount();
+    const ProductOrdinals ordinals = numberBasketProducts(events);
+
+    // 1. Sessions: each thread owns whole sessions, reduces them to distinct products and
+    //    scatters their pair keys into pair partitions.
+    const std::hash<std::string_view> sessionHash;
+    PartitionedRows rows = partitionRowsIf(events, partitionCount,
+        [&](const ECommerceEvent& event) { return sessionHash(event.userSession); }, isBasketEvent);
+
+    std::vector<std::vector<std::vector<uint64_t>>> pairKeys(partitionCount, std::vector<std::vector<uint64_t>>(partitionCount));
+    std::vector<size_t> sessionCounts(partitionCount, 0);
+    std::vector<size_t> cappedCounts(partitionCount, 0);
+    parallelChunks(partitionCount, partitionCount, [&](size_t, size_t begin, size_t end) {
+        for (size_t partition = begin; partition < end; ++partition) {
+            std::unordered_map<std::string_view, uint32_t> sessionIndex;
+            std::vector<std::vector<uint32_t>> sessionProducts;
+            forEachPartitionRow(rows, partition, [&](uint32_t row) {
+                const ECommerceEvent& event = events[row];
+                auto inserted = sessionIndex.try_emplace(event.userSession, static_cast<uint32_t>(sessionProducts.size()));
+                if (inserted.second) sessionProducts.emplace_back();
+                sessionProducts[inserted.first->second].push_back(ordinals.byProduct.at(event.prodId));
+                });
+
+            auto& localKeys = pairKeys[partition];
+            std::vector<uint32_t> products;
+            for (const auto& session : sessionProducts) {
+                if (!distinctProducts(session, options.maxProductsPerSession, products)) cappedCounts[partition]++;
+                for (size_t i = 0; i < products.size(); ++i) {
+                    for (size_t j = i + 1; j < products.size(); ++j) {
+                        const uint64_t key = pairKey(products[i], products[j]);
+                        localKeys[hashUint64(key) % partitionCount].push_back(key);
+                    }
+                }
+            }
+            sessionCounts[partition] = sessionProducts.size();
+        }
+        });
+    rows.clear();
+
+    // 2. Pairs: each thread counts one pair partition, then hands the frequent pairs to
+    //    the threads owning either product.
+    std::vector<std::vector<std::vector<PartnerCandidate>>> candidates(partitionCount, std::vector<std::vector<PartnerCandidate>>(partitionCount));
+    std::vector<size_t> pairCounts(partitionCount, 0);
+    parallelChunks(partitionCount, partitionCount, [&](size_t, size_t begin, size_t end) {
+        for (size_t partition = begin; partition < end; ++partition) {
+            std::unordered_map<uint64_t, uint32_t> counts;
+            for (auto& chunkKeys : pairKeys) {
+                for (uint64_t key : chunkKeys[partition]) counts[key]++;
+                std::vector<uint64_t>().swap(chunkKeys[partition]);
+            }
+            pairCounts[partition] = counts.size();
+
+            auto& localCandidates = candidates[partition];
+            for (const auto& pair : counts) {
+                if (pair.second < options.minSessions) continue;
+                const uint32_t first = static_cast<uint32_t>(pair.first >> 32);
+                const uint32_t second = static_cast<uint32_t>(pair.first);
+                localCandidates[first % partitionCount].push_back({ first, { ordinals.products[second], pair.second } });
+                localCandidates[second % partitionCount].push_back({ second, { ordinals.products[first], pair.second } });
+            }
+        }
+        });
+
+    // 3. Products: each thread keeps a bounded heap per product it owns.
+    std::vector<std::unordered_map<uint64_t, std::vector<ProductPartner>>> partials(partitionCount);
+    parallelChunks(partitionCount, partitionCount, [&](size_t, size_t begin, size_t end) {
+        for (size_t partition = begin; partition < end; ++partition) {
+            std::unordered_map<uint32_t, TopK<ProductPartner, PartnerLess>> best;
+            for (const auto& pairPartition : candidates) {
+                for (const auto& candidate : pairPartition[partition]) {
+                    auto it = best.try_emplace(candidate.product, options.topPartnersPerProduct).first;
+                    it->second.push(candidate.partner);
+                }
+            }
+            for (const auto& product : best) {
+                partials[partition].emplace(ordinals.products[product.first], product.second.sortedDescending());
+            }
+        }
+        });
+
+    CoOccurrenceReport report;
+    for (size_t partition = 0; partition < partitionCount; ++partition) {
+        report.sessionCount += sessionCounts[partition];
+        report.cappedSessions += cappedCounts[partition];
+        report.distinctPairs += pairCounts[partition];
+        report.partners.merge(partials[partition]);
+    }
+    return report;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Minimal native-endian binary serialization used by the persisted indexes and
+// aggregate state. Readers return false on a short or malformed stream.
+
+template<typename T>
+void writeValue(std::ostream& out, const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "writeValue needs a trivially copyable type");
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool readValue(std::istream& in, T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "readValue needs a trivially copyable type");
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template<typename T>
+void writeVector(std::ostream& out, const std::vector<T>& values) {
+    static_assert(std::is_trivially_copyable<T>::value, "writeVector needs a trivially copyable type");
+    writeValue(out, static_cast<uint64_t>(values.size()));
+    if (!values.empty()) {
+        out.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+    }
+}
+
+template<typename T>
+bool readVector(std::istream& in, std::vector<T>& values, uint64_t maxSize = uint64_t{ 1 } << 32) {
+    static_assert(std::is_trivially_copyable<T>::value, "readVector needs a trivially copyable type");
+    uint64_t size = 0;
+    if (!readValue(in, size) || size > maxSize) return false;
+    values.resize(static_cast<size_t>(size));
+    if (size == 0) return true;
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(size * sizeof(T))));
+}
+
+inline void writeString(std::ostream& out, std::string_view text) {
+    writeValue(out, static_cast<uint64_t>(text.size()));
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+}
+
+inline bool readString(std::istream& in, std::string& text, uint64_t maxSize = uint64_t{ 1 } << 20) {
+    uint64_t size = 0;
+    if (!readValue(in, size) || size > maxSize) return false;
+    text.resize(static_cast<size_t>(size));
+    return size == 0 || static_cast<bool>(in.read(&text[0], static_cast<std::streamsize>(size)));
+}
+
+// Every persisted structure starts with a four-byte tag and a version number.
+inline void writeHeader(std::ostream& out, const char (&tag)[5], uint32_t version) {
+    out.write(tag, 4);
+    writeValue(out, version);
+}
+
+inline bool readHeader(std::istream& in, const char (&tag)[5], uint32_t version) {
+    char found[4];
+    uint32_t foundVersion = 0;
+    if (!in.read(found, 4) || !readValue(in, foundVersion)) return false;
+    return std::equal(found, found + 4, tag) && foundVersion == version;
+}
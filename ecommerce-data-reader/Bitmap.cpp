@@ -0,0 +1,286 @@
+#include "Bitmap.h"
+#include "Hashing.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+    using Container = RowBitmap::Container;
+
+    constexpr size_t CONTAINER_BITS = 16;
+    constexpr size_t BITSET_WORDS = (size_t{ 1 } << CONTAINER_BITS) / 64;
+    constexpr uint32_t ARRAY_LIMIT = 4096;
+
+    void setBit(std::vector<uint64_t>& bits, uint16_t offset) {
+        bits[offset >> 6] |= uint64_t{ 1 } << (offset & 63);
+    }
+
+    std::vector<uint64_t> toBitset(const Container& container) {
+        if (container.isBitset()) return container.bits;
+        std::vector<uint64_t> bits(BITSET_WORDS, 0);
+        for (uint16_t offset : container.array) {
+            setBit(bits, offset);
+        }
+        return bits;
+    }
+
+    // Recounts a bitset container and demotes it to an array when it has become sparse.
+    void normalize(Container& container) {
+        if (!container.isBitset()) {
+            container.cardinality = static_cast<uint32_t>(container.array.size());
+            return;
+        }
+        uint32_t cardinality = 0;
+        for (uint64_t word : container.bits) {
+            cardinality += popCount64(word);
+        }
+        container.cardinality = cardinality;
+        if (cardinality > ARRAY_LIMIT) return;
+
+        container.array.clear();
+        container.array.reserve(cardinality);
+        for (size_t word = 0; word < BITSET_WORDS; ++word) {
+            uint64_t bits = container.bits[word];
+            while (bits != 0) {
+                container.array.push_back(static_cast<uint16_t>(word * 64 + countTrailingZeros64(bits)));
+                bits &= bits - 1;
+            }
+        }
+        std::vector<uint64_t>().swap(container.bits);
+    }
+
+    enum class SetOperation {
+        AND,
+        OR,
+        AND_NOT
+    };
+
+    Container combine(const Container& a, const Container& b, SetOperation operation) {
+        Container result;
+        result.key = a.key;
+
+        if (!a.isBitset() && !b.isBitset()) {
+            auto out = std::back_inserter(result.array);
+            switch (operation) {
+            case SetOperation::AND:
+                std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), out);
+                break;
+            case SetOperation::OR:
+                std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), out);
+                break;
+            case SetOperation::AND_NOT:
+                std::set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), out);
+                break;
+            }
+            if (result.array.size() > ARRAY_LIMIT) {
+                result.bits = toBitset(result);
+                std::vector<uint16_t>().swap(result.array);
+            }
+            normalize(result);
+            return result;
+        }
+
+        // At least one side is dense: work word by word. The loops have no dependencies
+        // between iterations, so they compile to packed SIMD instructions.
+        result.bits = toBitset(a);
+        const std::vector<uint64_t> other = toBitset(b);
+        uint64_t* target = result.bits.data();
+        const uint64_t* source = other.data();
+        switch (operation) {
+        case SetOperation::AND:
+            for (size_t i = 0; i < BITSET_WORDS; ++i) target[i] &= source[i];
+            break;
+        case SetOperation::OR:
+            for (size_t i = 0; i < BITSET_WORDS; ++i) target[i] |= source[i];
+            break;
+        case SetOperation::AND_NOT:
+            for (size_t i = 0; i < BITSET_WORDS; ++i) target[i] &= ~source[i];
+            break;
+        }
+        normalize(result);
+        return result;
+    }
+
+}
+
+void RowBitmap::add(uint32_t row) {
+    const uint16_t key = static_cast<uint16_t>(row >> CONTAINER_BITS);
+    const uint16_t offset = static_cast<uint16_t>(row & 0xFFFF);
+
+    if (containers.empty() || containers.back().key != key) {
+        containers.emplace_back();
+        containers.back().key = key;
+    }
+    Container& container = containers.back();
+
+    if (container.isBitset()) {
+        setBit(container.bits, offset);
+    }
+    else {
+        if (!container.array.empty() && container.array.back() >= offset) return;
+        container.array.push_back(offset);
+        if (container.array.size() > ARRAY_LIMIT) {
+            container.bits = toBitset(container);
+            std::vector<uint16_t>().swap(container.array);
+        }
+    }
+    container.cardinality++;
+}
+
+bool RowBitmap::contains(uint32_t row) const {
+    const uint16_t key = static_cast<uint16_t>(row >> CONTAINER_BITS);
+    const uint16_t offset = static_cast<uint16_t>(row & 0xFFFF);
+    auto it = std::lower_bound(containers.begin(), containers.end(), key, [](const Container& container, uint16_t value) {
+        return container.key < value;
+        });
+    if (it == containers.end() || it->key != key) return false;
+    if (it->isBitset()) return (it->bits[offset >> 6] >> (offset & 63)) & 1;
+    return std::binary_search(it->array.begin(), it->array.end(), offset);
+}
+
+size_t RowBitmap::cardinality() const {
+    size_t total = 0;
+    for (const auto& container : containers) {
+        total += container.cardinality;
+    }
+    return total;
+}
+
+size_t RowBitmap::memoryBytes() const {
+    size_t total = containers.capacity() * sizeof(Container);
+    for (const auto& container : containers) {
+        total += container.array.capacity() * sizeof(uint16_t) + container.bits.capacity() * sizeof(uint64_t);
+    }
+    return total;
+}
+
+std::vector<uint32_t> RowBitmap::toRows() const {
+    std::vector<uint32_t> rows;
+    rows.reserve(cardinality());
+    for (const auto& container : containers) {
+        const uint32_t base = static_cast<uint32_t>(container.key) << CONTAINER_BITS;
+        if (container.isBitset()) {
+            for (size_t word = 0; word < BITSET_WORDS; ++word) {
+                uint64_t bits = container.bits[word];
+                while (bits != 0) {
+                    rows.push_back(base + static_cast<uint32_t>(word * 64 + countTrailingZeros64(bits)));
+                    bits &= bits - 1;
+                }
+            }
+        }
+        else {
+            for (uint16_t offset : container.array) {
+                rows.push_back(base + offset);
+            }
+        }
+    }
+    return rows;
+}
+
+RowBitmap RowBitmap::intersect(const RowBitmap& a, const RowBitmap& b) {
+    RowBitmap result;
+    auto left = a.containers.begin();
+    auto right = b.containers.begin();
+    while (left != a.containers.end() && right != b.containers.end()) {
+        if (left->key < right->key) {
+            ++left;
+        }
+        else if (right->key < left->key) {
+            ++right;
+        }
+        else {
+            Container combined = combine(*left, *right, SetOperation::AND);
+            if (combined.cardinality > 0) result.containers.push_back(std::move(combined));
+            ++left;
+            ++right;
+        }
+    }
+    return result;
+}
+
+RowBitmap RowBitmap::unite(const RowBitmap& a, const RowBitmap& b) {
+    RowBitmap result;
+    auto left = a.containers.begin();
+    auto right = b.containers.begin();
+    while (left != a.containers.end() || right != b.containers.end()) {
+        if (right == b.containers.end() || (left != a.containers.end() && left->key < right->key)) {
+            result.containers.push_back(*left++);
+        }
+        else if (left == a.containers.end() || right->key < left->key) {
+            result.containers.push_back(*right++);
+        }
+        else {
+            result.containers.push_back(combine(*left++, *right++, SetOperation::OR));
+        }
+    }
+    return result;
+}
+
+RowBitmap RowBitmap::subtract(const RowBitmap& a, const RowBitmap& b) {
+    RowBitmap result;
+    auto right = b.containers.begin();
+    for (const auto& container : a.containers) {
+        while (right != b.containers.end() && right->key < container.key) ++right;
+        if (right != b.containers.end() && right->key == container.key) {
+            Container combined = combine(container, *right, SetOperation::AND_NOT);
+            if (combined.cardinality > 0) result.containers.push_back(std::move(combined));
+        }
+        else {
+            result.containers.push_back(container);
+        }
+    }
+    return result;
+}
+
+RowBitmap RowBitmap::complement(const RowBitmap& a, uint32_t rowCount) {
+    RowBitmap all;
+    if (rowCount == 0) return all;
+    const uint32_t lastRow = rowCount - 1;
+    for (uint32_t key = 0; key <= (lastRow >> CONTAINER_BITS); ++key) {
+        Container full;
+        full.key = static_cast<uint16_t>(key);
+        full.bits.assign(BITSET_WORDS, ~uint64_t{ 0 });
+        if (key == (lastRow >> CONTAINER_BITS)) {
+            // Clear the bits past the last row.
+            const size_t usedBits = (lastRow & 0xFFFF) + 1;
+            for (size_t bit = usedBits; bit < (size_t{ 1 } << CONTAINER_BITS); ++bit) {
+                full.bits[bit >> 6] &= ~(uint64_t{ 1 } << (bit & 63));
+            }
+        }
+        normalize(full);
+        all.containers.push_back(std::move(full));
+    }
+    return subtract(all, a);
+}
+
+void BitmapIndex::add(uint32_t row, const ECommerceEvent& event) {
+    byEventType[static_cast<size_t>(event.eventType)].add(row);
+    byBrand[event.brand].add(row);
+    byTopCategory[event.categoryCode.code].add(row);
+    rows = row + 1;
+}
+
+const RowBitmap& BitmapIndex::eventType(EventType type) const {
+    return byEventType[static_cast<size_t>(type)];
+}
+
+const RowBitmap& BitmapIndex::brand(std::string_view value) const {
+    static const RowBitmap empty;
+    auto it = byBrand.find(value);
+    return it == byBrand.end() ? empty : it->second;
+}
+
+const RowBitmap& BitmapIndex::topCategory(std::string_view value) const {
+    static const RowBitmap empty;
+    auto it = byTopCategory.find(value);
+    return it == byTopCategory.end() ? empty : it->second;
+}
+
+size_t BitmapIndex::memoryBytes() const {
+    size_t total = 0;
+    for (const auto& bitmap : byEventType) total += bitmap.memoryBytes();
+    for (const auto& entry : byBrand) total += entry.second.memoryBytes();
+    for (const auto& entry : byTopCategory) total += entry.second.memoryBytes();
+    return total;
+}
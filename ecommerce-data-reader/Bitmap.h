@@ -0,0 +1,70 @@
+#pragma once
+#include "DataStructure.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Compressed row bitmap in the Roaring layout: rows are split into 2^16-row containers,
+// each stored as a sorted array of 16-bit offsets while it holds at most 4096 rows and
+// as a 1024-word bitset beyond that. Sparse values cost 2 bytes per row, dense ones at
+// most 8 KB per 65536 rows, and set operations on bitset containers are plain word loops.
+class RowBitmap {
+public:
+    // Rows must be added in ascending order, which is how the parser produces them.
+    void add(uint32_t row);
+
+    bool contains(uint32_t row) const;
+    size_t cardinality() const;
+    size_t memoryBytes() const;
+
+    // Ascending row indices, ready to be used as a selection vector.
+    std::vector<uint32_t> toRows() const;
+
+    static RowBitmap intersect(const RowBitmap& a, const RowBitmap& b);
+    static RowBitmap unite(const RowBitmap& a, const RowBitmap& b);
+    static RowBitmap subtract(const RowBitmap& a, const RowBitmap& b);
+    // Every row in [0, rowCount) that is not in the bitmap.
+    static RowBitmap complement(const RowBitmap& a, uint32_t rowCount);
+
+    friend RowBitmap operator&(const RowBitmap& a, const RowBitmap& b) { return intersect(a, b); }
+    friend RowBitmap operator|(const RowBitmap& a, const RowBitmap& b) { return unite(a, b); }
+    friend RowBitmap operator-(const RowBitmap& a, const RowBitmap& b) { return subtract(a, b); }
+
+    struct Container {
+        uint16_t key = 0;
+        uint32_t cardinality = 0;
+        std::vector<uint16_t> array;
+        std::vector<uint64_t> bits;
+
+        bool isBitset() const { return !bits.empty(); }
+    };
+
+private:
+    std::vector<Container> containers;
+};
+
+// Bitmaps per event type and per low-cardinality dictionary value (brand, top-level
+// category), filled row by row while parsing. Filters combine them with the RowBitmap
+// operators and hand the resulting selection vector to the aggregators.
+class BitmapIndex {
+public:
+    void add(uint32_t row, const ECommerceEvent& event);
+
+    const RowBitmap& eventType(EventType type) const;
+    // Unknown values yield an empty bitmap.
+    const RowBitmap& brand(std::string_view value) const;
+    const RowBitmap& topCategory(std::string_view value) const;
+
+    uint32_t rowCount() const { return rows; }
+    size_t memoryBytes() const;
+
+private:
+    std::array<RowBitmap, 5> byEventType;
+    std::unordered_map<std::string_view, RowBitmap> byBrand;
+    std::unordered_map<std::string_view, RowBitmap> byTopCategory;
+    uint32_t rows = 0;
+};
@@ -0,0 +1,116 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+// Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's design). Every
+// slot carries a sequence number that tells producers and consumers whether it is free
+// or full for their current lap, so each push or pop is one compare-and-swap on its
+// own index plus one release store; producers and consumers never contend on a lock.
+//
+// The blocking push and pop spin and yield. close() lets consumers drain the queue and
+// then stop: pop returns false only once the queue is closed and empty, and a push that
+// is still waiting for room gives up.
+template<typename T>
+class BoundedQueue {
+public:
+    // capacity must be a power of two.
+    explicit BoundedQueue(size_t capacity) : mask(capacity - 1), cells(new Cell[capacity]) {
+        if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+            throw std::invalid_argument("BoundedQueue capacity must be a power of two of at least 2");
+        }
+        for (size_t i = 0; i < capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    bool tryPush(const T& value) {
+        size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[position & mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0) {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0) {
+                return false;
+            }
+            else {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& value) {
+        size_t position = dequeuePosition.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[position & mask];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+            if (difference == 0) {
+                if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0) {
+                return false;
+            }
+            else {
+                position = dequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Waits for room; returns false without pushing once the queue is closed, so a producer
+    // never blocks on a queue that nobody drains any more.
+    bool push(const T& value) {
+        while (!tryPush(value)) {
+            if (closed.load(std::memory_order_acquire)) return false;
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    // Waits for a value; returns false once the queue is closed and fully drained.
+    bool pop(T& value) {
+        for (;;) {
+            if (tryPop(value)) return true;
+            if (closed.load(std::memory_order_acquire)) {
+                // Everything pushed before close() is visible now; take any leftovers.
+                return tryPop(value);
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    // Called after the last push, or to stop producers and consumers early.
+    void close() {
+        closed.store(true, std::memory_order_release);
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    // Producer and consumer indices on separate cache lines.
+    alignas(64) const size_t mask;
+    const std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<size_t> enqueuePosition{ 0 };
+    alignas(64) std::atomic<size_t> dequeuePosition{ 0 };
+    alignas(64) std::atomic<bool> closed{ false };
+};
@@ -0,0 +1,112 @@
+#include "Analyzer.h"
+#include "Hashing.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include "Partitioning.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+    int monthNumber(const PurchaseTime& time) {
+        return time.year * 12 + (time.month - 1);
+    }
+
+    struct MonthRange {
+        int first = std::numeric_limits<int>::max();
+        int last = std::numeric_limits<int>::min();
+    };
+
+}
+
+CohortRetention Analyzer::getCohortRetention(const std::vector<ECommerceEvent>& events) {
+    METRIC_TIMER("analysis.cohorts");
+    const size_t partitionCount = getThreadCount();
+    // Only purchases matter; rows whose timestamp failed to parse have month 0. Partitioning
+    // by user gives all of a user's purchases to one thread, which can then number its
+    // users densely and keep their state in flat arrays.
+    PartitionedRows rows = partitionRowsIf(events, partitionCount,
+        [](const ECommerceEvent& event) { return hashUint64(event.userId); },
+        [](const ECommerceEvent& event) { return event.eventType == EventType::PURCHASE && event.purchaseTime.month >= 1; });
+
+    std::vector<MonthRange> ranges(partitionCount);
+    parallelChunks(partitionCount, partitionCount, [&](size_t, size_t begin, size_t end) {
+        for (size_t partition = begin; partition < end; ++partition) {
+            MonthRange& range = ranges[partition];
+            forEachPartitionRow(rows, partition, [&](uint32_t row) {
+                const int month = monthNumber(events[row].purchaseTime);
+                range.first = std::min(range.first, month);
+                range.last = std::max(range.last, month);
+                });
+        }
+        });
+
+    MonthRange range;
+    for (const auto& partial : ranges) {
+        range.first = std::min(range.first, partial.first);
+        range.last = std::max(range.last, partial.last);
+    }
+
+    CohortRetention retention;
+    if (range.first > range.last) return retention;
+    const int monthCount = range.last - range.first + 1;
+    retention.firstYear = range.first / 12;
+    retention.firstMonth = range.first % 12 + 1;
+
+    // Pass 1: each user's first purchase month and purchase months. Pass 2: each user adds
+    // one to its cohort row for every month it purchased in, so the work per partition
+    // is its purchase rows plus its users. Purchase months are a bitset of wordsPerUser
+    // words per user ordinal, sized by the month span, so any span fits.
+    const size_t wordsPerUser = (static_cast<size_t>(monthCount) + 63) / 64;
+    std::vector<std::vector<std::vector<size_t>>> partials(partitionCount);
+    parallelChunks(partitionCount, partitionCount, [&](size_t, size_t begin, size_t end) {
+        for (size_t partition = begin; partition < end; ++partition) {
+            std::unordered_map<uint64_t, uint32_t> ordinals;
+            std::vector<int> firstMonths;
+            std::vector<uint64_t> months;
+            forEachPartitionRow(rows, partition, [&](uint32_t row) {
+                const ECommerceEvent& event = events[row];
+                auto inserted = ordinals.try_emplace(event.userId, static_cast<uint32_t>(firstMonths.size()));
+                if (inserted.second) {
+                    firstMonths.push_back(monthCount);
+                    months.resize(months.size() + wordsPerUser, 0);
+                }
+                const uint32_t user = inserted.first->second;
+                const int month = monthNumber(event.purchaseTime) - range.first;
+                firstMonths[user] = std::min(firstMonths[user], month);
+                months[user * wordsPerUser + month / 64] |= uint64_t{ 1 } << (month % 64);
+                });
+
+            auto& matrix = partials[partition];
+            matrix.assign(monthCount, {});
+            for (int cohort = 0; cohort < monthCount; ++cohort) {
+                matrix[cohort].assign(monthCount - cohort, 0);
+            }
+            for (size_t user = 0; user < firstMonths.size(); ++user) {
+                const int cohort = firstMonths[user];
+                auto& cohortRow = matrix[cohort];
+                // Months before the first purchase are empty, so the scan starts at its word.
+                for (size_t word = static_cast<size_t>(cohort) / 64; word < wordsPerUser; ++word) {
+                    uint64_t bits = months[user * wordsPerUser + word];
+                    while (bits != 0) {
+                        cohortRow[word * 64 + countTrailingZeros64(bits) - cohort]++;
+                        bits &= bits - 1;
+                    }
+                }
+            }
+        }
+        });
+
+    retention.activeUsers = std::move(partials[0]);
+    for (size_t partition = 1; partition < partials.size(); ++partition) {
+        for (int cohort = 0; cohort < monthCount; ++cohort) {
+            auto& target = retention.activeUsers[cohort];
+            const auto& source = partials[partition][cohort];
+            for (size_t monthsLater = 0; monthsLater < target.size(); ++monthsLater) {
+                target[monthsLater] += source[monthsLater];
+            }
+        }
+    }
+    return retention;
+}
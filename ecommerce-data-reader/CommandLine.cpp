@@ -0,0 +1,241 @@
+#include "CommandLine.h"
+
+#include <charconv>
+#include <limits>
+
+namespace {
+
+    const char* const ANALYSIS_NAMES[ANALYSIS_KIND_COUNT] = {
+        "summary",
+        "top-products",
+        "drill-down",
+        "distinct",
+        "day-range",
+        "bitmap-filter",
+        "kernels",
+        "heavy-hitters",
+        "prices",
+        "time-series",
+        "funnel",
+        "sessions",
+        "cohorts",
+        "co-occurrence"
+    };
+
+    // "--name=value" -> value; false if the argument is a different option.
+    bool optionValue(std::string_view argument, std::string_view option, std::string_view& value) {
+        if (argument.substr(0, option.size()) != option) return false;
+        value = argument.substr(option.size());
+        return true;
+    }
+
+    // A positive number of seconds, optionally with an s, m, h or d suffix.
+    bool parseDuration(std::string_view text, int64_t& seconds) {
+        int64_t unit = 1;
+        if (!text.empty() && (text.back() < '0' || text.back() > '9')) {
+            switch (text.back()) {
+            case 's': unit = 1; break;
+            case 'm': unit = 60; break;
+            case 'h': unit = 60 * 60; break;
+            case 'd': unit = 24 * 60 * 60; break;
+            default: return false;
+            }
+            text.remove_suffix(1);
+        }
+        int64_t count = 0;
+        auto result = std::from_chars(text.data(), text.data() + text.size(), count);
+        if (text.empty() || result.ec != std::errc() || result.ptr != text.data() + text.size()
+            || count <= 0 || count > std::numeric_limits<int64_t>::max() / unit) {
+            return false;
+        }
+        seconds = count * unit;
+        return true;
+    }
+
+    // What runs without --analyses: the cheap core report.
+    std::bitset<ANALYSIS_KIND_COUNT> defaultAnalyses() {
+        std::bitset<ANALYSIS_KIND_COUNT> analyses;
+        analyses.set(static_cast<size_t>(AnalysisKind::SUMMARY));
+        analyses.set(static_cast<size_t>(AnalysisKind::TOP_PRODUCTS));
+        return analyses;
+    }
+
+    // "all" leaves out the kernel micro-benchmark, which only runs when named.
+    std::bitset<ANALYSIS_KIND_COUNT> allAnalyses() {
+        std::bitset<ANALYSIS_KIND_COUNT> analyses;
+        analyses.set();
+        analyses.reset(static_cast<size_t>(AnalysisKind::KERNEL_BENCHMARK));
+        return analyses;
+    }
+
+    bool parseAnalysisList(std::string_view list, std::bitset<ANALYSIS_KIND_COUNT>& analyses, std::string& error) {
+        analyses.reset();
+        while (!list.empty()) {
+            const size_t comma = list.find(',');
+            const std::string_view name = list.substr(0, comma);
+            list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+
+            AnalysisKind kind;
+            if (name == "all") {
+                analyses |= allAnalyses();
+            }
+            else if (name == "none") {
+                analyses.reset();
+            }
+            else if (parseAnalysisName(name, kind)) {
+                analyses.set(static_cast<size_t>(kind));
+            }
+            else {
+                error = "Unknown analysis '" + std::string(name) + "'.";
+                return false;
+            }
+        }
+        return true;
+    }
+
+}
+
+const char* analysisName(AnalysisKind kind) {
+    return ANALYSIS_NAMES[static_cast<size_t>(kind)];
+}
+
+bool parseAnalysisName(std::string_view name, AnalysisKind& kind) {
+    for (size_t i = 0; i < ANALYSIS_KIND_COUNT; ++i) {
+        if (name == ANALYSIS_NAMES[i]) {
+            kind = static_cast<AnalysisKind>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseCommandLine(int argc, char* argv[], CommandLineOptions& options, std::string& error) {
+    options = CommandLineOptions();
+    options.analyses = defaultAnalyses();
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view argument = argv[i];
+        std::string_view value;
+        if (argument == "--help" || argument == "-h") {
+            options.showHelp = true;
+        }
+        else if (optionValue(argument, "--input=", value)) {
+            options.inputFiles.emplace_back(value);
+        }
+        else if (optionValue(argument, "--analyses=", value)) {
+            if (!parseAnalysisList(value, options.analyses, error)) return false;
+        }
+        else if (optionValue(argument, "--format=", value)) {
+            if (value == "text") options.format = OutputFormat::TEXT;
+            else if (value == "json") options.format = OutputFormat::JSON;
+            else {
+                error = "Unknown output format '" + std::string(value) + "'; expected text or json.";
+                return false;
+            }
+        }
+        else if (optionValue(argument, "--threads=", value)) {
+            auto result = std::from_chars(value.data(), value.data() + value.size(), options.threadCount);
+            if (result.ec != std::errc() || result.ptr != value.data() + value.size() || options.threadCount == 0) {
+                error = "Invalid thread count '" + std::string(value) + "'.";
+                return false;
+            }
+        }
+        else if (argument == "--pin-threads") {
+            options.pinThreads = true;
+        }
+        else if (optionValue(argument, "--cpu-level=", value)) {
+            if (!parseCpuLevel(value, options.cpuLevel)) {
+                error = "Unknown CPU level '" + std::string(value) + "'; expected scalar, sse4.2, avx2 or avx512.";
+                return false;
+            }
+            options.cpuLevelSet = true;
+        }
+        else if (argument == "--self-test") {
+            options.selfTest = true;
+        }
+        else if (argument == "--pipeline") {
+            options.pipeline = true;
+        }
+        else if (optionValue(argument, "--bucket=", value)) {
+            if (!parseDuration(value, options.bucketSeconds)) {
+                error = "Invalid bucket width '" + std::string(value) + "'; expected e.g. 900, 15m, 1h or 1d.";
+                return false;
+            }
+        }
+        else if (optionValue(argument, "--state=", value)) {
+            options.statePath = std::string(value);
+        }
+        else if (optionValue(argument, "--sessions-csv=", value)) {
+            options.sessionsCsvPath = std::string(value);
+        }
+        else if (optionValue(argument, "--metrics=", value)) {
+            options.metricsPath = std::string(value);
+        }
+        else if (optionValue(argument, "--metrics-format=", value)) {
+            if (value == "json") options.metricsFormat = MetricsFormat::JSON;
+            else if (value == "prometheus") options.metricsFormat = MetricsFormat::PROMETHEUS;
+            else {
+                error = "Unknown metrics format '" + std::string(value) + "'; expected json or prometheus.";
+                return false;
+            }
+        }
+        else if (argument == "--profile") {
+            options.profile = true;
+        }
+        else if (optionValue(argument, "--serve=", value)) {
+            auto result = std::from_chars(value.data(), value.data() + value.size(), options.servePort);
+            if (result.ec != std::errc() || result.ptr != value.data() + value.size() || options.servePort == 0) {
+                error = "Invalid port '" + std::string(value) + "'.";
+                return false;
+            }
+        }
+        else if (!argument.empty() && argument[0] != '-') {
+            options.inputFiles.emplace_back(argument);
+        }
+        else {
+            error = "Unknown option '" + std::string(argument) + "'.";
+            return false;
+        }
+    }
+    if (!options.sessionsCsvPath.empty() && (options.pipeline || options.servePort != 0)) {
+        error = "--sessions-csv needs the parsed events and cannot be combined with --pipeline or --serve.";
+        return false;
+    }
+    return true;
+}
+
+void printUsage(std::ostream& out, const char* program) {
+    out << "Usage: " << program << " [options] [file.csv ...]\n"
+        << "\n"
+        << "Inputs are parsed in order and analyzed together; without any, 2019-Nov.csv is used\n"
+        << "unless --self-test is given.\n"
+        << "\n"
+        << "  --input=<file>         Add an input file (same as a bare file argument).\n"
+        << "  --analyses=<list>      Comma-separated analyses to run (default: summary,top-products).\n"
+        << "                         Available:\n"
+        << "                         ";
+    for (size_t i = 0; i < ANALYSIS_KIND_COUNT; ++i) {
+        out << ANALYSIS_NAMES[i];
+        if (i + 1 == ANALYSIS_KIND_COUNT) out << "\n";
+        else if (i == 6) out << ",\n                         ";
+        else out << ", ";
+    }
+    out << "                         'all' runs every analysis except kernels, a micro-benchmark\n"
+        << "                         that only runs when named; 'none' only parses.\n"
+        << "  --format=<text|json>   Report format on stdout (default: text). With json, progress\n"
+        << "                         and timings go to stderr.\n"
+        << "  --threads=<n>          Scheduler threads (default: hardware threads).\n"
+        << "  --pin-threads          Keep scheduler workers on fixed CPUs.\n"
+        << "  --cpu-level=<level>    scalar, sse4.2, avx2 or avx512; lowered to what the CPU supports.\n"
+        << "  --self-test            Run the built-in unit tests first; exit with failure if any fail.\n"
+        << "  --pipeline             Overlap parsing with aggregation instead of running analyses.\n"
+        << "  --bucket=<width>       Time series bucket width: seconds or e.g. 15m, 1h, 1d (default: 1d).\n"
+        << "  --state=<file>         Fold the inputs into a saved aggregate state.\n"
+        << "  --sessions-csv=<file>  Export one row per session (start, end, counts, values).\n"
+        << "  --metrics=<file>       Write per-stage timers and counters at exit.\n"
+        << "  --metrics-format=<f>   json (default) or prometheus.\n"
+        << "  --profile              Count cycles, instructions, branch and LLC misses and page\n"
+        << "                         faults per stage (Linux perf_event_open).\n"
+        << "  --serve=<port>         Keep the events in memory and answer JSON queries on\n"
+        << "                         http://127.0.0.1:<port>/ until /shutdown.\n"
+        << "  --help                 Show this message.\n";
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "CpuFeatures.h"
+#include "Metrics.h"
+
+#include <bitset>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The analyses the driver can run. Only the selected ones, and the indexes they need,
+// are computed.
+enum class AnalysisKind {
+    SUMMARY,
+    TOP_PRODUCTS,
+    DRILL_DOWN,
+    DISTINCT_COUNTS,
+    DAY_RANGE,
+    BITMAP_FILTER,
+    KERNEL_BENCHMARK,
+    HEAVY_HITTERS,
+    PRICE_QUANTILES,
+    TIME_SERIES,
+    FUNNEL,
+    SESSIONS,
+    COHORTS,
+    CO_OCCURRENCE
+};
+
+constexpr size_t ANALYSIS_KIND_COUNT = 14;
+
+enum class OutputFormat {
+    TEXT,
+    JSON
+};
+
+struct CommandLineOptions {
+    // Empty unless given; the driver falls back to 2019-Nov.csv when it has to parse.
+    std::vector<std::string> inputFiles;
+    std::bitset<ANALYSIS_KIND_COUNT> analyses;
+    OutputFormat format = OutputFormat::TEXT;
+    // 0 keeps the hardware thread count.
+    unsigned threadCount = 0;
+    bool pinThreads = false;
+    bool cpuLevelSet = false;
+    CpuLevel cpuLevel = CpuLevel::SCALAR;
+    bool selfTest = false;
+    bool pipeline = false;
+    bool showHelp = false;
+    std::string statePath;
+    // Empty unless one row per session should be exported as CSV.
+    std::string sessionsCsvPath;
+    // Width of the time series buckets.
+    int64_t bucketSeconds = 24 * 60 * 60;
+    // Non-zero keeps the parsed events resident and serves queries on this port.
+    uint16_t servePort = 0;
+    // Empty unless stage metrics should be written at exit.
+    std::string metricsPath;
+    MetricsFormat metricsFormat = MetricsFormat::JSON;
+    // Reads hardware counters around each stage and prints them after the timings.
+    bool profile = false;
+
+    bool wants(AnalysisKind kind) const { return analyses.test(static_cast<size_t>(kind)); }
+};
+
+const char* analysisName(AnalysisKind kind);
+// Accepts the names printed by analysisName.
+bool parseAnalysisName(std::string_view name, AnalysisKind& kind);
+
+// Fills options from argv. Every analysis is selected unless --analyses narrows it.
+// Returns false with a message in error for unknown options or bad values.
+bool parseCommandLine(int argc, char* argv[], CommandLineOptions& options, std::string& error);
+void printUsage(std::ostream& out, const char* program);
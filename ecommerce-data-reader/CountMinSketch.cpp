@@ -0,0 +1,190 @@
+#include "CountMinSketch.h"
+#include "BinaryIO.h"
+#include "Hashing.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+    const char COUNT_MIN_TAG[5] = "CMSK";
+    const char HEAVY_HITTERS_TAG[5] = "HHIT";
+    constexpr uint32_t SKETCH_VERSION = 1;
+
+    struct CandidateRecord {
+        uint64_t key;
+        uint64_t estimate;
+    };
+
+}
+
+CountMinSketch::CountMinSketch(size_t width, size_t depth) : width(width), depth(depth) {
+    if (width == 0 || (width & (width - 1)) != 0 || depth == 0) {
+        throw std::invalid_argument("CountMinSketch width must be a power of two and depth non-zero");
+    }
+    counters.assign(width * depth, 0);
+}
+
+size_t CountMinSketch::cellIndex(uint64_t hash, size_t row) const {
+    // Double hashing derives one independent-enough column per row from a single hash.
+    const uint64_t first = hash;
+    const uint64_t second = hashUint64(hash) | 1;
+    return row * width + static_cast<size_t>((first + row * second) & (width - 1));
+}
+
+uint64_t CountMinSketch::add(uint64_t hash, uint64_t count) {
+    uint64_t result = std::numeric_limits<uint64_t>::max();
+    for (size_t row = 0; row < depth; ++row) {
+        uint64_t& cell = counters[cellIndex(hash, row)];
+        cell += count;
+        result = std::min(result, cell);
+    }
+    return result;
+}
+
+uint64_t CountMinSketch::estimate(uint64_t hash) const {
+    uint64_t result = std::numeric_limits<uint64_t>::max();
+    for (size_t row = 0; row < depth; ++row) {
+        result = std::min(result, counters[cellIndex(hash, row)]);
+    }
+    return result;
+}
+
+void CountMinSketch::merge(const CountMinSketch& other) {
+    if (other.width != width || other.depth != depth) {
+        throw std::invalid_argument("Cannot merge Count-Min sketches of different shape");
+    }
+    for (size_t i = 0; i < counters.size(); ++i) {
+        counters[i] += other.counters[i];
+    }
+}
+
+HeavyHitters::HeavyHitters(size_t capacity, size_t width, size_t depth)
+    : sketch(width, depth), capacity(capacity) {
+    candidates.reserve(capacity + 1);
+}
+
+void HeavyHitters::refreshMinimum() {
+    minimumEstimate = std::numeric_limits<uint64_t>::max();
+    for (const auto& candidate : candidates) {
+        if (candidate.second < minimumEstimate) {
+            minimumEstimate = candidate.second;
+            minimumKey = candidate.first;
+        }
+    }
+}
+
+void HeavyHitters::add(uint64_t key, uint64_t count) {
+    if (capacity == 0) return;
+    const uint64_t estimate = sketch.add(hashUint64(key), count);
+
+    auto it = candidates.find(key);
+    if (it != candidates.end()) {
+        it->second = estimate;
+        if (key == minimumKey) refreshMinimum();
+        return;
+    }
+    if (candidates.size() < capacity) {
+        candidates.emplace(key, estimate);
+        if (candidates.size() == capacity) refreshMinimum();
+        return;
+    }
+    // Estimates only grow, so the candidate minimum is rescanned only on replacement.
+    if (estimate > minimumEstimate) {
+        candidates.erase(minimumKey);
+        candidates.emplace(key, estimate);
+        refreshMinimum();
+    }
+}
+
+void HeavyHitters::merge(const HeavyHitters& other) {
+    sketch.merge(other.sketch);
+
+    std::vector<std::pair<uint64_t, uint64_t>> merged;
+    merged.reserve(candidates.size() + other.candidates.size());
+    for (const auto& candidate : candidates) {
+        merged.emplace_back(candidate.first, 0);
+    }
+    for (const auto& candidate : other.candidates) {
+        if (candidates.count(candidate.first) == 0) merged.emplace_back(candidate.first, 0);
+    }
+    for (auto& candidate : merged) {
+        candidate.second = sketch.estimate(hashUint64(candidate.first));
+    }
+
+    const size_t keep = std::min(capacity, merged.size());
+    std::partial_sort(merged.begin(), merged.begin() + keep, merged.end(), [](const auto& a, const auto& b) {
+        return a.second > b.second;
+        });
+    candidates.clear();
+    candidates.insert(merged.begin(), merged.begin() + keep);
+    refreshMinimum();
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> HeavyHitters::top(size_t n) const {
+    std::vector<std::pair<uint64_t, uint64_t>> result(candidates.begin(), candidates.end());
+    std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+    if (result.size() > n) result.resize(n);
+    return result;
+}
+
+void CountMinSketch::save(std::ostream& out) const {
+    writeHeader(out, COUNT_MIN_TAG, SKETCH_VERSION);
+    writeValue(out, static_cast<uint64_t>(width));
+    writeValue(out, static_cast<uint64_t>(depth));
+    writeVector(out, counters);
+}
+
+bool CountMinSketch::load(std::istream& in) {
+    uint64_t storedWidth = 0;
+    uint64_t storedDepth = 0;
+    std::vector<uint64_t> storedCounters;
+    if (!readHeader(in, COUNT_MIN_TAG, SKETCH_VERSION) ||
+        !readValue(in, storedWidth) ||
+        !readValue(in, storedDepth) ||
+        storedWidth == 0 || (storedWidth & (storedWidth - 1)) != 0 || storedDepth == 0 ||
+        !readVector(in, storedCounters) ||
+        storedCounters.size() != storedWidth * storedDepth) {
+        return false;
+    }
+    width = static_cast<size_t>(storedWidth);
+    depth = static_cast<size_t>(storedDepth);
+    counters = std::move(storedCounters);
+    return true;
+}
+
+void HeavyHitters::save(std::ostream& out) const {
+    writeHeader(out, HEAVY_HITTERS_TAG, SKETCH_VERSION);
+    sketch.save(out);
+    writeValue(out, static_cast<uint64_t>(capacity));
+    std::vector<CandidateRecord> records;
+    records.reserve(candidates.size());
+    for (const auto& candidate : candidates) {
+        records.push_back({ candidate.first, candidate.second });
+    }
+    writeVector(out, records);
+}
+
+bool HeavyHitters::load(std::istream& in) {
+    uint64_t storedCapacity = 0;
+    std::vector<CandidateRecord> records;
+    CountMinSketch storedSketch(1, 1);
+    if (!readHeader(in, HEAVY_HITTERS_TAG, SKETCH_VERSION) ||
+        !storedSketch.load(in) ||
+        !readValue(in, storedCapacity) ||
+        !readVector(in, records) ||
+        records.size() > storedCapacity) {
+        return false;
+    }
+    sketch = std::move(storedSketch);
+    capacity = static_cast<size_t>(storedCapacity);
+    candidates.clear();
+    for (const auto& record : records) {
+        candidates.emplace(record.key, record.estimate);
+    }
+    refreshMinimum();
+    return true;
+}
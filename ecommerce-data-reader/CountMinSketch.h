@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Count-Min sketch over 64-bit hashes. Estimates never undercount, and overcount by at
+// most e / width of the total added count with probability 1 - exp(-depth). Sketches of
+// equal shape merge by element-wise addition.
+class CountMinSketch {
+public:
+    explicit CountMinSketch(size_t width = size_t{ 1 } << 16, size_t depth = 4);
+
+    // Adds count to the key and returns its updated estimate.
+    uint64_t add(uint64_t hash, uint64_t count = 1);
+    uint64_t estimate(uint64_t hash) const;
+    void merge(const CountMinSketch& other);
+
+    void save(std::ostream& out) const;
+    // Replaces this sketch with a saved one, whose shape may differ.
+    bool load(std::istream& in);
+
+    size_t getWidth() const { return width; }
+    size_t getDepth() const { return depth; }
+
+private:
+    size_t cellIndex(uint64_t hash, size_t row) const;
+
+    size_t width;
+    size_t depth;
+    std::vector<uint64_t> counters;
+};
+
+// Approximate top-N keys by count in fixed memory: a Count-Min sketch counts every key,
+// and a bounded candidate set keeps the keys with the largest estimates seen so far.
+class HeavyHitters {
+public:
+    explicit HeavyHitters(size_t capacity, size_t width = size_t{ 1 } << 16, size_t depth = 4);
+
+    void add(uint64_t key, uint64_t count = 1);
+    void merge(const HeavyHitters& other);
+
+    void save(std::ostream& out) const;
+    bool load(std::istream& in);
+
+    // Candidates sorted by descending estimated count.
+    std::vector<std::pair<uint64_t, uint64_t>> top(size_t n) const;
+
+private:
+    void refreshMinimum();
+
+    CountMinSketch sketch;
+    size_t capacity;
+    std::unordered_map<uint64_t, uint64_t> candidates;
+    uint64_t minimumKey = 0;
+    uint64_t minimumEstimate = 0;
+};
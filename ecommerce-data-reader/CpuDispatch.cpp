@@ -0,0 +1,61 @@
+#include "CpuDispatch.h"
+
+#include <array>
+#include <atomic>
+
+namespace {
+
+    using DispatchTables = std::array<CpuDispatch, CPU_LEVEL_COUNT>;
+
+    const DispatchTables& dispatchTables() {
+        static const DispatchTables tables = []() {
+            DispatchTables bound{};
+            for (int index = 0; index < CPU_LEVEL_COUNT; ++index) {
+                const CpuLevel level = static_cast<CpuLevel>(index);
+                bound[index] = {
+                    level,
+                    selectFindByte(level),
+                    selectParseTimestamp(level),
+                    selectParseUint64(level),
+                    selectCountEventTypes(level),
+                    selectSumPurchaseRevenue(level)
+                };
+            }
+            return bound;
+        }();
+        return tables;
+    }
+
+    CpuLevel clampToSupported(CpuLevel level) {
+        const CpuLevel supported = getSupportedCpuLevel();
+        return level < supported ? level : supported;
+    }
+
+    std::atomic<const CpuDispatch*> activeTable{ nullptr };
+
+}
+
+const CpuDispatch& cpuDispatch() {
+    const CpuDispatch* table = activeTable.load(std::memory_order_acquire);
+    if (table == nullptr) {
+        const CpuDispatch* detected = &cpuDispatch(getSupportedCpuLevel());
+        // Keep a level chosen by a concurrent setCpuLevel call.
+        activeTable.compare_exchange_strong(table, detected, std::memory_order_acq_rel);
+        table = activeTable.load(std::memory_order_acquire);
+    }
+    return *table;
+}
+
+const CpuDispatch& cpuDispatch(CpuLevel level) {
+    return dispatchTables()[static_cast<size_t>(clampToSupported(level))];
+}
+
+CpuLevel getCpuLevel() {
+    return cpuDispatch().level;
+}
+
+CpuLevel setCpuLevel(CpuLevel level) {
+    const CpuDispatch& table = cpuDispatch(level);
+    activeTable.store(&table, std::memory_order_release);
+    return table.level;
+}
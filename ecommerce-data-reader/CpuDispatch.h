@@ -0,0 +1,28 @@
+#pragma once
+#include "CpuFeatures.h"
+#include "Kernels.h"
+#include "Tokenizer.h"
+
+// One function pointer per hot routine, bound for a single CPU level. Callers go
+// through cpuDispatch() instead of testing features themselves:
+//
+//     size_t comma = cpuDispatch().findByte(line.data(), line.size(), ',');
+struct CpuDispatch {
+    CpuLevel level;
+    FindByteFn findByte;
+    ParseTimestampFn parseTimestamp;
+    ParseUint64Fn parseUint64;
+    CountEventTypesFn countEventTypes;
+    SumPurchaseRevenueFn sumPurchaseRevenue;
+};
+
+// Table for the active level, which starts at getSupportedCpuLevel().
+const CpuDispatch& cpuDispatch();
+// Table for a given level, e.g. to compare levels in a benchmark. Levels above the
+// supported one are lowered to it.
+const CpuDispatch& cpuDispatch(CpuLevel level);
+
+CpuLevel getCpuLevel();
+// Rebinds every routine; intended for startup, before any worker threads run. Levels
+// above what the CPU supports are lowered to the supported level, which is returned.
+CpuLevel setCpuLevel(CpuLevel level);
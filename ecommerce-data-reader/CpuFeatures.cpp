@@ -0,0 +1,120 @@
+#include "CpuFeatures.h"
+
+#include <cctype>
+#include <cstdint>
+
+#if defined(CPU_X86_64)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace {
+
+#if defined(CPU_X86_64)
+
+    void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t registers[4]) {
+#if defined(_MSC_VER)
+        int values[4];
+        __cpuidex(values, static_cast<int>(leaf), static_cast<int>(subleaf));
+        for (int i = 0; i < 4; ++i) registers[i] = static_cast<uint32_t>(values[i]);
+#else
+        __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+    }
+
+    // Register state the operating system saves on context switches (XCR0).
+    uint64_t enabledRegisterState() {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        uint32_t low, high;
+        __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+        return (static_cast<uint64_t>(high) << 32) | low;
+#endif
+    }
+
+    bool bit(uint32_t value, int index) {
+        return ((value >> index) & 1) != 0;
+    }
+
+#endif
+
+    CpuFeatures detectCpuFeatures() {
+        CpuFeatures features;
+#if defined(CPU_X86_64)
+        uint32_t registers[4];
+        cpuid(0, 0, registers);
+        const uint32_t maxLeaf = registers[0];
+
+        cpuid(1, 0, registers);
+        features.ssse3 = bit(registers[2], 9);
+        features.sse41 = bit(registers[2], 19);
+        features.sse42 = bit(registers[2], 20);
+        features.popcnt = bit(registers[2], 23);
+        const bool osxsave = bit(registers[2], 27);
+        const bool avx = bit(registers[2], 28);
+
+        // XMM and YMM state, then additionally the opmask and upper ZMM state.
+        const uint64_t state = osxsave ? enabledRegisterState() : 0;
+        const bool ymmEnabled = avx && (state & 0x6) == 0x6;
+        const bool zmmEnabled = ymmEnabled && (state & 0xE6) == 0xE6;
+
+        if (maxLeaf >= 7) {
+            cpuid(7, 0, registers);
+            features.avx2 = ymmEnabled && bit(registers[1], 5);
+            features.bmi2 = bit(registers[1], 8);
+            features.avx512f = zmmEnabled && bit(registers[1], 16);
+            features.avx512bw = zmmEnabled && bit(registers[1], 30);
+        }
+#endif
+        return features;
+    }
+
+}
+
+const CpuFeatures& getCpuFeatures() {
+    static const CpuFeatures features = detectCpuFeatures();
+    return features;
+}
+
+CpuLevel getSupportedCpuLevel() {
+    const CpuFeatures& features = getCpuFeatures();
+    const bool sse42 = features.ssse3 && features.sse41 && features.sse42 && features.popcnt;
+    if (sse42 && features.avx2 && features.avx512f && features.avx512bw) return CpuLevel::AVX512;
+    if (sse42 && features.avx2) return CpuLevel::AVX2;
+    if (sse42) return CpuLevel::SSE42;
+    return CpuLevel::SCALAR;
+}
+
+const char* cpuLevelName(CpuLevel level) {
+    switch (level) {
+    case CpuLevel::SCALAR:
+        return "scalar";
+    case CpuLevel::SSE42:
+        return "sse4.2";
+    case CpuLevel::AVX2:
+        return "avx2";
+    case CpuLevel::AVX512:
+        return "avx512";
+    }
+    return "unknown";
+}
+
+bool parseCpuLevel(std::string_view name, CpuLevel& level) {
+    for (int candidate = 0; candidate < CPU_LEVEL_COUNT; ++candidate) {
+        const std::string_view known = cpuLevelName(static_cast<CpuLevel>(candidate));
+        if (known.size() != name.size()) continue;
+        bool equal = true;
+        for (size_t i = 0; i < name.size() && equal; ++i) {
+            equal = std::tolower(static_cast<unsigned char>(name[i])) == known[i];
+        }
+        if (equal) {
+            level = static_cast<CpuLevel>(candidate);
+            return true;
+        }
+    }
+    return false;
+}
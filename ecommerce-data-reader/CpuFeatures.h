@@ -0,0 +1,49 @@
+#pragma once
+#include <string_view>
+
+// Instruction set detection. The SIMD code paths are compiled into every build and
+// chosen at runtime (see CpuDispatch.h), so one binary runs on every x86-64 machine.
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CPU_X86_64 1
+#endif
+
+// Enables an instruction set for one function. MSVC accepts every intrinsic without
+// extra flags; GCC and Clang need the target so the rest of the program stays baseline.
+#if defined(CPU_X86_64) && !defined(_MSC_VER)
+#define CPU_TARGET(features) __attribute__((target(features)))
+#else
+#define CPU_TARGET(features)
+#endif
+
+struct CpuFeatures {
+    bool ssse3 = false;
+    bool sse41 = false;
+    bool sse42 = false;
+    bool popcnt = false;
+    bool avx2 = false;
+    bool bmi2 = false;
+    bool avx512f = false;
+    bool avx512bw = false;
+};
+
+// Ordered dispatch levels; each one implies the ones below it.
+enum class CpuLevel {
+    SCALAR,
+    SSE42,
+    AVX2,
+    AVX512
+};
+
+constexpr int CPU_LEVEL_COUNT = 4;
+
+// Detected once on first use. Features the operating system does not save on context
+// switches (checked through XGETBV) are reported as missing.
+const CpuFeatures& getCpuFeatures();
+// Highest level whose instructions are all available.
+CpuLevel getSupportedCpuLevel();
+
+const char* cpuLevelName(CpuLevel level);
+// Accepts the names printed by cpuLevelName, case-insensitively. Returns false for
+// anything else and leaves level unchanged.
+bool parseCpuLevel(std::string_view name, CpuLevel& level);
@@ -0,0 +1,345 @@
+#include "DataGenerator.h"
+#include "DataStructure.h"
+#include "Hashing.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace {
+
+    constexpr size_t CHUNK_ROWS = 1 << 16;
+    // Chance that the next event in a session stays on the product just seen.
+    constexpr double STAY_ON_PRODUCT = 0.45;
+    constexpr size_t MAX_SESSION_EVENTS = 500;
+    constexpr double MEAN_EVENT_GAP_SECONDS = 40.0;
+
+    const char* const TOP_LEVELS[] = {
+        "electronics", "appliances", "computers", "apparel", "furniture", "construction", "kids",
+        "auto", "sport", "accessories", "medicine", "country_yard", "stationery"
+    };
+    const char* const MID_LEVELS[] = {
+        "smartphone", "audio", "video", "kitchen", "environment", "personal", "notebook", "components",
+        "peripherals", "shoes", "bedroom", "living_room", "tools", "toys", "bicycle", "bag", "jewelry"
+    };
+    const char* const LEAF_LEVELS[] = {
+        "headphone", "tv", "washer", "refrigerators", "vacuum", "iron", "desktop", "cpu", "keyboard",
+        "sandals", "sofa", "bed", "drill", "skates", "clocks", "tablet", "player"
+    };
+    const char* const BRAND_SYLLABLES[] = {
+        "sam", "sung", "xia", "omi", "ap", "le", "len", "ovo", "hua", "wei", "bo", "sch", "phi", "lips",
+        "so", "ny", "lu", "ma", "ri", "ko", "ta", "ve", "ne", "dex", "ron", "tel", "ka", "zo", "gi", "var"
+    };
+
+    // SplitMix64. Written out instead of using <random> so that a seed gives the same file
+    // with every standard library.
+    class Random {
+    public:
+        explicit Random(uint64_t seed) : state(seed) {}
+
+        uint64_t next() {
+            uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            return z ^ (z >> 31);
+        }
+        // In [0, 1).
+        double uniform() { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+        size_t below(size_t count) { return static_cast<size_t>(next() % count); }
+        double normal() {
+            const double radius = std::sqrt(-2.0 * std::log(1.0 - uniform()));
+            return radius * std::cos(6.283185307179586 * uniform());
+        }
+        double exponential(double mean) { return -mean * std::log(1.0 - uniform()); }
+
+    private:
+        uint64_t state;
+    };
+
+    std::vector<double> zipfTable(size_t count, double skew) {
+        std::vector<double> cumulative(count);
+        double total = 0.0;
+        for (size_t rank = 0; rank < count; ++rank) {
+            total += 1.0 / std::pow(static_cast<double>(rank + 1), skew);
+            cumulative[rank] = total;
+        }
+        for (double& weight : cumulative) weight /= total;
+        return cumulative;
+    }
+
+    size_t sampleTable(const std::vector<double>& cumulative, Random& random) {
+        const size_t rank = static_cast<size_t>(std::upper_bound(cumulative.begin(), cumulative.end(), random.uniform()) - cumulative.begin());
+        return std::min(rank, cumulative.size() - 1);
+    }
+
+    template<size_t N>
+    const char* pick(const char* const (&words)[N], Random& random) {
+        return words[random.below(N)];
+    }
+
+    void appendNumber(std::string& text, uint64_t value) {
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        text.append(buffer, result.ptr);
+    }
+
+    void appendDigits(std::string& text, int value, int width) {
+        char buffer[8];
+        for (int i = width - 1; i >= 0; --i) {
+            buffer[i] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+        text.append(buffer, static_cast<size_t>(width));
+    }
+
+    void appendTime(std::string& text, int64_t seconds) {
+        const PurchaseTime time = fromEpochSeconds(seconds);
+        appendDigits(text, time.year, 4);
+        text += '-';
+        appendDigits(text, time.month, 2);
+        text += '-';
+        appendDigits(text, time.day, 2);
+        text += ' ';
+        appendDigits(text, time.hour, 2);
+        text += ':';
+        appendDigits(text, time.minute, 2);
+        text += ':';
+        appendDigits(text, time.second, 2);
+        text += " UTC";
+    }
+
+    void appendHex(std::string& text, uint64_t value, int digits) {
+        static const char HEX[] = "0123456789abcdef";
+        for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4) text += HEX[(value >> shift) & 0xf];
+    }
+
+    // Formats 128 random bits like the UUIDs in user_session.
+    void appendSession(std::string& text, uint64_t high, uint64_t low) {
+        appendHex(text, high >> 32, 8);
+        text += '-';
+        appendHex(text, high >> 16, 4);
+        text += '-';
+        appendHex(text, high, 4);
+        text += '-';
+        appendHex(text, low >> 48, 4);
+        text += '-';
+        appendHex(text, low, 12);
+    }
+
+    struct GeneratedRow {
+        int64_t time;
+        uint32_t product;
+        uint32_t user;
+        uint32_t session;
+        EventType type;
+    };
+
+}
+
+DataGenerator::DataGenerator(const GeneratorOptions& options) : options(options) {
+    const size_t maxCount = std::numeric_limits<uint32_t>::max();
+    if (options.productCount == 0 || options.brandCount == 0 || options.categoryCount == 0 || options.userCount == 0) {
+        throw std::invalid_argument("Generator catalogs must not be empty");
+    }
+    if (options.productCount > maxCount || options.userCount > maxCount) {
+        throw std::invalid_argument("Generator catalogs are limited to 2^32 entries");
+    }
+    if (!(options.emptyBrandRate >= 0.0 && options.emptyBrandRate <= 1.0) ||
+        !(options.emptyCategoryRate >= 0.0 && options.emptyCategoryRate <= 1.0)) {
+        throw std::invalid_argument("Empty field rates must be between 0 and 1");
+    }
+    if (!(options.productSkew >= 0.0) || !(options.brandSkew >= 0.0) || !(options.userSkew >= 0.0)) {
+        throw std::invalid_argument("Zipf exponents must not be negative");
+    }
+    if (!(options.meanSessionEvents >= 1.0) || options.durationSeconds <= 0) {
+        throw std::invalid_argument("Sessions need at least one event and a positive time span");
+    }
+
+    Random random(hashUint64(options.seed));
+
+    categories.reserve(options.categoryCount);
+    for (size_t i = 0; i < options.categoryCount; ++i) {
+        Category category;
+        category.id = 2053013552226107603ull + i * 1093;
+        if (random.uniform() >= options.emptyCategoryRate) {
+            const double depth = random.uniform();
+            category.code = pick(TOP_LEVELS, random);
+            if (depth >= 0.15) category.code += std::string(".") + pick(MID_LEVELS, random);
+            if (depth >= 0.65) category.code += std::string(".") + pick(LEAF_LEVELS, random);
+        }
+        category.basePrice = 60.0 * std::exp(random.normal());
+        categories.push_back(std::move(category));
+    }
+
+    std::unordered_set<std::string> brandNames;
+    brands.reserve(options.brandCount);
+    while (brands.size() < options.brandCount) {
+        std::string name = pick(BRAND_SYLLABLES, random);
+        const size_t syllables = 1 + random.below(3);
+        for (size_t i = 0; i < syllables; ++i) name += pick(BRAND_SYLLABLES, random);
+        if (!brandNames.insert(name).second) name += std::to_string(brands.size());
+        brands.push_back(std::move(name));
+    }
+
+    // Product ids are shuffled so the popular products are not simply the lowest ids.
+    std::vector<uint32_t> ids(options.productCount);
+    for (size_t i = 0; i < ids.size(); ++i) ids[i] = static_cast<uint32_t>(i);
+    for (size_t i = ids.size(); i > 1; --i) std::swap(ids[i - 1], ids[random.below(i)]);
+
+    const std::vector<double> categoryPopularity = zipfTable(categories.size(), 0.8);
+    const std::vector<double> brandPopularity = zipfTable(brands.size(), options.brandSkew);
+    products.reserve(options.productCount);
+    for (size_t i = 0; i < options.productCount; ++i) {
+        Product product;
+        product.id = 1000000 + ids[i];
+        product.category = static_cast<uint32_t>(sampleTable(categoryPopularity, random));
+        product.brand = random.uniform() < options.emptyBrandRate ? -1 : static_cast<int32_t>(sampleTable(brandPopularity, random));
+        const double price = categories[product.category].basePrice * std::exp(0.35 * random.normal());
+        product.priceCents = std::max<uint64_t>(50, static_cast<uint64_t>(price * 100.0 + 0.5));
+        products.push_back(product);
+    }
+
+    productPopularity = zipfTable(options.productCount, options.productSkew);
+    userPopularity = zipfTable(options.userCount, options.userSkew);
+}
+
+const char* DataGenerator::header() {
+    return "event_time,event_type,product_id,category_id,category_code,brand,price,user_id,user_session\n";
+}
+
+size_t DataGenerator::getChunkCount() const {
+    return (options.rows + CHUNK_ROWS - 1) / CHUNK_ROWS;
+}
+
+void DataGenerator::generateChunk(size_t chunk, std::string& text) const {
+    const size_t chunkCount = getChunkCount();
+    if (chunk >= chunkCount) return;
+    const size_t rowCount = std::min(CHUNK_ROWS, options.rows - chunk * CHUNK_ROWS);
+    // Chunks cover consecutive slices of the time span, so the file is nearly in time order.
+    const int64_t windowStart = options.startTime + static_cast<int64_t>(static_cast<double>(options.durationSeconds) * chunk / chunkCount);
+    const int64_t windowEnd = options.startTime + static_cast<int64_t>(static_cast<double>(options.durationSeconds) * (chunk + 1) / chunkCount);
+    Random random(hashUint64(options.seed) ^ hashUint64(chunk + 1));
+
+    std::vector<GeneratedRow> rows;
+    rows.reserve(rowCount);
+    std::vector<std::pair<uint64_t, uint64_t>> sessionIds;
+    std::vector<uint32_t> viewed;
+    std::vector<uint32_t> carted;
+    const double continueChance = 1.0 - 1.0 / options.meanSessionEvents;
+    while (rows.size() < rowCount) {
+        const uint32_t session = static_cast<uint32_t>(sessionIds.size());
+        sessionIds.emplace_back(random.next(), random.next());
+        const uint32_t user = static_cast<uint32_t>(sampleTable(userPopularity, random));
+        size_t length = 1;
+        while (length < MAX_SESSION_EVENTS && random.uniform() < continueChance) length++;
+
+        double time = static_cast<double>(windowStart) + random.uniform() * static_cast<double>(windowEnd - windowStart);
+        viewed.clear();
+        carted.clear();
+        uint32_t product = 0;
+        for (size_t event = 0; event < length && rows.size() < rowCount; ++event) {
+            if (event == 0 || random.uniform() >= STAY_ON_PRODUCT) {
+                product = static_cast<uint32_t>(sampleTable(productPopularity, random));
+            }
+            // A product is viewed before it is carted, and carted before it is removed or bought.
+            EventType type = EventType::VIEW;
+            auto inCart = std::find(carted.begin(), carted.end(), product);
+            if (std::find(viewed.begin(), viewed.end(), product) == viewed.end()) {
+                viewed.push_back(product);
+            }
+            else {
+                const double draw = random.uniform();
+                if (inCart == carted.end()) {
+                    if (draw >= 0.8) {
+                        type = EventType::CART;
+                        carted.push_back(product);
+                    }
+                }
+                else if (draw >= 0.5) {
+                    type = draw < 0.8 ? EventType::PURCHASE : EventType::REMOVE_FROM_CART;
+                    carted.erase(inCart);
+                }
+            }
+            rows.push_back({ static_cast<int64_t>(time), product, user, session, type });
+            time += 1.0 + random.exponential(MEAN_EVENT_GAP_SECONDS);
+        }
+    }
+    std::stable_sort(rows.begin(), rows.end(), [](const GeneratedRow& a, const GeneratedRow& b) { return a.time < b.time; });
+
+    static const char* const EVENT_NAMES[] = { "view", "cart", "remove_from_cart", "purchase" };
+    text.reserve(text.size() + rowCount * 140);
+    for (const GeneratedRow& row : rows) {
+        const Product& product = products[row.product];
+        const Category& category = categories[product.category];
+        appendTime(text, row.time);
+        text += ',';
+        text += EVENT_NAMES[static_cast<size_t>(row.type)];
+        text += ',';
+        appendNumber(text, product.id);
+        text += ',';
+        appendNumber(text, category.id);
+        text += ',';
+        text += category.code;
+        text += ',';
+        if (product.brand >= 0) text += brands[static_cast<size_t>(product.brand)];
+        text += ',';
+        appendNumber(text, product.priceCents / 100);
+        text += '.';
+        appendDigits(text, static_cast<int>(product.priceCents % 100), 2);
+        text += ',';
+        // 2654435761 is prime, so this permutes the user ranks as long as userCount is not a multiple of it.
+        appendNumber(text, 500000000 + (row.user * 2654435761ull) % options.userCount);
+        text += ',';
+        appendSession(text, sessionIds[row.session].first, sessionIds[row.session].second);
+        text += '\n';
+    }
+}
+
+void DataGenerator::generate(std::string& text) const {
+    std::vector<std::string> chunks(getChunkCount());
+    parallelFor(0, chunks.size(), [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; ++chunk) generateChunk(chunk, chunks[chunk]);
+        }, 1);
+    size_t total = text.size();
+    for (const auto& chunk : chunks) total += chunk.size();
+    text.reserve(total);
+    for (const auto& chunk : chunks) text += chunk;
+}
+
+bool DataGenerator::writeCsv(const std::string& fileName, std::ostream* progress) const {
+    std::ofstream out(fileName, std::ios::binary);
+    out << header();
+
+    // Chunks are generated a batch at a time, a few per thread, and written in order, so
+    // memory stays bounded at any file size.
+    const size_t chunkCount = getChunkCount();
+    const size_t batchSize = std::max<size_t>(1, getThreadCount() * 2);
+    std::vector<std::string> batch(batchSize);
+    for (size_t first = 0; first < chunkCount && out; first += batchSize) {
+        const size_t count = std::min(batchSize, chunkCount - first);
+        parallelFor(0, count, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                batch[i].clear();
+                generateChunk(first + i, batch[i]);
+            }
+            }, 1);
+        for (size_t i = 0; i < count; ++i) out.write(batch[i].data(), static_cast<std::streamsize>(batch[i].size()));
+        if (progress != nullptr) {
+            *progress << "\rGenerating: " << (first + count) * 100 / chunkCount << "%" << std::flush;
+        }
+    }
+    if (progress != nullptr) *progress << std::endl;
+
+    out.flush();
+    if (!out) {
+        std::cerr << "Generator error: could not write " << fileName << "." << std::endl;
+        return false;
+    }
+    return true;
+}
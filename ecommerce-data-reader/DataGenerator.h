@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct GeneratorOptions {
+    uint64_t seed = 42;
+    size_t rows = 1000000;
+    size_t productCount = 200000;
+    size_t brandCount = 3000;
+    size_t categoryCount = 600;
+    size_t userCount = 1000000;
+    // Zipf exponents for how often products and users appear and how many products each
+    // brand owns; 0 is uniform.
+    double productSkew = 1.1;
+    double brandSkew = 1.2;
+    double userSkew = 0.6;
+    // Session lengths are geometric with this mean.
+    double meanSessionEvents = 6.0;
+    // Share of products without a brand and of categories without a category_code.
+    double emptyBrandRate = 0.15;
+    double emptyCategoryRate = 0.3;
+    // Event times spread over [startTime, startTime + durationSeconds).
+    int64_t startTime = 1572566400;
+    int64_t durationSeconds = 30 * 24 * 60 * 60;
+};
+
+// Writes synthetic rows in the Kaggle CSV schema, so load tests run without the real
+// download. Products, brands and users follow Zipf popularity, categories have one to
+// three code levels, and sessions walk a view -> cart -> purchase funnel.
+//
+// Rows are produced in fixed-size chunks, each from its own seed, on the shared
+// scheduler. The output depends only on the options, never on the thread count.
+class DataGenerator {
+public:
+    // Builds the product, brand and category catalog. Throws std::invalid_argument for
+    // empty catalogs or rates outside [0, 1].
+    explicit DataGenerator(const GeneratorOptions& options);
+
+    static const char* header();
+    size_t getChunkCount() const;
+    // Appends the rows of one chunk, ordered by time, to text.
+    void generateChunk(size_t chunk, std::string& text) const;
+    // Appends every row, without the header.
+    void generate(std::string& text) const;
+    // Writes the header and every row. Returns false if the file cannot be written.
+    bool writeCsv(const std::string& fileName, std::ostream* progress = nullptr) const;
+
+private:
+    struct Category {
+        uint64_t id;
+        std::string code;
+        double basePrice;
+    };
+    struct Product {
+        uint64_t id;
+        uint32_t category;
+        // Index into brands, or -1 for an empty brand field.
+        int32_t brand;
+        uint64_t priceCents;
+    };
+
+    GeneratorOptions options;
+    std::vector<Category> categories;
+    std::vector<std::string> brands;
+    std::vector<Product> products;
+    // Cumulative Zipf weights; a uniform draw is looked up by binary search.
+    std::vector<double> productPopularity;
+    std::vector<double> userPopularity;
+};
@@ -1 +1,11 @@
 #include "DataStructure.h"
+
+#include <cstdio>
+
+std::string formatTimestamp(int64_t epochSeconds) {
+	const PurchaseTime time = fromEpochSeconds(epochSeconds);
+	char buffer[40];
+	std::snprintf(buffer, sizeof(buffer), "%04d-%02d-%02d %02d:%02d:%02d UTC",
+		time.year, time.month, time.day, time.hour, time.minute, time.second);
+	return buffer;
+}
@@ -1,6 +1,10 @@
 #pragma once
 #include <iostream>
 #include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
 
 
 struct PurchaseTime {
@@ -18,7 +22,7 @@ struct CategoryCode {
 	std::string_view secondarySubcode;
 };
 
-enum class EventType {
+enum class EventType : uint8_t {
 	VIEW,
 	CART,
 	REMOVE_FROM_CART,
@@ -28,6 +32,7 @@ enum class EventType {
 
 struct ECommerceEvent {
 	PurchaseTime purchaseTime;
+	int64_t timestamp;
 	EventType eventType;
 	uint64_t prodId;
 	uint64_t categoryId;
@@ -38,3 +43,57 @@ struct ECommerceEvent {
 	std::string_view userSession;
 };
 
+// Dense column copies of the hot fields, indexed by row like the event vector, so that
+// scans over them read one byte or one double per row instead of a whole event.
+struct EventColumns {
+	std::vector<uint8_t> eventTypes;
+	std::vector<double> prices;
+
+	size_t size() const { return eventTypes.size(); }
+};
+
+// Converts a parsed UTC timestamp to seconds since the Unix epoch.
+inline int64_t toEpochSeconds(const PurchaseTime& time) {
+	const int64_t year = time.year - (time.month <= 2 ? 1 : 0);
+	const int64_t era = (year >= 0 ? year : year - 399) / 400;
+	const int64_t yearOfEra = year - era * 400;
+	const int64_t dayOfYear = (153 * ((time.month + 9) % 12) + 2) / 5 + time.day - 1;
+	const int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+	const int64_t days = era * 146097 + dayOfEra - 719468;
+	return days * 86400 + time.hour * 3600 + time.minute * 60 + time.second;
+}
+
+// Rounds an epoch timestamp down to the start of its bucket, also for times before 1970.
+inline int64_t floorToBucket(int64_t time, int64_t bucketSeconds) {
+	int64_t bucket = time / bucketSeconds;
+	if (time % bucketSeconds < 0) bucket--;
+	return bucket * bucketSeconds;
+}
+
+inline PurchaseTime fromEpochSeconds(int64_t seconds) {
+	int64_t days = seconds / 86400;
+	int64_t secondOfDay = seconds % 86400;
+	if (secondOfDay < 0) {
+		secondOfDay += 86400;
+		days--;
+	}
+	days += 719468;
+	const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+	const int64_t dayOfEra = days - era * 146097;
+	const int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+	const int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+	const int64_t monthIndex = (5 * dayOfYear + 2) / 153;
+	const int month = static_cast<int>(monthIndex < 10 ? monthIndex + 3 : monthIndex - 9);
+
+	PurchaseTime time;
+	time.year = static_cast<int>(yearOfEra + era * 400 + (month <= 2 ? 1 : 0));
+	time.month = month;
+	time.day = static_cast<int>(dayOfYear - (153 * monthIndex + 2) / 5 + 1);
+	time.hour = static_cast<int>(secondOfDay / 3600);
+	time.minute = static_cast<int>(secondOfDay / 60 % 60);
+	time.second = static_cast<int>(secondOfDay % 60);
+	return time;
+}
+
+// Formats an epoch timestamp the way the dataset writes it: "2019-11-01 00:00:00 UTC".
+std::string formatTimestamp(int64_t epochSeconds);
@@ -0,0 +1,141 @@
+#include "EventIndex.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include "Partitioning.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace {
+
+    uint64_t keyOf(const ECommerceEvent& event, CsrIndex::Column column) {
+        return column == CsrIndex::Column::PRODUCT ? event.prodId : event.userId;
+    }
+
+}
+
+void CsrIndex::build(const std::vector<ECommerceEvent>& events, Column column) {
+    const size_t rowCount = events.size();
+    if (rowCount >= std::numeric_limits<uint32_t>::max()) {
+        throw std::length_error("CsrIndex supports at most 2^32 - 2 rows");
+    }
+    const size_t chunkCount = getThreadCount();
+
+    // 1. Dictionary of distinct keys, gathered per chunk and assigned ordinals in key order.
+    std::vector<std::unordered_set<uint64_t>> chunkKeys(chunkCount);
+    parallelChunks(rowCount, chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row) {
+            chunkKeys[chunk].insert(keyOf(events[row], column));
+        }
+        });
+
+    keys.clear();
+    for (auto& localKeys : chunkKeys) {
+        keys.insert(keys.end(), localKeys.begin(), localKeys.end());
+        std::unordered_set<uint64_t>().swap(localKeys);
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    ordinals.clear();
+    ordinals.reserve(keys.size());
+    for (size_t ordinal = 0; ordinal < keys.size(); ++ordinal) {
+        ordinals.emplace(keys[ordinal], static_cast<uint32_t>(ordinal));
+    }
+    const size_t keyTotal = keys.size();
+
+    // 2. Rows are partitioned by ordinal range, so each partition owns a contiguous run of
+    // keys and their slots. Counts, scan and scatter then run per partition in parallel
+    // with O(keys + rows) memory whatever the thread count.
+    const size_t partitionCount = std::min(chunkCount, std::max<size_t>(keyTotal, 1));
+    auto partitionOf = [&](uint32_t ordinal) {
+        return static_cast<size_t>(uint64_t{ ordinal } * partitionCount / keyTotal);
+    };
+    // First ordinal of a partition; the inverse of partitionOf.
+    auto firstOrdinal = [&](size_t partition) {
+        return (partition * keyTotal + partitionCount - 1) / partitionCount;
+    };
+    std::vector<uint32_t> rowOrdinals(rowCount);
+    PartitionedRows partitioned(chunkCount, std::vector<std::vector<uint32_t>>(partitionCount));
+    parallelChunks(rowCount, chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+        auto& localRows = partitioned[chunk];
+        for (size_t row = begin; row < end; ++row) {
+            const uint32_t ordinal = ordinals.find(keyOf(events[row], column))->second;
+            rowOrdinals[row] = ordinal;
+            localRows[partitionOf(ordinal)].push_back(static_cast<uint32_t>(row));
+        }
+        });
+
+    // 3. Each partition counts its keys' rows and scans them into offsets relative to the
+    // partition start; the partition starts are a scan over partitionCount totals.
+    offsets.assign(keyTotal + 1, 0);
+    std::vector<uint32_t> partitionStarts(partitionCount + 1, 0);
+    parallelChunks(partitionCount, partitionCount, [&](size_t, size_t begin, size_t end) {
+        for (size_t partition = begin; partition < end; ++partition) {
+            forEachPartitionRow(partitioned, partition, [&](uint32_t row) { offsets[rowOrdinals[row]]++; });
+            uint32_t running = 0;
+            for (size_t ordinal = firstOrdinal(partition); ordinal < firstOrdinal(partition + 1); ++ordinal) {
+                const uint32_t count = offsets[ordinal];
+                offsets[ordinal] = running;
+                running += count;
+            }
+            partitionStarts[partition + 1] = running;
+        }
+        });
+    for (size_t partition = 0; partition < partitionCount; ++partition) {
+        partitionStarts[partition + 1] += partitionStarts[partition];
+    }
+    offsets[keyTotal] = static_cast<uint32_t>(rowCount);
+
+    // 4. Scatter. A partition visits its rows in file order, so every key's rows end up
+    // sorted without a separate sort.
+    rows.assign(rowCount, 0);
+    parallelChunks(partitionCount, partitionCount, [&](size_t, size_t begin, size_t end) {
+        for (size_t partition = begin; partition < end; ++partition) {
+            const size_t first = firstOrdinal(partition);
+            const size_t last = firstOrdinal(partition + 1);
+            std::vector<uint32_t> cursors(last - first);
+            for (size_t ordinal = first; ordinal < last; ++ordinal) {
+                offsets[ordinal] += partitionStarts[partition];
+                cursors[ordinal - first] = offsets[ordinal];
+            }
+            forEachPartitionRow(partitioned, partition, [&](uint32_t row) {
+                rows[cursors[rowOrdinals[row] - first]++] = row;
+                });
+        }
+        });
+}
+
+RowRange CsrIndex::rowsFor(uint64_t key) const {
+    auto it = ordinals.find(key);
+    if (it == ordinals.end()) return {};
+    const uint32_t ordinal = it->second;
+    return { rows.data() + offsets[ordinal], rows.data() + offsets[ordinal + 1] };
+}
+
+std::vector<uint32_t> CsrIndex::rowsForAny(const std::vector<uint64_t>& keysToFind) const {
+    std::vector<uint32_t> result;
+    for (uint64_t key : keysToFind) {
+        RowRange range = rowsFor(key);
+        const size_t previousSize = result.size();
+        result.insert(result.end(), range.begin(), range.end());
+        std::inplace_merge(result.begin(), result.begin() + previousSize, result.end());
+    }
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+size_t CsrIndex::memoryBytes() const {
+    return keys.capacity() * sizeof(uint64_t)
+        + offsets.capacity() * sizeof(uint32_t)
+        + rows.capacity() * sizeof(uint32_t)
+        + ordinals.size() * (sizeof(uint64_t) + sizeof(uint32_t) + 2 * sizeof(void*));
+}
+
+void EventIndex::build(const std::vector<ECommerceEvent>& events) {
+    METRIC_TIMER("index.build");
+    byProduct.build(events, CsrIndex::Column::PRODUCT);
+    byUser.build(events, CsrIndex::Column::USER);
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "DataStructure.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Non-owning view of a sorted run of row indices into the event vector.
+struct RowRange {
+    const uint32_t* first = nullptr;
+    const uint32_t* last = nullptr;
+
+    RowRange() = default;
+    RowRange(const uint32_t* first, const uint32_t* last) : first(first), last(last) {}
+    RowRange(const std::vector<uint32_t>& rows) : first(rows.data()), last(rows.data() + rows.size()) {}
+
+    const uint32_t* begin() const { return first; }
+    const uint32_t* end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+    bool empty() const { return first == last; }
+};
+
+// Compressed-sparse-row inverted index from a 64-bit key to the rows holding it. Rows of
+// key k are rows[offsets[ordinal(k)] .. offsets[ordinal(k) + 1]), in ascending row order.
+class CsrIndex {
+public:
+    enum class Column {
+        PRODUCT,
+        USER
+    };
+
+    void build(const std::vector<ECommerceEvent>& events, Column column);
+
+    RowRange rowsFor(uint64_t key) const;
+    // Sorted union of the rows of several keys.
+    std::vector<uint32_t> rowsForAny(const std::vector<uint64_t>& keys) const;
+
+    size_t keyCount() const { return keys.size(); }
+    size_t memoryBytes() const;
+
+private:
+    std::unordered_map<uint64_t, uint32_t> ordinals;
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> rows;
+};
+
+// Optional per-product and per-user indexes, built once after parsing.
+class EventIndex {
+public:
+    void build(const std::vector<ECommerceEvent>& events);
+
+    RowRange rowsForProduct(uint64_t prodId) const { return byProduct.rowsFor(prodId); }
+    RowRange rowsForUser(uint64_t userId) const { return byUser.rowsFor(userId); }
+
+    const CsrIndex& productIndex() const { return byProduct; }
+    const CsrIndex& userIndex() const { return byUser; }
+
+private:
+    CsrIndex byProduct;
+    CsrIndex byUser;
+};
@@ -0,0 +1,146 @@
+#pragma once
+#include "CpuDispatch.h"
+#include "DataStructure.h"
+
+#include <array>
+#include <charconv>
+#include <string_view>
+#include <vector>
+
+// Field and line parsing for the CSV rows. Shared by Parser and the benchmark suite, and
+// kept in the header so the parse loops can inline them.
+
+template<typename T>
+void parseNumeric(T& outValue, std::string_view fieldView) {
+    if (fieldView.empty()) {
+        outValue = 0;
+        return;
+    }
+    auto result = std::from_chars(fieldView.data(), fieldView.data() + fieldView.size(), outValue);
+    if (result.ec != std::errc()) {
+        outValue = 0;
+    }
+}
+
+inline EventType parseEventType(std::string_view eventStr) {
+    if (eventStr == "view") return EventType::VIEW;
+    if (eventStr == "cart") return EventType::CART;
+    if (eventStr == "remove_from_cart") return EventType::REMOVE_FROM_CART;
+    if (eventStr == "purchase") return EventType::PURCHASE;
+    return EventType::UNKNOWN;
+}
+
+inline void parseTimestamp(PurchaseTime& outTime, std::string_view timeView) {
+    cpuDispatch().parseTimestamp(outTime, timeView);
+}
+
+inline void parseCategoryCode(CategoryCode& outCode, std::string_view catCodeStr) {
+    outCode = { "", "", "" };
+    std::vector<std::string_view> tempCodeStore;
+    tempCodeStore.reserve(3);
+
+    while (!catCodeStr.empty()) {
+        size_t nextDot = catCodeStr.find('.');
+        if (nextDot == std::string_view::npos) {
+            tempCodeStore.emplace_back(catCodeStr);
+            catCodeStr.remove_prefix(catCodeStr.size());
+        }
+        else {
+            tempCodeStore.emplace_back(catCodeStr.substr(0, nextDot));
+            catCodeStr.remove_prefix(nextDot + 1);
+        }
+    }
+
+    if (tempCodeStore.size() > 0) outCode.code = tempCodeStore[0];
+    if (tempCodeStore.size() > 1) outCode.subcode = tempCodeStore[1];
+    if (tempCodeStore.size() > 2) outCode.secondarySubcode = tempCodeStore[2];
+}
+
+// Years outside this range are taken to be corrupt rather than real event times.
+constexpr int MIN_EVENT_YEAR = 1970;
+constexpr int MAX_EVENT_YEAR = 2100;
+
+// Rejects the all-zero time an unparsable timestamp leaves, and any out-of-range field.
+inline bool isTimeValid(const PurchaseTime& time) {
+    if (time.year < MIN_EVENT_YEAR || time.year > MAX_EVENT_YEAR || time.month < 1 || time.month > 12 ||
+        time.hour < 0 || time.hour > 23 || time.minute < 0 || time.minute > 59 || time.second < 0 || time.second > 59) {
+        return false;
+    }
+    static constexpr int DAYS_IN_MONTH[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    const bool leapYear = time.year % 4 == 0 && (time.year % 100 != 0 || time.year % 400 == 0);
+    const int days = DAYS_IN_MONTH[time.month - 1] + (time.month == 2 && leapYear ? 1 : 0);
+    return time.day >= 1 && time.day <= days;
+}
+
+inline bool isEventValid(const ECommerceEvent& event) {
+    return isTimeValid(event.purchaseTime) &&
+        event.price >= 0.0 &&
+        event.eventType != EventType::UNKNOWN &&
+        event.prodId != 0 &&
+        event.userId != 0;
+}
+
+// Cuts the next line, without its line ending, off the front of dataView.
+inline std::string_view nextLine(std::string_view& dataView, const CpuDispatch& cpu) {
+    size_t nextNewline = cpu.findByte(dataView.data(), dataView.size(), '\n');
+    std::string_view line;
+
+    if (nextNewline == std::string_view::npos) {
+        line = dataView;
+        dataView.remove_prefix(dataView.size());
+    }
+    else {
+        line = dataView.substr(0, nextNewline);
+        dataView.remove_prefix(nextNewline + 1);
+    }
+
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+    return line;
+}
+
+constexpr size_t NUM_COLUMNS = 9;
+
+// Splits a row at its commas into up to NUM_COLUMNS fields; returns how many were found.
+// Missing trailing fields are left untouched.
+inline size_t splitFields(std::string_view line, const CpuDispatch& cpu, std::array<std::string_view, NUM_COLUMNS>& fields) {
+    size_t fieldIndex = 0;
+    while (!line.empty() && fieldIndex < NUM_COLUMNS) {
+        size_t nextComma = cpu.findByte(line.data(), line.size(), ',');
+        if (nextComma == std::string_view::npos) {
+            fields[fieldIndex] = line;
+            line.remove_prefix(line.size());
+        }
+        else {
+            fields[fieldIndex] = line.substr(0, nextComma);
+            line.remove_prefix(nextComma + 1);
+        }
+        fieldIndex++;
+    }
+    return fieldIndex;
+}
+
+// Fills event from the fields splitFields found; fields missing from a short row must be empty.
+inline void decodeFields(const std::array<std::string_view, NUM_COLUMNS>& fields, const CpuDispatch& cpu, ECommerceEvent& event) {
+    cpu.parseTimestamp(event.purchaseTime, fields[0]);
+    event.timestamp = toEpochSeconds(event.purchaseTime);
+    event.eventType = parseEventType(fields[1]);
+    cpu.parseUint64(event.prodId, fields[2]);
+    cpu.parseUint64(event.categoryId, fields[3]);
+    parseCategoryCode(event.categoryCode, fields[4]);
+    event.brand = fields[5];
+    parseNumeric(event.price, fields[6]);
+    cpu.parseUint64(event.userId, fields[7]);
+    event.userSession = fields[8];
+}
+
+// Returns false for empty lines and rows that fail isEventValid.
+inline bool parseLine(std::string_view line, const CpuDispatch& cpu, ECommerceEvent& event) {
+    if (line.empty()) return false;
+
+    std::array<std::string_view, NUM_COLUMNS> fields;
+    splitFields(line, cpu, fields);
+    decodeFields(fields, cpu, event);
+    return isEventValid(event);
+}
@@ -0,0 +1,314 @@
+#pragma once
+#include "DataStructure.h"
+#include "EventIndex.h"
+#include "Hashing.h"
+#include "HyperLogLog.h"
+#include "Parallel.h"
+#include "QuantileSketch.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Compile-time group-by engine. A key column and a list of aggregates are template
+// parameters, so each combination instantiates one specialized loop in which every
+// aggregate update is a static, inlinable call; there is no per-row virtual dispatch.
+//
+//     auto revenueByBrand = groupBy<BrandKey, Count, SumIf<EventType::PURCHASE, Price>>(events);
+//
+// Each result maps a key to a std::tuple holding one value per aggregate, in order.
+
+// --- Key columns ---
+
+struct ProductKey {
+    using Type = uint64_t;
+    Type operator()(const ECommerceEvent& event) const { return event.prodId; }
+};
+
+struct CategoryKey {
+    using Type = uint64_t;
+    Type operator()(const ECommerceEvent& event) const { return event.categoryId; }
+};
+
+// Top-level segment of the category code, e.g. "electronics".
+struct TopCategoryKey {
+    using Type = std::string_view;
+    Type operator()(const ECommerceEvent& event) const { return event.categoryCode.code; }
+};
+
+struct BrandKey {
+    using Type = std::string_view;
+    Type operator()(const ECommerceEvent& event) const { return event.brand; }
+};
+
+struct UserKey {
+    using Type = uint64_t;
+    Type operator()(const ECommerceEvent& event) const { return event.userId; }
+};
+
+struct SessionKey {
+    using Type = std::string_view;
+    Type operator()(const ECommerceEvent& event) const { return event.userSession; }
+};
+
+// Start of the event's time bucket, in epoch seconds.
+struct TimeBucketKey {
+    using Type = int64_t;
+    int64_t bucketSeconds = 3600;
+    Type operator()(const ECommerceEvent& event) const { return floorToBucket(event.timestamp, bucketSeconds); }
+};
+
+template<typename... Keys>
+struct CompositeKey {
+    using Type = std::tuple<typename Keys::Type...>;
+    std::tuple<Keys...> keys;
+
+    CompositeKey() = default;
+    CompositeKey(Keys... keys) : keys(keys...) {}
+
+    Type operator()(const ECommerceEvent& event) const {
+        return std::apply([&event](const Keys&... key) { return Type(key(event)...); }, keys);
+    }
+};
+
+template<typename T>
+struct KeyHash : std::hash<T> {};
+
+template<typename... Ts>
+struct KeyHash<std::tuple<Ts...>> {
+    size_t operator()(const std::tuple<Ts...>& key) const {
+        size_t seed = 0;
+        std::apply([&seed](const Ts&... parts) {
+            ((seed ^= std::hash<Ts>()(parts) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2)), ...);
+            }, key);
+        return seed;
+    }
+};
+
+// --- Value columns ---
+
+struct Price {
+    static double get(const ECommerceEvent& event) { return event.price; }
+};
+
+struct Timestamp {
+    static double get(const ECommerceEvent& event) { return static_cast<double>(event.timestamp); }
+};
+
+// --- Aggregates ---
+// Each aggregate defines a default-initialized State, a Result, and static update, merge
+// and finish functions.
+
+struct Count {
+    using State = size_t;
+    using Result = size_t;
+    static void update(State& state, const ECommerceEvent&) { state++; }
+    static void merge(State& state, const State& other) { state += other; }
+    static Result finish(const State& state) { return state; }
+};
+
+template<EventType Type>
+struct CountIf {
+    using State = size_t;
+    using Result = size_t;
+    static void update(State& state, const ECommerceEvent& event) { state += event.eventType == Type ? 1 : 0; }
+    static void merge(State& state, const State& other) { state += other; }
+    static Result finish(const State& state) { return state; }
+};
+
+template<typename Field>
+struct Sum {
+    using State = double;
+    using Result = double;
+    static void update(State& state, const ECommerceEvent& event) { state += Field::get(event); }
+    static void merge(State& state, const State& other) { state += other; }
+    static Result finish(const State& state) { return state; }
+};
+
+template<EventType Type, typename Field>
+struct SumIf {
+    using State = double;
+    using Result = double;
+    static void update(State& state, const ECommerceEvent& event) {
+        if (event.eventType == Type) state += Field::get(event);
+    }
+    static void merge(State& state, const State& other) { state += other; }
+    static Result finish(const State& state) { return state; }
+};
+
+template<typename Field>
+struct Min {
+    struct State { double value = std::numeric_limits<double>::infinity(); };
+    using Result = double;
+    static void update(State& state, const ECommerceEvent& event) { state.value = std::min(state.value, Field::get(event)); }
+    static void merge(State& state, const State& other) { state.value = std::min(state.value, other.value); }
+    static Result finish(const State& state) { return state.value; }
+};
+
+template<typename Field>
+struct Max {
+    struct State { double value = -std::numeric_limits<double>::infinity(); };
+    using Result = double;
+    static void update(State& state, const ECommerceEvent& event) { state.value = std::max(state.value, Field::get(event)); }
+    static void merge(State& state, const State& other) { state.value = std::max(state.value, other.value); }
+    static Result finish(const State& state) { return state.value; }
+};
+
+template<typename Field>
+struct Mean {
+    struct State {
+        double sum = 0.0;
+        size_t count = 0;
+    };
+    using Result = double;
+    static void update(State& state, const ECommerceEvent& event) {
+        state.sum += Field::get(event);
+        state.count++;
+    }
+    static void merge(State& state, const State& other) {
+        state.sum += other.sum;
+        state.count += other.count;
+    }
+    static Result finish(const State& state) { return state.count == 0 ? 0.0 : state.sum / state.count; }
+};
+
+// Approximate distinct users or sessions per group; see HyperLogLog for the error bounds.
+template<uint8_t Precision = 10>
+struct DistinctUsers {
+    struct State : HyperLogLog {
+        State() : HyperLogLog(Precision) {}
+    };
+    using Result = double;
+    static void update(State& state, const ECommerceEvent& event) { state.add(hashUint64(event.userId)); }
+    static void merge(State& state, const State& other) { state.HyperLogLog::merge(other); }
+    static Result finish(const State& state) { return state.estimate(); }
+};
+
+template<uint8_t Precision = 10>
+struct DistinctSessions {
+    struct State : HyperLogLog {
+        State() : HyperLogLog(Precision) {}
+    };
+    using Result = double;
+    static void update(State& state, const ECommerceEvent& event) { state.add(hashString(event.userSession)); }
+    static void merge(State& state, const State& other) { state.HyperLogLog::merge(other); }
+    static Result finish(const State& state) { return state.estimate(); }
+};
+
+// Mergeable KLL sketch of purchase prices; query any quantile from the resulting sketch.
+template<uint16_t K = 200>
+struct PurchasePriceQuantiles {
+    struct State : QuantileSketch {
+        State() : QuantileSketch(K) {}
+    };
+    using Result = QuantileSketch;
+    static void update(State& state, const ECommerceEvent& event) {
+        if (event.eventType == EventType::PURCHASE) state.add(event.price);
+    }
+    static void merge(State& state, const State& other) { state.QuantileSketch::merge(other); }
+    static Result finish(const State& state) { return state; }
+};
+
+// --- Engine ---
+
+template<typename Key, typename... Aggregates>
+class GroupBy {
+public:
+    using KeyType = typename Key::Type;
+    using State = std::tuple<typename Aggregates::State...>;
+    using Result = std::tuple<typename Aggregates::Result...>;
+    using StateMap = std::unordered_map<KeyType, State, KeyHash<KeyType>>;
+    using ResultMap = std::unordered_map<KeyType, Result, KeyHash<KeyType>>;
+
+    explicit GroupBy(Key key = Key()) : key(key) {}
+
+    void update(const ECommerceEvent& event) {
+        updateState(groups[key(event)], event, std::index_sequence_for<Aggregates...>());
+    }
+
+    void update(const std::vector<ECommerceEvent>& events, size_t begin, size_t end) {
+        for (size_t row = begin; row < end; ++row) {
+            update(events[row]);
+        }
+    }
+
+    void merge(const GroupBy& other) {
+        for (const auto& group : other.groups) {
+            mergeState(groups[group.first], group.second, std::index_sequence_for<Aggregates...>());
+        }
+    }
+
+    const StateMap& states() const { return groups; }
+
+    ResultMap results() const {
+        ResultMap result;
+        result.reserve(groups.size());
+        for (const auto& group : groups) {
+            result.emplace(group.first, finishState(group.second, std::index_sequence_for<Aggregates...>()));
+        }
+        return result;
+    }
+
+    // Aggregates only the selected rows, e.g. an index lookup or a bitmap filter result.
+    static GroupBy runSelected(const std::vector<ECommerceEvent>& events, RowRange rows, Key key = Key()) {
+        const size_t chunkCount = getThreadCount();
+        std::vector<GroupBy> partials(chunkCount, GroupBy(key));
+        parallelChunks(rows.size(), chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                partials[chunk].update(events[rows.first[i]]);
+            }
+            });
+        return mergePartials(partials);
+    }
+
+    // Aggregates every event on all threads, each into a private map, then merges the
+    // smaller maps into the largest one.
+    static GroupBy run(const std::vector<ECommerceEvent>& events, Key key = Key()) {
+        const size_t chunkCount = getThreadCount();
+        std::vector<GroupBy> partials(chunkCount, GroupBy(key));
+        parallelChunks(events.size(), chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+            partials[chunk].update(events, begin, end);
+            });
+        return mergePartials(partials);
+    }
+
+private:
+    static GroupBy mergePartials(std::vector<GroupBy>& partials) {
+        auto largest = std::max_element(partials.begin(), partials.end(), [](const GroupBy& a, const GroupBy& b) {
+            return a.groups.size() < b.groups.size();
+            });
+        GroupBy merged = std::move(*largest);
+        for (auto it = partials.begin(); it != partials.end(); ++it) {
+            if (it != largest) merged.merge(*it);
+        }
+        return merged;
+    }
+
+    template<size_t... I>
+    static void updateState(State& state, const ECommerceEvent& event, std::index_sequence<I...>) {
+        (Aggregates::update(std::get<I>(state), event), ...);
+    }
+
+    template<size_t... I>
+    static void mergeState(State& state, const State& other, std::index_sequence<I...>) {
+        (Aggregates::merge(std::get<I>(state), std::get<I>(other)), ...);
+    }
+
+    template<size_t... I>
+    static Result finishState(const State& state, std::index_sequence<I...>) {
+        return Result(Aggregates::finish(std::get<I>(state))...);
+    }
+
+    Key key;
+    StateMap groups;
+};
+
+template<typename Key, typename... Aggregates>
+typename GroupBy<Key, Aggregates...>::ResultMap groupBy(const std::vector<ECommerceEvent>& events, Key key = Key()) {
+    return GroupBy<Key, Aggregates...>::run(events, key).results();
+}
@@ -0,0 +1,114 @@
+#include "HyperLogLog.h"
+#include "BinaryIO.h"
+#include "Hashing.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+    const char HYPERLOGLOG_TAG[5] = "HLLS";
+    constexpr uint32_t HYPERLOGLOG_VERSION = 1;
+
+    const std::array<double, 64> INVERSE_POWERS_OF_TWO = []() {
+        std::array<double, 64> table{};
+        for (size_t i = 0; i < table.size(); ++i) {
+            table[i] = std::ldexp(1.0, -static_cast<int>(i));
+        }
+        return table;
+    }();
+
+    double alphaFor(size_t registerCount) {
+        switch (registerCount) {
+        case 16: return 0.673;
+        case 32: return 0.697;
+        case 64: return 0.709;
+        default: return 0.7213 / (1.0 + 1.079 / registerCount);
+        }
+    }
+
+}
+
+HyperLogLog::HyperLogLog(uint8_t precision) : precision(precision) {
+    if (precision < MIN_PRECISION || precision > MAX_PRECISION) {
+        throw std::invalid_argument("HyperLogLog precision must be between 4 and 18");
+    }
+    registers.assign(size_t{ 1 } << precision, 0);
+}
+
+uint8_t HyperLogLog::rankOf(uint64_t hash) const {
+    // The guard bit keeps the rank bounded when the remaining bits are all zero.
+    const uint64_t remaining = (hash << precision) | (uint64_t{ 1 } << (precision - 1));
+    return static_cast<uint8_t>(countLeadingZeros64(remaining) + 1);
+}
+
+void HyperLogLog::addAll(const uint64_t* hashes, size_t count) {
+    constexpr size_t BATCH = 256;
+    std::array<uint32_t, BATCH> indices;
+    std::array<uint8_t, BATCH> ranks;
+
+    for (size_t offset = 0; offset < count; offset += BATCH) {
+        const size_t batchSize = std::min(BATCH, count - offset);
+        for (size_t i = 0; i < batchSize; ++i) {
+            indices[i] = static_cast<uint32_t>(hashes[offset + i] >> (64 - precision));
+            ranks[i] = rankOf(hashes[offset + i]);
+        }
+        for (size_t i = 0; i < batchSize; ++i) {
+            registers[indices[i]] = std::max(registers[indices[i]], ranks[i]);
+        }
+    }
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+    if (other.precision != precision) {
+        throw std::invalid_argument("Cannot merge HyperLogLog sketches of different precision");
+    }
+    // Element-wise byte max; compiles to packed max instructions.
+    uint8_t* target = registers.data();
+    const uint8_t* source = other.registers.data();
+    for (size_t i = 0; i < registers.size(); ++i) {
+        target[i] = std::max(target[i], source[i]);
+    }
+}
+
+double HyperLogLog::estimate() const {
+    const size_t registerCount = registers.size();
+    double inverseSum = 0.0;
+    size_t zeroRegisters = 0;
+    for (uint8_t value : registers) {
+        inverseSum += INVERSE_POWERS_OF_TWO[value];
+        zeroRegisters += value == 0 ? 1 : 0;
+    }
+
+    const double m = static_cast<double>(registerCount);
+    const double rawEstimate = alphaFor(registerCount) * m * m / inverseSum;
+
+    // Small cardinalities are estimated more accurately by linear counting.
+    if (rawEstimate <= 2.5 * m && zeroRegisters > 0) {
+        return m * std::log(m / static_cast<double>(zeroRegisters));
+    }
+    return rawEstimate;
+}
+
+void HyperLogLog::save(std::ostream& out) const {
+    writeHeader(out, HYPERLOGLOG_TAG, HYPERLOGLOG_VERSION);
+    writeValue(out, precision);
+    writeVector(out, registers);
+}
+
+bool HyperLogLog::load(std::istream& in) {
+    uint8_t storedPrecision = 0;
+    std::vector<uint8_t> storedRegisters;
+    if (!readHeader(in, HYPERLOGLOG_TAG, HYPERLOGLOG_VERSION) ||
+        !readValue(in, storedPrecision) ||
+        storedPrecision < MIN_PRECISION || storedPrecision > MAX_PRECISION ||
+        !readVector(in, storedRegisters) ||
+        storedRegisters.size() != (size_t{ 1 } << storedPrecision)) {
+        return false;
+    }
+    precision = storedPrecision;
+    registers = std::move(storedRegisters);
+    return true;
+}
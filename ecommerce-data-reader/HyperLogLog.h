@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// HyperLogLog distinct-count sketch over 64-bit hashes. It uses 2^precision one-byte
+// registers and has a relative standard error of about 1.04 / sqrt(2^precision):
+// precision 10 costs 1 KB for ~3.3% error, 12 costs 4 KB for ~1.6%, 14 costs 16 KB for ~0.8%.
+// Sketches built on different threads or files are combined with merge().
+class HyperLogLog {
+public:
+    static constexpr uint8_t MIN_PRECISION = 4;
+    static constexpr uint8_t MAX_PRECISION = 18;
+
+    explicit HyperLogLog(uint8_t precision = 12);
+
+    void add(uint64_t hash) {
+        const size_t index = static_cast<size_t>(hash >> (64 - precision));
+        const uint8_t rank = rankOf(hash);
+        if (rank > registers[index]) registers[index] = rank;
+    }
+
+    // Adds a batch of hashes. Index and rank are computed in a separate branch-free pass
+    // that the compiler can vectorize before the register maxima are applied.
+    void addAll(const uint64_t* hashes, size_t count);
+
+    void merge(const HyperLogLog& other);
+    double estimate() const;
+
+    void save(std::ostream& out) const;
+    // Replaces this sketch with a saved one, whose precision may differ.
+    bool load(std::istream& in);
+
+    uint8_t getPrecision() const { return precision; }
+    size_t memoryBytes() const { return registers.size(); }
+
+private:
+    uint8_t rankOf(uint64_t hash) const;
+
+    uint8_t precision;
+    std::vector<uint8_t> registers;
+};
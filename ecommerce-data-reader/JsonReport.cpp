@@ -0,0 +1,154 @@
+#include "JsonReport.h"
+
+#include <algorithm>
+
+namespace {
+
+    void writeHeavyHitterList(JsonWriter& json, std::string_view name, const std::vector<std::pair<uint64_t, uint64_t>>& entries) {
+        json.key(name).beginArray();
+        for (const auto& entry : entries) {
+            json.beginObject().field("id", entry.first).field("count", entry.second).endObject();
+        }
+        json.endArray();
+    }
+
+    void writeFunnelStats(JsonWriter& json, const FunnelStats& stats) {
+        json.beginObject()
+            .field("sessions", stats.sessionCount)
+            .field("viewSessions", stats.viewSessions)
+            .field("cartSessions", stats.cartSessions)
+            .field("purchaseSessions", stats.purchaseSessions)
+            .field("viewToCartDropOff", stats.viewToCartDropOff)
+            .field("cartToPurchaseDropOff", stats.cartToPurchaseDropOff)
+            .field("medianViewToCartSeconds", stats.medianViewToCartSeconds)
+            .field("medianCartToPurchaseSeconds", stats.medianCartToPurchaseSeconds)
+            .endObject();
+    }
+
+    // Largest groups first, so truncating consumers keep the important rows.
+    template<typename Map, typename Count>
+    auto sortedBy(const Map& map, Count count) {
+        std::vector<std::pair<typename Map::key_type, typename Map::mapped_type>> rows(map.begin(), map.end());
+        std::sort(rows.begin(), rows.end(), [&count](const auto& a, const auto& b) {
+            return count(a.second) > count(b.second);
+            });
+        return rows;
+    }
+
+}
+
+void writeJson(JsonWriter& json, const AnalysisSummary& summary) {
+    json.beginObject()
+        .field("revenue", summary.totalRevenue)
+        .field("views", summary.viewCount)
+        .field("carts", summary.cartCount)
+        .field("removes", summary.removeCount)
+        .field("purchases", summary.purchaseCount)
+        .endObject();
+}
+
+void writeJson(JsonWriter& json, const std::vector<RankedProduct>& products) {
+    json.beginArray();
+    for (const auto& product : products) {
+        json.beginObject()
+            .field("prodId", product.prodId)
+            .field("views", product.stats.viewCount)
+            .field("carts", product.stats.cartCount)
+            .field("purchases", product.stats.purchaseCount)
+            .field("revenue", product.stats.revenue)
+            .field("score", product.score)
+            .endObject();
+    }
+    json.endArray();
+}
+
+void writeJson(JsonWriter& json, const DistinctCounts& counts) {
+    json.beginObject().field("users", counts.users).field("sessions", counts.sessions).endObject();
+}
+
+void writeJson(JsonWriter& json, const HeavyHitterReport& report) {
+    json.beginObject();
+    writeHeavyHitterList(json, "viewedProducts", report.topViewedProducts);
+    writeHeavyHitterList(json, "cartedProducts", report.topCartedProducts);
+    writeHeavyHitterList(json, "purchasedProducts", report.topPurchasedProducts);
+    writeHeavyHitterList(json, "activeUsers", report.mostActiveUsers);
+    json.endObject();
+}
+
+void writeJson(JsonWriter& json, const std::unordered_map<std::string_view, PriceQuantiles>& quantiles, std::string_view keyName) {
+    json.beginArray();
+    for (const auto& row : sortedBy(quantiles, [](const PriceQuantiles& q) { return q.purchaseCount; })) {
+        json.beginObject()
+            .field(keyName, row.first)
+            .field("purchases", row.second.purchaseCount)
+            .field("p50", row.second.p50)
+            .field("p90", row.second.p90)
+            .field("p99", row.second.p99)
+            .endObject();
+    }
+    json.endArray();
+}
+
+void writeJson(JsonWriter& json, const TimeSeries& series) {
+    json.beginObject().field("bucketSeconds", series.bucketSeconds);
+    json.key("bucketStarts").beginArray();
+    for (int64_t start : series.bucketStarts) {
+        json.value(start);
+    }
+    json.endArray().key("buckets").beginArray();
+    for (const auto& bucket : series.buckets) {
+        writeJson(json, bucket);
+    }
+    json.endArray().endObject();
+}
+
+void writeJson(JsonWriter& json, const FunnelReport& report) {
+    json.beginObject();
+    json.key("overall");
+    writeFunnelStats(json, report.overall);
+    json.key("byCategory").beginArray();
+    for (const auto& row : sortedBy(report.byCategory, [](const FunnelStats& stats) { return stats.sessionCount; })) {
+        json.beginObject().field("category", row.first).key("funnel");
+        writeFunnelStats(json, row.second);
+        json.endObject();
+    }
+    json.endArray().key("byBrand").beginArray();
+    for (const auto& row : sortedBy(report.byBrand, [](const FunnelStats& stats) { return stats.sessionCount; })) {
+        json.beginObject().field("brand", row.first).key("funnel");
+        writeFunnelStats(json, row.second);
+        json.endObject();
+    }
+    json.endArray().endObject();
+}
+
+void writeJson(JsonWriter& json, const CohortRetention& retention) {
+    json.beginObject()
+        .field("firstYear", retention.firstYear)
+        .field("firstMonth", retention.firstMonth);
+    json.key("activeUsers").beginArray();
+    for (const auto& cohort : retention.activeUsers) {
+        json.beginArray();
+        for (size_t users : cohort) json.value(users);
+        json.endArray();
+    }
+    json.endArray().endObject();
+}
+
+void writeJson(JsonWriter& json, const CoOccurrenceReport& report, const std::vector<uint64_t>& products) {
+    json.beginObject()
+        .field("sessions", report.sessionCount)
+        .field("cappedSessions", report.cappedSessions)
+        .field("distinctPairs", report.distinctPairs);
+    json.key("products").beginArray();
+    for (uint64_t prodId : products) {
+        json.beginObject().field("prodId", prodId).key("partners").beginArray();
+        auto it = report.partners.find(prodId);
+        if (it != report.partners.end()) {
+            for (const auto& partner : it->second) {
+                json.beginObject().field("prodId", partner.prodId).field("sessions", partner.sessions).endObject();
+            }
+        }
+        json.endArray().endObject();
+    }
+    json.endArray().endObject();
+}
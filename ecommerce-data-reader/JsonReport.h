@@ -0,0 +1,21 @@
+#pragma once
+#include "Analyzer.h"
+#include "JsonWriter.h"
+
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// JSON forms of the analysis results, shared by the command-line driver and anything else
+// that reports them. Each call writes exactly one JSON value.
+void writeJson(JsonWriter& json, const AnalysisSummary& summary);
+void writeJson(JsonWriter& json, const std::vector<RankedProduct>& products);
+void writeJson(JsonWriter& json, const DistinctCounts& counts);
+void writeJson(JsonWriter& json, const HeavyHitterReport& report);
+// Groups ordered by purchase count, like the text report; keyName labels the group field.
+void writeJson(JsonWriter& json, const std::unordered_map<std::string_view, PriceQuantiles>& quantiles, std::string_view keyName);
+void writeJson(JsonWriter& json, const TimeSeries& series);
+void writeJson(JsonWriter& json, const FunnelReport& report);
+void writeJson(JsonWriter& json, const CohortRetention& retention);
+// Partners of the given products only; the full report can hold every carted product.
+void writeJson(JsonWriter& json, const CoOccurrenceReport& report, const std::vector<uint64_t>& products);
@@ -0,0 +1,145 @@
+#pragma once
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Streaming JSON writer: values go straight to the stream, with commas and (optionally)
+// indentation handled here. Keys are only valid inside objects.
+//
+//     JsonWriter json(std::cout);
+//     json.beginObject();
+//     json.field("rows", rows);
+//     json.key("summary").beginObject().field("revenue", revenue).endObject();
+//     json.endObject();
+//
+// Non-finite doubles become null; strings are escaped but otherwise passed through as UTF-8.
+class JsonWriter {
+public:
+    explicit JsonWriter(std::ostream& out, bool pretty = true) : out(out), pretty(pretty) {}
+
+    JsonWriter& beginObject() { return open('{'); }
+    JsonWriter& endObject() { return close('}'); }
+    JsonWriter& beginArray() { return open('['); }
+    JsonWriter& endArray() { return close(']'); }
+
+    JsonWriter& key(std::string_view name) {
+        separate();
+        writeString(name);
+        out << (pretty ? ": " : ":");
+        afterKey = true;
+        return *this;
+    }
+
+    JsonWriter& value(std::string_view text) {
+        separate();
+        writeString(text);
+        return *this;
+    }
+    JsonWriter& value(const char* text) { return value(std::string_view(text)); }
+
+    JsonWriter& value(bool flag) {
+        separate();
+        out << (flag ? "true" : "false");
+        return *this;
+    }
+
+    JsonWriter& value(double number) {
+        separate();
+        if (!std::isfinite(number)) {
+            out << "null";
+            return *this;
+        }
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+        out.write(buffer, result.ptr - buffer);
+        return *this;
+    }
+
+    template<typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>>
+    JsonWriter& value(T number) {
+        separate();
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), number);
+        out.write(buffer, result.ptr - buffer);
+        return *this;
+    }
+
+    JsonWriter& null() {
+        separate();
+        out << "null";
+        return *this;
+    }
+
+    template<typename T>
+    JsonWriter& field(std::string_view name, const T& fieldValue) {
+        key(name);
+        return value(fieldValue);
+    }
+
+private:
+    JsonWriter& open(char bracket) {
+        separate();
+        out << bracket;
+        hasItems.push_back(false);
+        return *this;
+    }
+
+    JsonWriter& close(char bracket) {
+        const bool empty = !hasItems.back();
+        hasItems.pop_back();
+        if (!empty) newline();
+        out << bracket;
+        if (hasItems.empty() && pretty) out << '\n';
+        return *this;
+    }
+
+    // Comma and line break before every value except the one following its key.
+    void separate() {
+        if (afterKey) {
+            afterKey = false;
+            return;
+        }
+        if (hasItems.empty()) return;
+        if (hasItems.back()) out << ',';
+        hasItems.back() = true;
+        newline();
+    }
+
+    void newline() {
+        if (!pretty) return;
+        out << '\n';
+        for (size_t level = 0; level < hasItems.size(); ++level) out << "  ";
+    }
+
+    void writeString(std::string_view text) {
+        static const char HEX[] = "0123456789abcdef";
+        out << '"';
+        for (char c : text) {
+            switch (c) {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\r': out << "\\r"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out << "\\u00" << HEX[(c >> 4) & 0xF] << HEX[c & 0xF];
+                }
+                else {
+                    out << c;
+                }
+            }
+        }
+        out << '"';
+    }
+
+    std::ostream& out;
+    bool pretty;
+    bool afterKey = false;
+    // One entry per open object or array: whether it has a value yet.
+    std::vector<bool> hasItems;
+};
@@ -0,0 +1,191 @@
+#include "Kernels.h"
+#include "CpuDispatch.h"
+
+#include <cstring>
+
+#if defined(CPU_X86_64)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+    constexpr uint8_t PURCHASE = static_cast<uint8_t>(EventType::PURCHASE);
+    // Types counted by the vector loops; UNKNOWN is whatever is left over.
+    constexpr size_t COUNTED_TYPES = 4;
+
+    EventTypeCounts countEventTypesScalar(const uint8_t* eventTypes, size_t count) {
+        EventTypeCounts result;
+        for (size_t i = 0; i < count; ++i) {
+            result.counts[eventTypes[i] < COUNTED_TYPES ? eventTypes[i] : COUNTED_TYPES]++;
+        }
+        return result;
+    }
+
+    double sumPurchaseRevenueScalar(const uint8_t* eventTypes, const double* prices, size_t count) {
+        double sum = 0.0;
+        for (size_t i = 0; i < count; ++i) {
+            if (eventTypes[i] == PURCHASE) sum += prices[i];
+        }
+        return sum;
+    }
+
+#if defined(CPU_X86_64)
+
+    // Byte compares accumulate into 8-bit lanes (each match subtracts -1), which are
+    // widened with a sum of absolute differences before any lane can overflow.
+    CPU_TARGET("avx2")
+    EventTypeCounts countEventTypesAvx2(const uint8_t* eventTypes, size_t count) {
+        EventTypeCounts result;
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i typeValues[COUNTED_TYPES];
+        __m256i totals[COUNTED_TYPES];
+        for (size_t type = 0; type < COUNTED_TYPES; ++type) {
+            typeValues[type] = _mm256_set1_epi8(static_cast<char>(type));
+            totals[type] = zero;
+        }
+
+        size_t i = 0;
+        while (i + 32 <= count) {
+            __m256i lanes[COUNTED_TYPES] = { zero, zero, zero, zero };
+            const size_t blockEnd = i + 255 * 32 <= count ? i + 255 * 32 : count - (count - i) % 32;
+            for (; i < blockEnd; i += 32) {
+                const __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(eventTypes + i));
+                for (size_t type = 0; type < COUNTED_TYPES; ++type) {
+                    lanes[type] = _mm256_sub_epi8(lanes[type], _mm256_cmpeq_epi8(values, typeValues[type]));
+                }
+            }
+            for (size_t type = 0; type < COUNTED_TYPES; ++type) {
+                totals[type] = _mm256_add_epi64(totals[type], _mm256_sad_epu8(lanes[type], zero));
+            }
+        }
+
+        size_t counted = 0;
+        for (size_t type = 0; type < COUNTED_TYPES; ++type) {
+            alignas(32) uint64_t parts[4];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(parts), totals[type]);
+            result.counts[type] = static_cast<size_t>(parts[0] + parts[1] + parts[2] + parts[3]);
+            counted += result.counts[type];
+        }
+        result.counts[COUNTED_TYPES] = i - counted;
+
+        const EventTypeCounts tail = countEventTypesScalar(eventTypes + i, count - i);
+        for (size_t type = 0; type <= COUNTED_TYPES; ++type) result.counts[type] += tail.counts[type];
+        return result;
+    }
+
+    CPU_TARGET("avx512f,avx512bw,popcnt")
+    EventTypeCounts countEventTypesAvx512(const uint8_t* eventTypes, size_t count) {
+        EventTypeCounts result;
+        __m512i typeValues[COUNTED_TYPES];
+        for (size_t type = 0; type < COUNTED_TYPES; ++type) {
+            typeValues[type] = _mm512_set1_epi8(static_cast<char>(type));
+        }
+
+        size_t i = 0;
+        for (; i + 64 <= count; i += 64) {
+            const __m512i values = _mm512_loadu_si512(eventTypes + i);
+            for (size_t type = 0; type < COUNTED_TYPES; ++type) {
+                result.counts[type] += static_cast<size_t>(_mm_popcnt_u64(_mm512_cmpeq_epi8_mask(values, typeValues[type])));
+            }
+        }
+        result.counts[COUNTED_TYPES] = i - (result.counts[0] + result.counts[1] + result.counts[2] + result.counts[3]);
+
+        const EventTypeCounts tail = countEventTypesScalar(eventTypes + i, count - i);
+        for (size_t type = 0; type <= COUNTED_TYPES; ++type) result.counts[type] += tail.counts[type];
+        return result;
+    }
+
+    // Widens four type bytes to 64-bit lanes, compares them with PURCHASE and uses the
+    // all-ones lanes as a bit mask over the prices. Two accumulators hide the add latency.
+    CPU_TARGET("avx2")
+    double sumPurchaseRevenueAvx2(const uint8_t* eventTypes, const double* prices, size_t count) {
+        const __m256i purchase = _mm256_set1_epi64x(PURCHASE);
+        __m256d first = _mm256_setzero_pd();
+        __m256d second = _mm256_setzero_pd();
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            int32_t lowTypes, highTypes;
+            std::memcpy(&lowTypes, eventTypes + i, sizeof(lowTypes));
+            std::memcpy(&highTypes, eventTypes + i + 4, sizeof(highTypes));
+            const __m256i lowMask = _mm256_cmpeq_epi64(_mm256_cvtepu8_epi64(_mm_cvtsi32_si128(lowTypes)), purchase);
+            const __m256i highMask = _mm256_cmpeq_epi64(_mm256_cvtepu8_epi64(_mm_cvtsi32_si128(highTypes)), purchase);
+            first = _mm256_add_pd(first, _mm256_and_pd(_mm256_castsi256_pd(lowMask), _mm256_loadu_pd(prices + i)));
+            second = _mm256_add_pd(second, _mm256_and_pd(_mm256_castsi256_pd(highMask), _mm256_loadu_pd(prices + i + 4)));
+        }
+
+        alignas(32) double parts[4];
+        _mm256_store_pd(parts, _mm256_add_pd(first, second));
+        return (parts[0] + parts[1]) + (parts[2] + parts[3]) + sumPurchaseRevenueScalar(eventTypes + i, prices + i, count - i);
+    }
+
+    CPU_TARGET("avx512f")
+    double sumPurchaseRevenueAvx512(const uint8_t* eventTypes, const double* prices, size_t count) {
+        const __m512i purchase = _mm512_set1_epi64(PURCHASE);
+        __m512d first = _mm512_setzero_pd();
+        __m512d second = _mm512_setzero_pd();
+
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            const __m512i lowTypes = _mm512_cvtepu8_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(eventTypes + i)));
+            const __m512i highTypes = _mm512_cvtepu8_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(eventTypes + i + 8)));
+            first = _mm512_mask_add_pd(first, _mm512_cmpeq_epi64_mask(lowTypes, purchase), first, _mm512_loadu_pd(prices + i));
+            second = _mm512_mask_add_pd(second, _mm512_cmpeq_epi64_mask(highTypes, purchase), second, _mm512_loadu_pd(prices + i + 8));
+        }
+
+        return _mm512_reduce_add_pd(_mm512_add_pd(first, second)) + sumPurchaseRevenueScalar(eventTypes + i, prices + i, count - i);
+    }
+
+#endif
+
+}
+
+CountEventTypesFn selectCountEventTypes(CpuLevel level) {
+#if defined(CPU_X86_64)
+    switch (level) {
+    case CpuLevel::AVX512:
+        return countEventTypesAvx512;
+    case CpuLevel::AVX2:
+        return countEventTypesAvx2;
+    case CpuLevel::SSE42:
+    case CpuLevel::SCALAR:
+        break;
+    }
+#else
+    (void)level;
+#endif
+    return countEventTypesScalar;
+}
+
+SumPurchaseRevenueFn selectSumPurchaseRevenue(CpuLevel level) {
+#if defined(CPU_X86_64)
+    switch (level) {
+    case CpuLevel::AVX512:
+        return sumPurchaseRevenueAvx512;
+    case CpuLevel::AVX2:
+        return sumPurchaseRevenueAvx2;
+    case CpuLevel::SSE42:
+    case CpuLevel::SCALAR:
+        break;
+    }
+#else
+    (void)level;
+#endif
+    return sumPurchaseRevenueScalar;
+}
+
+EventTypeCounts countEventTypes(const uint8_t* eventTypes, size_t count, CpuLevel level) {
+    return cpuDispatch(level).countEventTypes(eventTypes, count);
+}
+
+EventTypeCounts countEventTypes(const uint8_t* eventTypes, size_t count) {
+    return cpuDispatch().countEventTypes(eventTypes, count);
+}
+
+double sumPurchaseRevenue(const uint8_t* eventTypes, const double* prices, size_t count, CpuLevel level) {
+    return cpuDispatch(level).sumPurchaseRevenue(eventTypes, prices, count);
+}
+
+double sumPurchaseRevenue(const uint8_t* eventTypes, const double* prices, size_t count) {
+    return cpuDispatch().sumPurchaseRevenue(eventTypes, prices, count);
+}
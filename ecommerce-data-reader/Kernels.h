@@ -0,0 +1,32 @@
+#pragma once
+#include "CpuFeatures.h"
+#include "DataStructure.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Column scan kernels for the summary. Each kernel has a scalar version and, on x86-64,
+// AVX2 and AVX-512 versions. The overloads without a level use the active CPU level
+// (see CpuDispatch.h).
+
+// Rows per event type, indexed by static_cast<size_t>(EventType).
+struct EventTypeCounts {
+    size_t counts[5] = {};
+
+    size_t operator[](EventType type) const { return counts[static_cast<size_t>(type)]; }
+};
+
+using CountEventTypesFn = EventTypeCounts(*)(const uint8_t* eventTypes, size_t count);
+using SumPurchaseRevenueFn = double(*)(const uint8_t* eventTypes, const double* prices, size_t count);
+
+// Widest implementation that needs no more than the given level.
+CountEventTypesFn selectCountEventTypes(CpuLevel level);
+SumPurchaseRevenueFn selectSumPurchaseRevenue(CpuLevel level);
+
+EventTypeCounts countEventTypes(const uint8_t* eventTypes, size_t count, CpuLevel level);
+EventTypeCounts countEventTypes(const uint8_t* eventTypes, size_t count);
+
+// Sum of prices[i] over the rows whose event type is PURCHASE. The vector versions add in
+// a different order than the scalar loop, so results can differ in the last few bits.
+double sumPurchaseRevenue(const uint8_t* eventTypes, const double* prices, size_t count, CpuLevel level);
+double sumPurchaseRevenue(const uint8_t* eventTypes, const double* prices, size_t count);
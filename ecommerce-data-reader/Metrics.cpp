@@ -0,0 +1,170 @@
+#include "Metrics.h"
+#include "JsonWriter.h"
+
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+
+    constexpr size_t MAX_METRICS = 128;
+
+    // Written only by its own thread. Relaxed atomics let snapshots read it while that
+    // thread keeps adding; on x86 the updates compile to plain loads and stores.
+    struct ThreadMetrics {
+        std::array<std::atomic<uint64_t>, MAX_METRICS> counts{};
+        std::array<std::atomic<uint64_t>, MAX_METRICS> nanoseconds{};
+    };
+
+    struct MetricRegistry {
+        std::mutex mutex;
+        std::vector<std::pair<std::string, MetricKind>> metrics;
+        // Kept after their threads exit, so nothing recorded is lost.
+        std::vector<std::unique_ptr<ThreadMetrics>> threads;
+    };
+
+    MetricRegistry& registry() {
+        static MetricRegistry instance;
+        return instance;
+    }
+
+    ThreadMetrics& threadMetrics() {
+        thread_local ThreadMetrics* local = nullptr;
+        if (local == nullptr) {
+            MetricRegistry& metrics = registry();
+            std::lock_guard<std::mutex> lock(metrics.mutex);
+            metrics.threads.push_back(std::make_unique<ThreadMetrics>());
+            local = metrics.threads.back().get();
+        }
+        return *local;
+    }
+
+    void add(std::atomic<uint64_t>& slot, uint64_t value) {
+        slot.store(slot.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    // Prometheus label values escape backslashes, quotes and newlines.
+    void writeLabel(std::ostream& out, const std::string& value) {
+        for (char c : value) {
+            if (c == '\\' || c == '"') out << '\\' << c;
+            else if (c == '\n') out << "\\n";
+            else out << c;
+        }
+    }
+
+}
+
+size_t registerMetric(const char* name, MetricKind kind) {
+    MetricRegistry& metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+    for (size_t id = 0; id < metrics.metrics.size(); ++id) {
+        if (metrics.metrics[id].first != name) continue;
+        if (metrics.metrics[id].second != kind) {
+            throw std::invalid_argument(std::string("Metric '") + name + "' is registered as another kind");
+        }
+        return id;
+    }
+    if (metrics.metrics.size() == MAX_METRICS) {
+        throw std::invalid_argument("Too many metrics");
+    }
+    metrics.metrics.emplace_back(name, kind);
+    return metrics.metrics.size() - 1;
+}
+
+void addTimerSample(size_t id, uint64_t calls, uint64_t nanoseconds) {
+    ThreadMetrics& local = threadMetrics();
+    add(local.counts[id], calls);
+    add(local.nanoseconds[id], nanoseconds);
+}
+
+void addCounter(size_t id, uint64_t value) {
+    add(threadMetrics().counts[id], value);
+}
+
+std::vector<MetricSnapshot> snapshotMetrics() {
+    MetricRegistry& metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+    std::vector<MetricSnapshot> snapshot(metrics.metrics.size());
+    for (size_t id = 0; id < snapshot.size(); ++id) {
+        snapshot[id].name = metrics.metrics[id].first;
+        snapshot[id].kind = metrics.metrics[id].second;
+        uint64_t nanoseconds = 0;
+        for (const auto& thread : metrics.threads) {
+            snapshot[id].count += thread->counts[id].load(std::memory_order_relaxed);
+            nanoseconds += thread->nanoseconds[id].load(std::memory_order_relaxed);
+        }
+        snapshot[id].seconds = static_cast<double>(nanoseconds) / 1e9;
+    }
+    return snapshot;
+}
+
+void resetMetrics() {
+    MetricRegistry& metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+    for (const auto& thread : metrics.threads) {
+        for (auto& count : thread->counts) count.store(0, std::memory_order_relaxed);
+        for (auto& nanoseconds : thread->nanoseconds) nanoseconds.store(0, std::memory_order_relaxed);
+    }
+}
+
+void writeMetricsJson(std::ostream& out) {
+    const std::vector<MetricSnapshot> snapshot = snapshotMetrics();
+    JsonWriter json(out);
+    json.beginObject().key("timers").beginObject();
+    for (const auto& metric : snapshot) {
+        if (metric.kind != MetricKind::TIMER) continue;
+        json.key(metric.name).beginObject().field("calls", metric.count).field("seconds", metric.seconds).endObject();
+    }
+    json.endObject().key("counters").beginObject();
+    for (const auto& metric : snapshot) {
+        if (metric.kind == MetricKind::COUNTER) json.field(metric.name, metric.count);
+    }
+    json.endObject().endObject();
+    out << "\n";
+}
+
+void writeMetricsPrometheus(std::ostream& out) {
+    const std::vector<MetricSnapshot> snapshot = snapshotMetrics();
+    const std::streamsize precision = out.precision(12);
+    out << "# HELP ecommerce_stage_seconds_total Wall time spent in an instrumented stage.\n"
+        << "# TYPE ecommerce_stage_seconds_total counter\n";
+    for (const auto& metric : snapshot) {
+        if (metric.kind != MetricKind::TIMER) continue;
+        out << "ecommerce_stage_seconds_total{stage=\"";
+        writeLabel(out, metric.name);
+        out << "\"} " << metric.seconds << "\n";
+    }
+    out << "# HELP ecommerce_stage_calls_total Times an instrumented stage ran.\n"
+        << "# TYPE ecommerce_stage_calls_total counter\n";
+    for (const auto& metric : snapshot) {
+        if (metric.kind != MetricKind::TIMER) continue;
+        out << "ecommerce_stage_calls_total{stage=\"";
+        writeLabel(out, metric.name);
+        out << "\"} " << metric.count << "\n";
+    }
+    out << "# HELP ecommerce_count_total Instrumented counters.\n"
+        << "# TYPE ecommerce_count_total counter\n";
+    for (const auto& metric : snapshot) {
+        if (metric.kind != MetricKind::COUNTER) continue;
+        out << "ecommerce_count_total{name=\"";
+        writeLabel(out, metric.name);
+        out << "\"} " << metric.count << "\n";
+    }
+    out.precision(precision);
+}
+
+bool saveMetrics(const std::string& fileName, MetricsFormat format) {
+    std::ofstream out(fileName);
+    if (format == MetricsFormat::JSON) writeMetricsJson(out);
+    else writeMetricsPrometheus(out);
+    out.flush();
+    if (!out) {
+        std::cerr << "Metrics error: could not write " << fileName << "." << std::endl;
+        return false;
+    }
+    return true;
+}
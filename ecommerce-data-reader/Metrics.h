@@ -0,0 +1,95 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Lightweight stage instrumentation. Timers add up wall time and calls, counters add up
+// values, and both are accumulated per thread without locks or shared cache lines; the
+// totals are summed only when a snapshot is taken.
+//
+//     METRIC_TIMER("analysis.productStats");   // times the rest of the enclosing scope
+//     METRIC_COUNT("parse.rows", rows);
+//
+// Build with METRICS_ENABLED=0 to compile every METRIC_ macro away. The functions below
+// stay available and then report nothing.
+#ifndef METRICS_ENABLED
+#define METRICS_ENABLED 1
+#endif
+
+enum class MetricKind {
+    TIMER,
+    COUNTER
+};
+
+enum class MetricsFormat {
+    JSON,
+    PROMETHEUS
+};
+
+struct MetricSnapshot {
+    std::string name;
+    MetricKind kind = MetricKind::TIMER;
+    // Calls for a timer, the summed value for a counter.
+    uint64_t count = 0;
+    double seconds = 0.0;
+};
+
+// Returns the id for a name, registering it on first use. Throws std::invalid_argument if
+// the name is already registered with the other kind, or if all slots are taken.
+size_t registerMetric(const char* name, MetricKind kind);
+void addTimerSample(size_t id, uint64_t calls, uint64_t nanoseconds);
+void addCounter(size_t id, uint64_t value);
+
+// Totals over all threads, in registration order. Values added by work still running
+// may or may not be included.
+std::vector<MetricSnapshot> snapshotMetrics();
+// Zeroes every metric; call it while no instrumented work runs.
+void resetMetrics();
+
+void writeMetricsJson(std::ostream& out);
+// Prometheus text exposition format.
+void writeMetricsPrometheus(std::ostream& out);
+// Returns false, with a message on std::cerr, if the file cannot be written.
+bool saveMetrics(const std::string& fileName, MetricsFormat format);
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(size_t id) : id(id), start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        addTimerSample(id, 1, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    size_t id;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define METRIC_JOIN_IMPL(a, b) a##b
+#define METRIC_JOIN(a, b) METRIC_JOIN_IMPL(a, b)
+
+#if METRICS_ENABLED
+#define METRIC_TIMER(name) \
+    static const size_t METRIC_JOIN(metricId, __LINE__) = registerMetric(name, MetricKind::TIMER); \
+    ScopedTimer METRIC_JOIN(metricTimer, __LINE__)(METRIC_JOIN(metricId, __LINE__))
+#define METRIC_COUNT(name, value) \
+    do { \
+        static const size_t metricId = registerMetric(name, MetricKind::COUNTER); \
+        addCounter(metricId, value); \
+    } while (0)
+// Adds time measured elsewhere, e.g. an estimate scaled up from sampled rows.
+#define METRIC_ADD_TIME(name, calls, nanoseconds) \
+    do { \
+        static const size_t metricId = registerMetric(name, MetricKind::TIMER); \
+        addTimerSample(metricId, calls, nanoseconds); \
+    } while (0)
+#else
+#define METRIC_TIMER(name) ((void)0)
+#define METRIC_COUNT(name, value) ((void)0)
+#define METRIC_ADD_TIME(name, calls, nanoseconds) ((void)0)
+#endif
@@ -0,0 +1,31 @@
+#include "Parallel.h"
+
+#include <atomic>
+#include <thread>
+
+namespace {
+    std::atomic<unsigned> configuredThreadCount{ 0 };
+    std::atomic<bool> configuredPinning{ false };
+}
+
+unsigned getThreadCount() {
+    unsigned count = configuredThreadCount.load(std::memory_order_relaxed);
+    if (count == 0) {
+        count = std::thread::hardware_concurrency();
+    }
+    return count == 0 ? 1 : count;
+}
+
+void setThreadCount(unsigned threadCount) {
+    configuredThreadCount.store(threadCount, std::memory_order_relaxed);
+    Scheduler::resetInstance();
+}
+
+bool getThreadPinning() {
+    return configuredPinning.load(std::memory_order_relaxed);
+}
+
+void setThreadPinning(bool pinThreads) {
+    configuredPinning.store(pinThreads, std::memory_order_relaxed);
+    Scheduler::resetInstance();
+}
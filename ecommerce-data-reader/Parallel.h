@@ -0,0 +1,72 @@
+#pragma once
+#include "Scheduler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Threads the shared scheduler uses, counting the calling thread. Defaults to the
+// hardware thread count; set it before starting parallel work.
+unsigned getThreadCount();
+void setThreadCount(unsigned threadCount);
+// Pins scheduler workers to logical CPUs; off by default.
+bool getThreadPinning();
+void setThreadPinning(bool pinThreads);
+
+// Splits [0, count) into chunkCount contiguous ranges and runs fn(chunkIndex, begin, end)
+// for each of them as a scheduler task. The calling thread handles the first chunk.
+template<typename Fn>
+void parallelChunks(size_t count, size_t chunkCount, Fn&& fn) {
+    if (chunkCount == 0) chunkCount = 1;
+    const size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+    TaskGroup group;
+    for (size_t chunk = 1; chunk < chunkCount; ++chunk) {
+        size_t begin = std::min(count, chunk * chunkSize);
+        size_t end = std::min(count, begin + chunkSize);
+        group.spawn([&fn, chunk, begin, end]() { fn(chunk, begin, end); });
+    }
+    fn(size_t{ 0 }, size_t{ 0 }, std::min(count, chunkSize));
+    group.wait();
+}
+
+// Runs fn(begin, end) over [first, last) in ranges of about grainSize items. Ranges are
+// many more than threads, so stealing evens out uneven work. 0 picks eight ranges per thread.
+template<typename Fn>
+void parallelFor(size_t first, size_t last, Fn&& fn, size_t grainSize = 0) {
+    if (first >= last) return;
+    const size_t count = last - first;
+    if (grainSize == 0) grainSize = std::max<size_t>(1, count / (size_t{ getThreadCount() } * 8));
+
+    TaskGroup group;
+    for (size_t begin = first + grainSize; begin < last; begin += grainSize) {
+        const size_t end = std::min(last, begin + grainSize);
+        group.spawn([&fn, begin, end]() { fn(begin, end); });
+    }
+    fn(first, std::min(last, first + grainSize));
+    group.wait();
+}
+
+// Maps each range of [first, last) to a partial result with map(begin, end) and folds the
+// partials in range order with combine(T, T), so the result does not depend on which
+// thread ran which range.
+template<typename T, typename Map, typename Combine>
+T parallelReduce(size_t first, size_t last, T identity, Map&& map, Combine&& combine, size_t grainSize = 0) {
+    if (first >= last) return identity;
+    const size_t count = last - first;
+    if (grainSize == 0) grainSize = std::max<size_t>(1, count / (size_t{ getThreadCount() } * 8));
+
+    std::vector<T> partials((count + grainSize - 1) / grainSize, identity);
+    parallelFor(0, partials.size(), [&](size_t begin, size_t end) {
+        for (size_t range = begin; range < end; ++range) {
+            const size_t rangeBegin = first + range * grainSize;
+            partials[range] = map(rangeBegin, std::min(last, rangeBegin + grainSize));
+        }
+        }, 1);
+
+    T result = identity;
+    for (auto& partial : partials) {
+        result = combine(std::move(result), std::move(partial));
+    }
+    return result;
+}
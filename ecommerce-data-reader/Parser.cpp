@@ -1,88 +1,115 @@
 #include "Parser.h"
+#include "BoundedQueue.h"
+#include "CpuDispatch.h"
 #include "DataStructure.h"
+#include "FieldParsers.h"
+#include "Metrics.h"
+#include "Parallel.h"
 #include "mio.hpp"
 
 #include <iostream>
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <charconv>
+#include <stdexcept>
 #include <vector>
 #include <cassert>
 
 namespace {
 
-    template<typename T>
-    void parseNumeric(T& outValue, std::string_view fieldView) {
-        if (fieldView.empty()) {
-            outValue = 0;
-            return;
+    // One line in ROW_SAMPLE_INTERVAL has its stages timed and the totals are scaled up to
+    // every line; reading the clock on every line would cost more than tokenizing it.
+    constexpr size_t ROW_SAMPLE_INTERVAL = 64;
+
+    // nextLine followed by parseLine, with per-stage metrics.
+    class SampledLineParser {
+    public:
+        bool parseNext(std::string_view& data, const CpuDispatch& cpu, ECommerceEvent& event) {
+#if METRICS_ENABLED
+            if (lines++ % ROW_SAMPLE_INTERVAL == 0) return parseNextTimed(data, cpu, event);
+            const bool valid = parseLine(nextLine(data, cpu), cpu, event);
+            validRows += valid;
+            return valid;
+#else
+            return parseLine(nextLine(data, cpu), cpu, event);
+#endif
         }
-        auto result = std::from_chars(fieldView.data(), fieldView.data() + fieldView.size(), outValue);
-        if (result.ec != std::errc()) {
-            outValue = 0;
-        }
-    }
-
-    EventType parseEventType(std::string_view eventStr) {
-        if (eventStr == "view") return EventType::VIEW;
-        if (eventStr == "cart") return EventType::CART;
-        if (eventStr == "remove_from_cart") return EventType::REMOVE_FROM_CART;
-        if (eventStr == "purchase") return EventType::PURCHASE;
-        return EventType::UNKNOWN;
-    }
 
-    void parseTimestamp(PurchaseTime& outTime, std::string_view timeView) {
-        if (timeView.length() < 19) {
-            outTime = { 0,0,0,0,0,0 };
-            return;
+        // Adds this parser's line counts and stage estimates to the calling thread's metrics.
+        void publish() const {
+#if METRICS_ENABLED
+            METRIC_COUNT("parse.lines", lines);
+            METRIC_COUNT("parse.rows", validRows);
+            METRIC_COUNT("parse.rejected", lines - validRows);
+            if (sampledLines == 0) return;
+            const double scale = static_cast<double>(lines) / sampledLines;
+            METRIC_ADD_TIME("parse.tokenize", lines, static_cast<uint64_t>(tokenizeNanoseconds * scale));
+            METRIC_ADD_TIME("parse.decode", lines, static_cast<uint64_t>(decodeNanoseconds * scale));
+            METRIC_ADD_TIME("parse.validate", lines, static_cast<uint64_t>(validateNanoseconds * scale));
+#endif
         }
-        parseNumeric(outTime.year, timeView.substr(0, 4));
-        parseNumeric(outTime.month, timeView.substr(5, 2));
-        parseNumeric(outTime.day, timeView.substr(8, 2));
-        parseNumeric(outTime.hour, timeView.substr(11, 2));
-        parseNumeric(outTime.minute, timeView.substr(14, 2));
-        parseNumeric(outTime.second, timeView.substr(17, 2));
-    }
-
-    void parseCategoryCode(CategoryCode& outCode, std::string_view catCodeStr) {
-        outCode = { "", "", "" };
-        std::vector<std::string_view> tempCodeStore;
-        tempCodeStore.reserve(3);
 
-        while (!catCodeStr.empty()) {
-            size_t nextDot = catCodeStr.find('.');
-            if (nextDot == std::string_view::npos) {
-                tempCodeStore.emplace_back(catCodeStr);
-                catCodeStr.remove_prefix(catCodeStr.size());
-            }
-            else {
-                tempCodeStore.emplace_back(catCodeStr.substr(0, nextDot));
-                catCodeStr.remove_prefix(nextDot + 1);
-            }
+    private:
+        bool parseNextTimed(std::string_view& data, const CpuDispatch& cpu, ECommerceEvent& event) {
+            using Clock = std::chrono::steady_clock;
+            const auto start = Clock::now();
+            const std::string_view line = nextLine(data, cpu);
+            std::array<std::string_view, NUM_COLUMNS> fields;
+            if (!line.empty()) splitFields(line, cpu, fields);
+            const auto tokenized = Clock::now();
+            if (!line.empty()) decodeFields(fields, cpu, event);
+            const auto decoded = Clock::now();
+            const bool valid = !line.empty() && isEventValid(event);
+            const auto validated = Clock::now();
+
+            sampledLines++;
+            validRows += valid;
+            tokenizeNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(tokenized - start).count();
+            decodeNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(decoded - tokenized).count();
+            validateNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(validated - decoded).count();
+            return valid;
         }
 
-        if (tempCodeStore.size() > 0) outCode.code = tempCodeStore[0];
-        if (tempCodeStore.size() > 1) outCode.subcode = tempCodeStore[1];
-        if (tempCodeStore.size() > 2) outCode.secondarySubcode = tempCodeStore[2];
-    }
+        size_t lines = 0;
+        size_t validRows = 0;
+        size_t sampledLines = 0;
+        uint64_t tokenizeNanoseconds = 0;
+        uint64_t decodeNanoseconds = 0;
+        uint64_t validateNanoseconds = 0;
+    };
 
-    bool isEventValid(const ECommerceEvent& event) {
-        return event.price >= 0.0 &&
-            event.eventType != EventType::UNKNOWN &&
-            event.prodId != 0 &&
-            event.userId != 0;
+    mio::mmap_source mapFile(const std::string& fileName) {
+        METRIC_TIMER("parse.map");
+        mio::mmap_source data(fileName);
+        METRIC_COUNT("parse.bytes", data.size());
+        return data;
     }
 
 }
 
-const size_t ALLOC_NEEDED = 70000000;
+// Rows are estimated from the line length in the first part of the file.
+const size_t RESERVE_SAMPLE_BYTES = 1 << 20;
+
+Parser::Parser() = default;
+
+void Parser::reserveFor(std::string_view data) {
+    const size_t sampleSize = std::min(data.size(), RESERVE_SAMPLE_BYTES);
+    const size_t sampleLines = static_cast<size_t>(std::count(data.data(), data.data() + sampleSize, '\n'));
+    if (sampleLines == 0) return;
+    const size_t estimatedRows = static_cast<size_t>(static_cast<double>(data.size()) / sampleSize * sampleLines * 1.02) + 16;
+    const size_t needed = eventVector.size() + estimatedRows;
+    if (needed <= eventVector.capacity()) return;
 
-Parser::Parser() {
     try {
-        eventVector.reserve(ALLOC_NEEDED);
+        eventVector.reserve(needed);
+        eventColumns.eventTypes.reserve(needed);
+        eventColumns.prices.reserve(needed);
     }
     catch (const std::bad_alloc& e) {
         std::cerr << "FATAL ERROR: Failed to allocate required memory ("
-            << (ALLOC_NEEDED * sizeof(ECommerceEvent)) / (1024 * 1024) << " MB)."
+            << (needed * sizeof(ECommerceEvent)) / (1024 * 1024) << " MB for about " << needed << " rows)."
             << std::endl;
         std::cerr << "  Exception details: " << e.what() << std::endl;
         std::cerr << "  This can happen if you do not have enough available RAM, "
@@ -96,132 +123,203 @@ const std::vector<ECommerceEvent>& Parser::getEventVector() const {
     return eventVector;
 }
 
-void Parser::runUnitTests() {
-    std::cout << "--- Running Unit Tests ---" << std::endl;
-
-    int failedTests = 0;
-
-    int intVal;
-    parseNumeric(intVal, "123");
-    if (intVal != 123) { std::cerr << "TEST FAILED: parseNumeric basic int" << std::endl; failedTests++; }
-    parseNumeric(intVal, "");
-    if (intVal != 0) { std::cerr << "TEST FAILED: parseNumeric empty int" << std::endl; failedTests++; }
-
-    double doubleVal;
-    parseNumeric(doubleVal, "45.67");
-    if (abs(doubleVal - 45.67) > 1e-9) { std::cerr << "TEST FAILED: parseNumeric basic double" << std::endl; failedTests++; }
-
-    if (parseEventType("view") != EventType::VIEW) { std::cerr << "TEST FAILED: parseEventType view" << std::endl; failedTests++; }
-    if (parseEventType("invalid") != EventType::UNKNOWN) { std::cerr << "TEST FAILED: parseEventType unknown" << std::endl; failedTests++; }
-
-    PurchaseTime pt;
-    parseTimestamp(pt, "2025-06-16 21:15:30 UTC");
-    if (pt.year != 2025 || pt.month != 6 || pt.day != 16 || pt.hour != 21 || pt.minute != 15 || pt.second != 30) {
-        std::cerr << "TEST FAILED: parseTimestamp" << std::endl; failedTests++;
-    }
-
-    CategoryCode cc;
-    parseCategoryCode(cc, "electronics.smartphone.apple");
-    if (cc.code != "electronics" || cc.subcode != "smartphone" || cc.secondarySubcode != "apple") {
-        std::cerr << "TEST FAILED: parseCategoryCode full" << std::endl; failedTests++;
-    }
-    parseCategoryCode(cc, "apparel.shoes");
-    if (cc.code != "apparel" || cc.subcode != "shoes" || !cc.secondarySubcode.empty()) {
-        std::cerr << "TEST FAILED: parseCategoryCode partial" << std::endl; failedTests++;
-    }
+const EventColumns& Parser::getEventColumns() const {
+    return eventColumns;
+}
 
-    ECommerceEvent validEvent = { {}, EventType::VIEW, 1,1,{},"",10.0,1,{} };
-    ECommerceEvent invalidEvent = { {}, EventType::VIEW, 1,1,{},"",-1.0,1,{} };
-    if (!isEventValid(validEvent)) { std::cerr << "TEST FAILED: isEventValid positive case" << std::endl; failedTests++; }
-    if (isEventValid(invalidEvent)) { std::cerr << "TEST FAILED: isEventValid negative case" << std::endl; failedTests++; }
+const BitmapIndex& Parser::getBitmapIndex() const {
+    return bitmapIndex;
+}
 
+void Parser::setProgressOutput(std::ostream* out) {
+    progressOutput = out;
+}
 
-    if (failedTests == 0) {
-        std::cout << "All unit tests passed!" << std::endl;
-    }
-    else {
-        std::cout << failedTests << " unit tests FAILED." << std::endl;
-    }
-    std::cout << "--------------------------" << std::endl << std::endl;
+void Parser::setBitmapIndexEnabled(bool enabled) {
+    bitmapIndexEnabled = enabled;
 }
 
 void Parser::parseFile(const std::string& fileName) {
     try {
-        mio::mmap_source data(fileName);
+        const CpuDispatch& cpu = cpuDispatch();
+        mio::mmap_source data = mapFile(fileName);
         std::string_view dataView(data.data(), data.size());
 
         const size_t totalSize = dataView.size();
         int lastReportedPercent = -1;
+        reserveFor(dataView);
 
         size_t firstNewline = dataView.find('\n');
         if (firstNewline != std::string_view::npos) {
             dataView.remove_prefix(firstNewline + 1);
         }
 
+        SampledLineParser lineParser;
         while (!dataView.empty()) {
             size_t bytesProcessed = totalSize - dataView.size();
             int currentPercent = static_cast<int>((static_cast<double>(bytesProcessed) / totalSize) * 100.0);
 
-            if (currentPercent > lastReportedPercent) {
-                std::cout << "\rParsing progress: " << currentPercent << "%" << std::flush;
+            if (currentPercent > lastReportedPercent && progressOutput != nullptr) {
+                *progressOutput << "\rParsing progress: " << currentPercent << "%" << std::flush;
                 lastReportedPercent = currentPercent;
             }
 
-            size_t nextNewline = dataView.find('\n');
-            std::string_view line;
+            ECommerceEvent event;
+            if (!lineParser.parseNext(dataView, cpu, event)) continue;
 
-            if (nextNewline == std::string_view::npos) {
-                line = dataView;
-                dataView.remove_prefix(dataView.size());
-            }
-            else {
-                line = dataView.substr(0, nextNewline);
-                dataView.remove_prefix(nextNewline + 1);
+            if (bitmapIndexEnabled) {
+                bitmapIndex.add(static_cast<uint32_t>(eventVector.size()), event);
             }
+            eventColumns.eventTypes.push_back(static_cast<uint8_t>(event.eventType));
+            eventColumns.prices.push_back(event.price);
+            eventVector.emplace_back(std::move(event));
+        }
+        lineParser.publish();
+        if (progressOutput != nullptr) {
+            *progressOutput << "\rParsing progress: 100%" << std::endl;
+        }
 
-            if (!line.empty() && line.back() == '\r') {
-                line.remove_suffix(1);
-            }
+        mappedFiles.emplace_back(std::move(data));
 
-            if (line.empty()) continue;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Parser error: " << e.what() << std::endl;
+    }
+}
 
-            const size_t NUM_COLUMNS = 9;
-            std::array<std::string_view, NUM_COLUMNS> fields;
-            size_t fieldIndex = 0;
-            std::string_view lineView = line;
-            while (!lineView.empty() && fieldIndex < NUM_COLUMNS) {
-                size_t nextComma = lineView.find(',');
-                if (nextComma == std::string_view::npos) {
-                    fields[fieldIndex] = lineView;
-                    lineView.remove_prefix(lineView.size());
-                }
-                else {
-                    fields[fieldIndex] = lineView.substr(0, nextComma);
-                    lineView.remove_prefix(nextComma + 1);
-                }
-                fieldIndex++;
+PipelineStats Parser::parseFilePipelined(const std::string& fileName, const PipelineOptions& options, const BatchConsumer& consume) {
+    PipelineStats stats;
+    try {
+        const auto wallStart = std::chrono::high_resolution_clock::now();
+        const CpuDispatch& cpu = cpuDispatch();
+        mio::mmap_source data = mapFile(fileName);
+        std::string_view body(data.data(), data.size());
+        size_t firstNewline = body.find('\n');
+        body.remove_prefix(firstNewline == std::string_view::npos ? body.size() : firstNewline + 1);
+
+        // Parsers and consumers wait on each other, so all of them must be running at once:
+        // they run as scheduler stages rather than tasks, where one could stay queued behind
+        // a busy worker while the others block on it. Together they get at most the
+        // scheduler's threads. With a single thread the parser hands each batch straight to
+        // consumer 0.
+        const size_t threadCount = getThreadCount();
+        const size_t parserThreads = std::max<size_t>(1, std::min(threadCount - 1,
+            options.parserThreads != 0 ? options.parserThreads : threadCount / 2));
+        const size_t consumerThreads = std::min(threadCount - parserThreads,
+            options.consumerThreads != 0 ? options.consumerThreads : threadCount - parserThreads);
+        const bool inlineConsumer = consumerThreads == 0;
+        const size_t consumerSlots = std::max<size_t>(1, consumerThreads);
+        const size_t batchSize = std::max<size_t>(1, options.batchSize);
+
+        // Every batch is allocated here once: enough to fill the queue while each parser and
+        // each consumer holds one more. Empty batches wait in the free list.
+        const size_t batchCount = options.queueCapacity + parserThreads + consumerThreads;
+        std::vector<std::vector<ECommerceEvent>> batches(batchCount);
+        size_t freeCapacity = 2;
+        while (freeCapacity < batchCount) freeCapacity *= 2;
+        BoundedQueue<std::vector<ECommerceEvent>*> freeBatches(freeCapacity);
+        BoundedQueue<std::vector<ECommerceEvent>*> fullBatches(options.queueCapacity);
+        for (auto& batch : batches) {
+            batch.reserve(batchSize);
+            freeBatches.push(&batch);
+        }
+
+        // Parser ranges start and end on line boundaries.
+        std::vector<size_t> rangeStarts(parserThreads + 1, body.size());
+        rangeStarts[0] = 0;
+        for (size_t parser = 1; parser < parserThreads; ++parser) {
+            size_t start = std::max(rangeStarts[parser - 1], body.size() / parserThreads * parser);
+            if (start > 0) {
+                size_t newline = body.find('\n', start - 1);
+                start = newline == std::string_view::npos ? body.size() : newline + 1;
             }
+            rangeStarts[parser] = start;
+        }
 
+        std::vector<size_t> parserRows(parserThreads, 0);
+        std::vector<double> parseBusy(parserThreads, 0.0);
+        std::vector<size_t> consumerBatches(consumerSlots, 0);
+        std::vector<double> consumeBusy(consumerSlots, 0.0);
+        std::atomic<size_t> activeParsers{ parserThreads };
+
+        auto consumeBatch = [&](size_t consumer, std::vector<ECommerceEvent>& batch) {
+            const auto start = std::chrono::high_resolution_clock::now();
+            consume(consumer, batch);
+            consumeBusy[consumer] += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            consumerBatches[consumer]++;
+            batch.clear();
+        };
+
+        // A failing stage closes both queues: parsers stop at their next batch and consumers
+        // drain what is queued without consuming it, so every stage finishes and runStages
+        // rethrows the error.
+        std::atomic<bool> failed{ false };
+        auto parseRange = [&](size_t task) {
+            const auto start = std::chrono::high_resolution_clock::now();
+            std::string_view range = body.substr(rangeStarts[task], rangeStarts[task + 1] - rangeStarts[task]);
+            std::vector<ECommerceEvent>* batch = nullptr;
+            if (!freeBatches.pop(batch)) return;
             ECommerceEvent event;
-
-            parseTimestamp(event.purchaseTime, fields[0]);
-            event.eventType = parseEventType(fields[1]);
-            parseNumeric(event.prodId, fields[2]);
-            parseNumeric(event.categoryId, fields[3]);
-            parseCategoryCode(event.categoryCode, fields[4]);
-            event.brand = fields[5];
-            parseNumeric(event.price, fields[6]);
-            parseNumeric(event.userId, fields[7]);
-            event.userSession = fields[8];
-
-            if (isEventValid(event)) {
-                eventVector.emplace_back(std::move(event));
+            SampledLineParser lineParser;
+            while (!range.empty() && !failed.load(std::memory_order_acquire)) {
+                if (!lineParser.parseNext(range, cpu, event)) continue;
+                batch->push_back(event);
+                if (batch->size() == batchSize) {
+                    parserRows[task] += batch->size();
+                    if (inlineConsumer) {
+                        consumeBatch(0, *batch);
+                    }
+                    else if (!fullBatches.push(batch) || !freeBatches.pop(batch)) {
+                        return;
+                    }
+                }
+            }
+            parserRows[task] += batch->size();
+            lineParser.publish();
+            if (batch->empty()) freeBatches.push(batch);
+            else if (inlineConsumer) consumeBatch(0, *batch);
+            else fullBatches.push(batch);
+            parseBusy[task] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+            if (inlineConsumer) parseBusy[task] -= consumeBusy[0];
+            if (activeParsers.fetch_sub(1) == 1) fullBatches.close();
+        };
+        auto consumeQueue = [&](size_t consumer) {
+            std::vector<ECommerceEvent>* batch = nullptr;
+            while (fullBatches.pop(batch)) {
+                if (!failed.load(std::memory_order_acquire)) consumeBatch(consumer, *batch);
+                else batch->clear();
+                freeBatches.push(batch);
+            }
+        };
+        Scheduler::instance().runStages(parserThreads + consumerThreads, [&](size_t task) {
+            try {
+                if (task < parserThreads) parseRange(task);
+                else consumeQueue(task - parserThreads);
             }
+            catch (...) {
+                failed.store(true, std::memory_order_release);
+                fullBatches.close();
+                freeBatches.close();
+                throw;
+            }
+            });
+
+        stats.parserThreads = parserThreads;
+        stats.consumerThreads = consumerThreads;
+        for (size_t parser = 0; parser < parserThreads; ++parser) {
+            stats.rows += parserRows[parser];
+            stats.parseSeconds += parseBusy[parser];
+        }
+        for (size_t consumer = 0; consumer < consumerSlots; ++consumer) {
+            stats.batches += consumerBatches[consumer];
+            stats.consumeSeconds += consumeBusy[consumer];
         }
-        std::cout << "\rParsing progress: 100%" << std::endl;
+        stats.wallSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - wallStart).count();
 
+        mappedFiles.emplace_back(std::move(data));
     }
     catch (const std::exception& e) {
         std::cerr << "Parser error: " << e.what() << std::endl;
     }
+    return stats;
 }
@@ -1,15 +1,69 @@
 #pragma once
+#include "Bitmap.h"
 #include "DataStructure.h"
+#include "mio.hpp"
+#include <functional>
+#include <iostream>
+#include <string_view>
 #include <vector>
 #include <string>
 
+struct PipelineOptions {
+    // 0 splits getThreadCount() evenly between parsing and consuming. Both are capped so
+    // that parsers and consumers together fit the scheduler's threads.
+    size_t parserThreads = 0;
+    size_t consumerThreads = 0;
+    size_t batchSize = 4096;
+    // Filled batches that may wait for a consumer; a power of two.
+    size_t queueCapacity = 64;
+};
+
+struct PipelineStats {
+    size_t rows = 0;
+    size_t batches = 0;
+    // Threads actually used; 0 consumer threads means the parser consumed its own batches.
+    size_t parserThreads = 0;
+    size_t consumerThreads = 0;
+    // Busy time summed over the parser threads and over the consumer threads.
+    double parseSeconds = 0.0;
+    double consumeSeconds = 0.0;
+    double wallSeconds = 0.0;
+};
+
+// Called on consumer thread `consumer` (0 <= consumer < consumerThreads, or 0 when
+// consuming inline) with a batch of valid events. Must not start parallel work; the batch
+// is reused once the call returns. If it throws, the pipeline stops, the queued batches
+// are dropped and parseFilePipelined reports the error as it does a parse failure.
+using BatchConsumer = std::function<void(size_t consumer, const std::vector<ECommerceEvent>& batch)>;
+
 class Parser {
 public:
     Parser();
     void parseFile(const std::string& fileName);
-    void runUnitTests();
+    // Parses on several threads and streams fixed-size batches through a bounded queue to
+    // consumer threads, so aggregation overlaps parsing. Events are not kept in the event
+    // vector; their string_views stay valid for the lifetime of the parser.
+    PipelineStats parseFilePipelined(const std::string& fileName, const PipelineOptions& options, const BatchConsumer& consume);
+    // Returns true if every test passed; failures are also reported on std::cerr.
+    bool runUnitTests(std::ostream& out = std::cout);
     const std::vector<ECommerceEvent>& getEventVector() const;
+    const EventColumns& getEventColumns() const;
+    const BitmapIndex& getBitmapIndex() const;
+    // Bitmaps are built during parsing unless disabled before parseFile is called.
+    void setBitmapIndexEnabled(bool enabled);
+    // Where parseFile reports its progress; nullptr silences it. Defaults to std::cout.
+    void setProgressOutput(std::ostream* out);
 
 private:
+    // Reserves the event storage once per file from a row estimate, instead of growing it
+    // row by row.
+    void reserveFor(std::string_view data);
+
     std::vector<ECommerceEvent> eventVector;
+    EventColumns eventColumns;
+    BitmapIndex bitmapIndex;
+    bool bitmapIndexEnabled = true;
+    std::ostream* progressOutput = &std::cout;
+    // The events hold string_views into these mappings, so they live as long as the parser.
+    std::vector<mio::mmap_source> mappedFiles;
 };
@@ -0,0 +1,56 @@
+#pragma once
+#include "DataStructure.h"
+#include "Parallel.h"
+
+#include <cstdint>
+#include <vector>
+
+// rows[chunk][partition] holds the indices of the rows from one input chunk that hash to
+// one partition. Walking a partition chunk by chunk visits its rows in file order.
+using PartitionedRows = std::vector<std::vector<std::vector<uint32_t>>>;
+
+// Scatters row indices into partitionCount hash partitions in a single parallel pass, so
+// each partition can afterwards be aggregated by one thread without any locking.
+template<typename KeyHash>
+PartitionedRows partitionRows(const std::vector<ECommerceEvent>& events, size_t partitionCount, KeyHash keyHash) {
+    const size_t chunkCount = getThreadCount();
+    PartitionedRows rows(chunkCount, std::vector<std::vector<uint32_t>>(partitionCount));
+
+    parallelChunks(events.size(), chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+        auto& localRows = rows[chunk];
+        for (auto& partition : localRows) {
+            partition.reserve((end - begin) / partitionCount + 1);
+        }
+        for (size_t row = begin; row < end; ++row) {
+            localRows[keyHash(events[row]) % partitionCount].push_back(static_cast<uint32_t>(row));
+        }
+        });
+    return rows;
+}
+
+// Same layout as partitionRows, holding only the rows for which keep(event) is true. Meant
+// for sparse selections such as purchases, so nothing is reserved up front.
+template<typename KeyHash, typename Predicate>
+PartitionedRows partitionRowsIf(const std::vector<ECommerceEvent>& events, size_t partitionCount, KeyHash keyHash, Predicate keep) {
+    const size_t chunkCount = getThreadCount();
+    PartitionedRows rows(chunkCount, std::vector<std::vector<uint32_t>>(partitionCount));
+
+    parallelChunks(events.size(), chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+        auto& localRows = rows[chunk];
+        for (size_t row = begin; row < end; ++row) {
+            if (keep(events[row])) {
+                localRows[keyHash(events[row]) % partitionCount].push_back(static_cast<uint32_t>(row));
+            }
+        }
+        });
+    return rows;
+}
+
+template<typename Fn>
+void forEachPartitionRow(const PartitionedRows& rows, size_t partition, Fn&& fn) {
+    for (const auto& chunkRows : rows) {
+        for (uint32_t row : chunkRows[partition]) {
+            fn(row);
+        }
+    }
+}
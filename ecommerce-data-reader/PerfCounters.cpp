@@ -0,0 +1,176 @@
+#include "PerfCounters.h"
+
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace {
+
+    const char* const PERF_EVENT_NAMES[PERF_EVENT_COUNT] = {
+        "cycles", "instructions", "branch-misses", "LLC-misses", "page-faults"
+    };
+
+#if defined(__linux__)
+    int openCounter(PerfEvent event) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        switch (event) {
+        case PerfEvent::CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PerfEvent::INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PerfEvent::BRANCH_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case PerfEvent::CACHE_MISSES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case PerfEvent::PAGE_FAULTS:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+            break;
+        }
+        // User space only, which the default perf_event_paranoid setting allows. Inherited
+        // counters also count threads created later, and reading the parent's descriptor
+        // sums over all of them.
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+#endif
+
+    void printPerRow(std::ostream& out, const PerfStageReport& stage, PerfEvent event, int width) {
+        if (stage.counts.has(event) && stage.rows > 0) out << std::setw(width) << stage.perRow(event);
+        else out << std::setw(width) << "n/a";
+    }
+
+}
+
+double PerfStageReport::ipc() const {
+    if (!counts.has(PerfEvent::CYCLES) || !counts.has(PerfEvent::INSTRUCTIONS) || counts.get(PerfEvent::CYCLES) <= 0.0) return 0.0;
+    return counts.get(PerfEvent::INSTRUCTIONS) / counts.get(PerfEvent::CYCLES);
+}
+
+double PerfStageReport::perRow(PerfEvent event) const {
+    if (rows == 0 || !counts.has(event)) return 0.0;
+    return counts.get(event) / static_cast<double>(rows);
+}
+
+PerfCounters::~PerfCounters() {
+#if defined(__linux__)
+    for (int descriptor : descriptors) {
+        if (descriptor >= 0) close(descriptor);
+    }
+#endif
+}
+
+bool PerfCounters::open(std::string& error) {
+#if defined(__linux__)
+    std::string failures;
+    for (size_t i = 0; i < PERF_EVENT_COUNT; ++i) {
+        if (descriptors[i] >= 0) continue;
+        descriptors[i] = openCounter(static_cast<PerfEvent>(i));
+        if (descriptors[i] < 0) {
+            failures += std::string(failures.empty() ? "" : ", ") + PERF_EVENT_NAMES[i] + " (" + std::strerror(errno) + ")";
+        }
+    }
+    if (!isOpen()) {
+        error = "perf_event_open failed: " + failures + "; check /proc/sys/kernel/perf_event_paranoid";
+        return false;
+    }
+    error = failures.empty() ? "" : "unavailable: " + failures;
+    return true;
+#else
+    error = "hardware counters need Linux perf_event_open";
+    return false;
+#endif
+}
+
+bool PerfCounters::isOpen() const {
+    for (int descriptor : descriptors) {
+        if (descriptor >= 0) return true;
+    }
+    return false;
+}
+
+PerfReading PerfCounters::read() const {
+    PerfReading reading;
+    reading.time = std::chrono::steady_clock::now();
+#if defined(__linux__)
+    for (size_t i = 0; i < PERF_EVENT_COUNT; ++i) {
+        if (descriptors[i] < 0) continue;
+        // value, time enabled, time running
+        uint64_t data[3] = { 0, 0, 0 };
+        if (::read(descriptors[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data))) continue;
+        reading.available[i] = true;
+        reading.values[i] = data[2] == 0 ? 0.0 : static_cast<double>(data[0]) * static_cast<double>(data[1]) / static_cast<double>(data[2]);
+    }
+#endif
+    return reading;
+}
+
+void PerfCounters::addStage(const std::string& name, size_t rows, const PerfReading& begin, const PerfReading& end) {
+    PerfStageReport stage;
+    stage.name = name;
+    stage.rows = rows;
+    stage.seconds = std::chrono::duration<double>(end.time - begin.time).count();
+    for (size_t i = 0; i < PERF_EVENT_COUNT; ++i) {
+        stage.counts.available[i] = begin.available[i] && end.available[i];
+        stage.counts.values[i] = stage.counts.available[i] ? end.values[i] - begin.values[i] : 0.0;
+    }
+    stages.push_back(std::move(stage));
+}
+
+const std::vector<PerfStageReport>& PerfCounters::getStages() const {
+    return stages;
+}
+
+void PerfCounters::printStages(std::ostream& out) const {
+    out << "\n--- Hardware Counters (per row) ---" << std::endl;
+    out << std::left << std::setw(18) << "Stage" << std::right << std::setw(10) << "Seconds" << std::setw(12) << "Rows"
+        << std::setw(8) << "IPC" << std::setw(14) << "Branch miss" << std::setw(12) << "LLC miss"
+        << std::setw(13) << "Page faults" << std::endl;
+    out << std::string(87, '-') << std::endl;
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    out << std::fixed;
+    for (const auto& stage : stages) {
+        out << std::left << std::setw(18) << stage.name << std::right << std::setprecision(4) << std::setw(10) << stage.seconds
+            << std::setw(12) << stage.rows << std::setprecision(2);
+        if (stage.ipc() > 0.0) out << std::setw(8) << stage.ipc();
+        else out << std::setw(8) << "n/a";
+        out << std::setprecision(4);
+        printPerRow(out, stage, PerfEvent::BRANCH_MISSES, 14);
+        printPerRow(out, stage, PerfEvent::CACHE_MISSES, 12);
+        printPerRow(out, stage, PerfEvent::PAGE_FAULTS, 13);
+        out << std::endl;
+    }
+    out.flags(flags);
+    out.precision(precision);
+    out << std::string(87, '-') << std::endl;
+}
+
+PerfStage::PerfStage(PerfCounters& counters, std::string name, size_t rows)
+    : counters(counters), name(std::move(name)), rows(rows) {
+    if (counters.isOpen()) begin = counters.read();
+}
+
+PerfStage::~PerfStage() {
+    if (counters.isOpen()) counters.addStage(name, rows, begin, counters.read());
+}
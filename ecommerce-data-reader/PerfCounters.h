@@ -0,0 +1,89 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Hardware and kernel counters for the profiling mode, read through Linux perf_event_open.
+// Elsewhere open() fails and the driver carries on without them.
+
+enum class PerfEvent {
+    CYCLES,
+    INSTRUCTIONS,
+    BRANCH_MISSES,
+    // Last-level cache misses.
+    CACHE_MISSES,
+    PAGE_FAULTS
+};
+
+constexpr size_t PERF_EVENT_COUNT = 5;
+
+struct PerfReading {
+    // Scaled up when the kernel had to multiplex the counters.
+    std::array<double, PERF_EVENT_COUNT> values{};
+    std::array<bool, PERF_EVENT_COUNT> available{};
+    std::chrono::steady_clock::time_point time;
+
+    double get(PerfEvent event) const { return values[static_cast<size_t>(event)]; }
+    bool has(PerfEvent event) const { return available[static_cast<size_t>(event)]; }
+};
+
+struct PerfStageReport {
+    std::string name;
+    size_t rows = 0;
+    double seconds = 0.0;
+    // Counts during the stage.
+    PerfReading counts;
+
+    // Instructions per cycle; 0 when either counter is missing.
+    double ipc() const;
+    // Count per row; 0 without rows or without the counter.
+    double perRow(PerfEvent event) const;
+};
+
+class PerfCounters {
+public:
+    PerfCounters() = default;
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // Starts counting this process in user space. Threads it starts afterwards, such as the
+    // scheduler workers, are included, so open it before any parallel work. Returns false
+    // with a reason if no counter could be opened. Counters the CPU or the virtual machine
+    // lacks are left out; error then lists them and the table shows n/a.
+    bool open(std::string& error);
+    bool isOpen() const;
+    // Totals since open().
+    PerfReading read() const;
+
+    void addStage(const std::string& name, size_t rows, const PerfReading& begin, const PerfReading& end);
+    const std::vector<PerfStageReport>& getStages() const;
+    // A table of seconds, rows, IPC and misses per row for each stage.
+    void printStages(std::ostream& out) const;
+
+private:
+    std::array<int, PERF_EVENT_COUNT> descriptors{ -1, -1, -1, -1, -1 };
+    std::vector<PerfStageReport> stages;
+};
+
+// Records the counters between construction and destruction as one stage. Does nothing
+// when the counters are not open.
+class PerfStage {
+public:
+    PerfStage(PerfCounters& counters, std::string name, size_t rows = 0);
+    ~PerfStage();
+    PerfStage(const PerfStage&) = delete;
+    PerfStage& operator=(const PerfStage&) = delete;
+
+    // For stages whose row count is only known at the end, such as parsing.
+    void setRows(size_t rows) { this->rows = rows; }
+
+private:
+    PerfCounters& counters;
+    std::string name;
+    size_t rows;
+    PerfReading begin;
+};
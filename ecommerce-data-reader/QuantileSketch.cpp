@@ -0,0 +1,199 @@
+#include "QuantileSketch.h"
+#include "BinaryIO.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    constexpr size_t MIN_LEVEL_CAPACITY = 2;
+    constexpr double LEVEL_DECAY = 2.0 / 3.0;
+    const char QUANTILE_SKETCH_TAG[5] = "KLLS";
+    constexpr uint32_t QUANTILE_SKETCH_VERSION = 1;
+    // Far more levels than 2^64 items could ever need; guards against corrupt input.
+    constexpr uint32_t MAX_LEVELS = 64;
+
+    std::atomic<uint64_t> nextInstanceSeed{ 0 };
+
+    // SplitMix64 finalizer; the result is never zero, which the xorshift state requires.
+    uint64_t mixSeed(uint64_t seed) {
+        uint64_t z = seed + 0x9e3779b97f4a7c15ull;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        z ^= z >> 31;
+        return z == 0 ? 0x9e3779b97f4a7c15ull : z;
+    }
+}
+
+QuantileSketch::QuantileSketch(uint16_t k)
+    : QuantileSketch(k, nextInstanceSeed.fetch_add(1, std::memory_order_relaxed)) {
+}
+
+QuantileSketch::QuantileSketch(uint16_t k, uint64_t seed)
+    : k(k),
+    minSeen(std::numeric_limits<double>::infinity()),
+    maxSeen(-std::numeric_limits<double>::infinity()),
+    randomState(mixSeed(seed)),
+    levels(1) {
+    if (k < 8) {
+        throw std::invalid_argument("QuantileSketch k must be at least 8");
+    }
+    capacity = totalCapacity();
+    levels[0].reserve(capacity);
+}
+
+size_t QuantileSketch::levelCapacity(size_t level) const {
+    // The top level gets k items and each level below it two thirds of the one above.
+    const size_t depth = levels.size() - 1 - level;
+    const double capacity = std::ceil(k * std::pow(LEVEL_DECAY, static_cast<double>(depth)));
+    return std::max(MIN_LEVEL_CAPACITY, static_cast<size_t>(capacity));
+}
+
+size_t QuantileSketch::totalCapacity() const {
+    size_t total = 0;
+    for (size_t level = 0; level < levels.size(); ++level) {
+        total += levelCapacity(level);
+    }
+    return total;
+}
+
+bool QuantileSketch::nextRandomBit() {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return (randomState & 1) != 0;
+}
+
+void QuantileSketch::add(double value) {
+    if (std::isnan(value)) return;
+    itemCount++;
+    minSeen = std::min(minSeen, value);
+    maxSeen = std::max(maxSeen, value);
+    levels[0].push_back(value);
+    retained++;
+    if (retained >= capacity) {
+        compress();
+    }
+}
+
+void QuantileSketch::compactLevel(size_t level) {
+    if (level + 1 == levels.size()) {
+        levels.emplace_back();
+        capacity = totalCapacity();
+    }
+    auto& items = levels[level];
+    std::sort(items.begin(), items.end());
+
+    // An odd item out stays behind so the promoted weight is exactly preserved.
+    double leftover = 0.0;
+    const bool hasLeftover = items.size() % 2 == 1;
+    if (hasLeftover) {
+        leftover = items.back();
+        items.pop_back();
+    }
+
+    auto& above = levels[level + 1];
+    for (size_t i = nextRandomBit() ? 1 : 0; i < items.size(); i += 2) {
+        above.push_back(items[i]);
+    }
+    retained -= items.size() / 2;
+    items.clear();
+    if (hasLeftover) {
+        items.push_back(leftover);
+    }
+}
+
+void QuantileSketch::compress() {
+    while (retained >= capacity) {
+        size_t level = 0;
+        while (level + 1 < levels.size() && levels[level].size() < levelCapacity(level)) {
+            level++;
+        }
+        compactLevel(level);
+    }
+}
+
+void QuantileSketch::merge(const QuantileSketch& other) {
+    if (other.itemCount == 0) return;
+    while (levels.size() < other.levels.size()) {
+        levels.emplace_back();
+    }
+    for (size_t level = 0; level < other.levels.size(); ++level) {
+        levels[level].insert(levels[level].end(), other.levels[level].begin(), other.levels[level].end());
+    }
+    retained += other.retained;
+    capacity = totalCapacity();
+    itemCount += other.itemCount;
+    minSeen = std::min(minSeen, other.minSeen);
+    maxSeen = std::max(maxSeen, other.maxSeen);
+    // Copies of one sketch share a seed; mixing keeps their merged compactions independent.
+    randomState = mixSeed(randomState ^ (other.randomState << 1));
+    compress();
+}
+
+double QuantileSketch::quantile(double rank) const {
+    if (itemCount == 0) return std::numeric_limits<double>::quiet_NaN();
+    if (rank <= 0.0) return minSeen;
+    if (rank >= 1.0) return maxSeen;
+
+    std::vector<std::pair<double, uint64_t>> weighted;
+    weighted.reserve(retained);
+    uint64_t totalWeight = 0;
+    for (size_t level = 0; level < levels.size(); ++level) {
+        const uint64_t weight = uint64_t{ 1 } << level;
+        for (double value : levels[level]) {
+            weighted.emplace_back(value, weight);
+            totalWeight += weight;
+        }
+    }
+    std::sort(weighted.begin(), weighted.end());
+
+    const double target = rank * static_cast<double>(totalWeight);
+    uint64_t cumulative = 0;
+    for (const auto& item : weighted) {
+        cumulative += item.second;
+        if (static_cast<double>(cumulative) >= target) {
+            return item.first;
+        }
+    }
+    return maxSeen;
+}
+
+void QuantileSketch::save(std::ostream& out) const {
+    writeHeader(out, QUANTILE_SKETCH_TAG, QUANTILE_SKETCH_VERSION);
+    writeValue(out, k);
+    writeValue(out, itemCount);
+    writeValue(out, minSeen);
+    writeValue(out, maxSeen);
+    writeValue(out, randomState);
+    writeValue(out, static_cast<uint32_t>(levels.size()));
+    for (const auto& level : levels) {
+        writeVector(out, level);
+    }
+}
+
+bool QuantileSketch::load(std::istream& in) {
+    QuantileSketch stored(8, 0);
+    uint32_t levelCount = 0;
+    if (!readHeader(in, QUANTILE_SKETCH_TAG, QUANTILE_SKETCH_VERSION) ||
+        !readValue(in, stored.k) || stored.k < 8 ||
+        !readValue(in, stored.itemCount) ||
+        !readValue(in, stored.minSeen) ||
+        !readValue(in, stored.maxSeen) ||
+        !readValue(in, stored.randomState) ||
+        !readValue(in, levelCount) || levelCount == 0 || levelCount > MAX_LEVELS) {
+        return false;
+    }
+    stored.levels.assign(levelCount, {});
+    stored.retained = 0;
+    for (auto& level : stored.levels) {
+        if (!readVector(in, level)) return false;
+        stored.retained += level.size();
+    }
+    stored.capacity = stored.totalCapacity();
+    *this = std::move(stored);
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// KLL streaming quantile sketch (Karnin, Lang, Liberty 2016).
+//
+// Values are kept in a stack of compactors; level i holds items of weight 2^i. Once the
+// sketch holds more items than its total capacity, the lowest full level is sorted and
+// every other item, starting at a random offset, is promoted to the next level. Retained
+// items stay below roughly 3k + 2 * levels, so memory is bounded by k regardless of the
+// stream length.
+//
+// Error guarantee: a quantile returned for rank r has a true rank within r +/- epsilon
+// with 99% probability, where epsilon is about 1.65% for the default k = 200 and shrinks
+// roughly as 1/k (0.65% at k = 500, 0.33% at k = 1000). The bound holds for merged
+// sketches too, so per-thread and per-file sketches can be combined freely.
+class QuantileSketch {
+public:
+    // Each sketch draws its own seed for the compaction coin flips, so sketches fed
+    // similar streams, such as per-thread partials, do not make correlated choices.
+    explicit QuantileSketch(uint16_t k = 200);
+    // A fixed seed, for reproducible results.
+    QuantileSketch(uint16_t k, uint64_t seed);
+
+    void add(double value);
+    void merge(const QuantileSketch& other);
+
+    void save(std::ostream& out) const;
+    // Replaces this sketch with a saved one, including its k.
+    bool load(std::istream& in);
+
+    // Returns an approximate value at normalized rank [0, 1]; NaN for an empty sketch.
+    double quantile(double rank) const;
+
+    uint64_t count() const { return itemCount; }
+    double minValue() const { return minSeen; }
+    double maxValue() const { return maxSeen; }
+    size_t retainedItems() const { return retained; }
+
+private:
+    size_t levelCapacity(size_t level) const;
+    size_t totalCapacity() const;
+    void compress();
+    void compactLevel(size_t level);
+    bool nextRandomBit();
+
+    uint16_t k;
+    uint64_t itemCount = 0;
+    double minSeen;
+    double maxSeen;
+    uint64_t randomState;
+    size_t retained = 0;
+    size_t capacity;
+    std::vector<std::vector<double>> levels;
+};
@@ -0,0 +1,508 @@
+#include "QueryServer.h"
+#include "GroupBy.h"
+#include "JsonReport.h"
+#include "JsonWriter.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#if defined(_WIN32)
+    using SocketHandle = SOCKET;
+    const SocketHandle INVALID_SOCKET_HANDLE = INVALID_SOCKET;
+    const int SEND_FLAGS = 0;
+
+    void closeSocket(SocketHandle socket) { closesocket(socket); }
+
+    struct SocketLibrary {
+        bool ready;
+        SocketLibrary() {
+            WSADATA data;
+            ready = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }
+        ~SocketLibrary() {
+            if (ready) WSACleanup();
+        }
+    };
+
+    int pollSockets(pollfd* sockets, size_t count, int timeoutMs) {
+        return WSAPoll(sockets, static_cast<ULONG>(count), timeoutMs);
+    }
+#else
+    using SocketHandle = int;
+    const SocketHandle INVALID_SOCKET_HANDLE = -1;
+    // A client that hangs up early must not kill the process with SIGPIPE.
+#if defined(MSG_NOSIGNAL)
+    const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    const int SEND_FLAGS = 0;
+#endif
+
+    void closeSocket(SocketHandle socket) { close(socket); }
+
+    struct SocketLibrary {
+        bool ready = true;
+    };
+
+    int pollSockets(pollfd* sockets, size_t count, int timeoutMs) {
+        return poll(sockets, static_cast<nfds_t>(count), timeoutMs);
+    }
+#endif
+
+    constexpr size_t MAX_REQUEST_BYTES = 8192;
+    // A client gets this long in total to send its request head, however it paces it.
+    constexpr int REQUEST_DEADLINE_MS = 5000;
+    // Connections whose heads are still arriving; beyond this the server stops accepting.
+    constexpr size_t MAX_PENDING_CONNECTIONS = 256;
+    // accept() failures such as running out of descriptors back off up to this long.
+    constexpr int MAX_ACCEPT_BACKOFF_MS = 1000;
+    constexpr size_t MAX_RESULT_ROWS = 10000;
+
+    using QueryParams = std::unordered_map<std::string, std::string>;
+
+    std::string percentDecode(std::string_view text) {
+        std::string decoded;
+        decoded.reserve(text.size());
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (text[i] == '+') {
+                decoded += ' ';
+            }
+            else if (text[i] == '%') {
+                unsigned value = 0;
+                const char* digits = text.data() + i + 1;
+                if (i + 2 >= text.size() || std::from_chars(digits, digits + 2, value, 16).ptr != digits + 2) {
+                    throw std::invalid_argument("Bad percent escape in query");
+                }
+                decoded += static_cast<char>(value);
+                i += 2;
+            }
+            else {
+                decoded += text[i];
+            }
+        }
+        return decoded;
+    }
+
+    std::string_view splitTarget(std::string_view target, QueryParams& params) {
+        const size_t question = target.find('?');
+        const std::string_view path = target.substr(0, question);
+        std::string_view query = question == std::string_view::npos ? std::string_view() : target.substr(question + 1);
+        while (!query.empty()) {
+            const size_t amp = query.find('&');
+            const std::string_view pair = query.substr(0, amp);
+            query.remove_prefix(amp == std::string_view::npos ? query.size() : amp + 1);
+            if (pair.empty()) continue;
+            const size_t equals = pair.find('=');
+            params[percentDecode(pair.substr(0, equals))] =
+                equals == std::string_view::npos ? std::string() : percentDecode(pair.substr(equals + 1));
+        }
+        return path;
+    }
+
+    const std::string* findParam(const QueryParams& params, const char* name) {
+        auto it = params.find(name);
+        return it == params.end() ? nullptr : &it->second;
+    }
+
+    template<typename T>
+    T parseNumber(const std::string& text, const char* name) {
+        T value{};
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (text.empty() || result.ec != std::errc() || result.ptr != text.data() + text.size()) {
+            throw std::invalid_argument(std::string("Invalid value for '") + name + "'");
+        }
+        return value;
+    }
+
+    template<typename T>
+    T numberParam(const QueryParams& params, const char* name, T defaultValue) {
+        const std::string* text = findParam(params, name);
+        return text == nullptr ? defaultValue : parseNumber<T>(*text, name);
+    }
+
+    // Epoch seconds, or YYYY-MM-DD with an optional THH:MM[:SS] (a space works as well).
+    // endOfDay moves a bare date to its last second, so "to=2019-11-05" includes that day.
+    int64_t parseTime(const std::string& text, const char* name, bool endOfDay) {
+        if (text.find('-', 1) == std::string::npos) return parseNumber<int64_t>(text, name);
+
+        PurchaseTime time = { 0, 0, 0, 0, 0, 0 };
+        const char* end = text.data() + text.size();
+        int* const fields[] = { &time.year, &time.month, &time.day, &time.hour, &time.minute, &time.second };
+        const char separators[] = { '-', '-', 'T', ':', ':' };
+        const char* cursor = text.data();
+        size_t fieldCount = 0;
+        while (fieldCount < 6) {
+            auto result = std::from_chars(cursor, end, *fields[fieldCount]);
+            if (result.ec != std::errc()) throw std::invalid_argument(std::string("Invalid time for '") + name + "'");
+            cursor = result.ptr;
+            fieldCount++;
+            if (cursor == end || fieldCount == 6) break;
+            const char expected = separators[fieldCount - 1];
+            if (*cursor != expected && !(expected == 'T' && *cursor == ' ')) {
+                throw std::invalid_argument(std::string("Invalid time for '") + name + "'");
+            }
+            cursor++;
+        }
+        if (cursor != end || fieldCount < 3 || fieldCount == 4 || time.month < 1 || time.month > 12 || time.day < 1 || time.day > 31) {
+            throw std::invalid_argument(std::string("Invalid time for '") + name + "'");
+        }
+        const int64_t seconds = toEpochSeconds(time);
+        return fieldCount == 3 && endOfDay ? seconds + 24 * 60 * 60 - 1 : seconds;
+    }
+
+    // Returns true if the query restricts the time range.
+    bool readTimeRange(const QueryParams& params, RangePredicate& predicate) {
+        const std::string* from = findParam(params, "from");
+        const std::string* to = findParam(params, "to");
+        if (from != nullptr) predicate.minTime = parseTime(*from, "from", false);
+        if (to != nullptr) predicate.maxTime = parseTime(*to, "to", true);
+        return from != nullptr || to != nullptr;
+    }
+
+    std::vector<uint32_t> selectRows(const std::vector<ECommerceEvent>& events, const ZoneMap& zones, const RangePredicate& predicate) {
+        std::vector<uint32_t> rows;
+        for (size_t block : zones.candidateBlocks(predicate)) {
+            const size_t begin = block * zones.getBlockRows();
+            const size_t end = std::min(events.size(), begin + zones.getBlockRows());
+            const bool all = predicate.coversAll(zones.zone(block));
+            for (size_t row = begin; row < end; ++row) {
+                if (all || predicate.matches(events[row])) rows.push_back(static_cast<uint32_t>(row));
+            }
+        }
+        return rows;
+    }
+
+    template<typename Key>
+    void writeGroups(JsonWriter& json, const std::vector<ECommerceEvent>& events, const std::vector<uint32_t>* rows, Key key, size_t limit) {
+        using Engine = GroupBy<Key, Count, CountIf<EventType::VIEW>, CountIf<EventType::CART>, CountIf<EventType::PURCHASE>,
+            SumIf<EventType::PURCHASE, Price>>;
+        const auto results = (rows == nullptr ? Engine::run(events, key) : Engine::runSelected(events, RowRange(*rows), key)).results();
+
+        std::vector<std::pair<typename Engine::KeyType, typename Engine::Result>> groups(results.begin(), results.end());
+        std::sort(groups.begin(), groups.end(), [](const auto& a, const auto& b) {
+            if (std::get<4>(a.second) != std::get<4>(b.second)) return std::get<4>(a.second) > std::get<4>(b.second);
+            return std::get<0>(a.second) > std::get<0>(b.second);
+            });
+
+        json.field("groupCount", groups.size());
+        json.key("groups").beginArray();
+        for (size_t i = 0; i < std::min(limit, groups.size()); ++i) {
+            const auto& result = groups[i].second;
+            json.beginObject();
+            json.field("key", groups[i].first)
+                .field("events", std::get<0>(result))
+                .field("views", std::get<1>(result))
+                .field("carts", std::get<2>(result))
+                .field("purchases", std::get<3>(result))
+                .field("revenue", std::get<4>(result));
+            json.endObject();
+        }
+        json.endArray();
+    }
+
+    void writeDrillDown(JsonWriter& json, const std::vector<ECommerceEvent>& events, RowRange rows) {
+        Analyzer analyzer;
+        int64_t firstTime = 0;
+        int64_t lastTime = 0;
+        for (const uint32_t* row = rows.first; row != rows.last; ++row) {
+            const int64_t time = events[*row].timestamp;
+            if (row == rows.first || time < firstTime) firstTime = time;
+            if (row == rows.first || time > lastTime) lastTime = time;
+        }
+        json.field("rows", rows.size());
+        if (rows.size() == 0) {
+            json.key("firstTime").null().key("lastTime").null();
+        }
+        else {
+            json.field("firstTime", firstTime).field("lastTime", lastTime);
+        }
+        json.key("summary");
+        writeJson(json, analyzer.getSummary(events, rows));
+    }
+
+    const char* statusText(int status) {
+        switch (status) {
+        case 200: return "OK";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 431: return "Request Header Fields Too Large";
+        default: return "Internal Server Error";
+        }
+    }
+
+    std::string errorBody(const std::string& message) {
+        std::ostringstream body;
+        JsonWriter json(body, false);
+        json.beginObject().field("error", message).endObject();
+        return body.str();
+    }
+
+    // Returns the target of a complete request head, or a non-200 status.
+    int parseRequestHead(const std::string& request, std::string& target) {
+        const size_t lineEnd = request.find("\r\n");
+        const std::string_view line = std::string_view(request).substr(0, lineEnd);
+        const size_t methodEnd = line.find(' ');
+        const size_t targetEnd = line.find(' ', methodEnd == std::string_view::npos ? line.size() : methodEnd + 1);
+        if (methodEnd == std::string_view::npos || targetEnd == std::string_view::npos) return 400;
+        if (line.substr(0, methodEnd) != "GET") return 405;
+        target = std::string(line.substr(methodEnd + 1, targetEnd - methodEnd - 1));
+        return 200;
+    }
+
+    // A connection whose request head is still arriving.
+    struct PendingRequest {
+        SocketHandle client;
+        std::chrono::steady_clock::time_point deadline;
+        std::string head;
+    };
+
+    void sendResponse(SocketHandle client, int status, const std::string& body) {
+        std::ostringstream head;
+        head << "HTTP/1.1 " << status << " " << statusText(status) << "\r\n"
+            << "Content-Type: application/json\r\n"
+            << "Content-Length: " << body.size() << "\r\n"
+            << "Connection: close\r\n\r\n";
+        const std::string response = head.str() + body;
+        size_t sent = 0;
+        while (sent < response.size()) {
+            const int result = static_cast<int>(send(client, response.data() + sent, static_cast<int>(response.size() - sent), SEND_FLAGS));
+            if (result <= 0) break;
+            sent += static_cast<size_t>(result);
+        }
+    }
+
+}
+
+QueryServer::QueryServer(const std::vector<ECommerceEvent>& events, const EventColumns& columns)
+    : events(events), columns(columns) {
+    index.build(events);
+    zones.build(events);
+    Analyzer analyzer;
+    productStats = analyzer.getProductStats(events);
+}
+
+int QueryServer::handle(std::string_view target, std::string& body) const {
+    std::ostringstream out;
+    JsonWriter json(out, false);
+    try {
+        QueryParams params;
+        const std::string_view path = splitTarget(target, params);
+        Analyzer analyzer;
+        RangePredicate predicate;
+
+        if (path == "/health") {
+            json.beginObject().field("status", "ok").field("rows", events.size()).endObject();
+        }
+        else if (path == "/summary") {
+            const bool ranged = readTimeRange(params, predicate);
+            json.beginObject();
+            if (ranged) json.field("from", predicate.minTime).field("to", predicate.maxTime);
+            json.key("summary");
+            writeJson(json, ranged ? analyzer.getSummary(events, zones, predicate) : analyzer.getSummary(columns));
+            json.endObject();
+        }
+        else if (path == "/top-products") {
+            TopKOptions options;
+            options.k = std::min(numberParam<size_t>(params, "k", options.k), MAX_RESULT_ROWS);
+            options.viewThreshold = numberParam<size_t>(params, "minViews", options.viewThreshold);
+            options.purchaseThreshold = numberParam<size_t>(params, "minPurchases", options.purchaseThreshold);
+            if (const std::string* metric = findParam(params, "metric")) {
+                if (*metric == "conversion") options.metric = RankMetric::CONVERSION_RATE;
+                else if (*metric == "purchases") options.metric = RankMetric::PURCHASES;
+                else if (*metric == "revenue") options.metric = RankMetric::REVENUE;
+                else throw std::invalid_argument("Unknown metric '" + *metric + "'; expected conversion, purchases or revenue");
+            }
+            json.beginObject().key("products");
+            writeJson(json, analyzer.getTopProducts(productStats, options));
+            json.endObject();
+        }
+        else if (path == "/group-by") {
+            const std::string* key = findParam(params, "key");
+            if (key == nullptr) throw std::invalid_argument("Missing 'key'");
+            const size_t limit = std::min(numberParam<size_t>(params, "limit", 20), MAX_RESULT_ROWS);
+            std::vector<uint32_t> rows;
+            const bool ranged = readTimeRange(params, predicate);
+            if (ranged) rows = selectRows(events, zones, predicate);
+            const std::vector<uint32_t>* selection = ranged ? &rows : nullptr;
+
+            json.beginObject().field("key", *key);
+            if (*key == "category") writeGroups(json, events, selection, TopCategoryKey(), limit);
+            else if (*key == "brand") writeGroups(json, events, selection, BrandKey(), limit);
+            else if (*key == "product") writeGroups(json, events, selection, ProductKey(), limit);
+            else if (*key == "hour") writeGroups(json, events, selection, TimeBucketKey{ 60 * 60 }, limit);
+            else if (*key == "day") writeGroups(json, events, selection, TimeBucketKey{ 24 * 60 * 60 }, limit);
+            else throw std::invalid_argument("Unknown key '" + *key + "'; expected category, brand, product, hour or day");
+            json.endObject();
+        }
+        else if (path == "/product" || path == "/user") {
+            const std::string* id = findParam(params, "id");
+            if (id == nullptr) throw std::invalid_argument("Missing 'id'");
+            const uint64_t key = parseNumber<uint64_t>(*id, "id");
+            json.beginObject().field(path == "/product" ? "prodId" : "userId", key);
+            writeDrillDown(json, events, path == "/product" ? index.rowsForProduct(key) : index.rowsForUser(key));
+            json.endObject();
+        }
+        else {
+            body = errorBody("Unknown query '" + std::string(path) + "'");
+            return 404;
+        }
+    }
+    catch (const std::invalid_argument& e) {
+        body = errorBody(e.what());
+        return 400;
+    }
+    catch (const std::exception& e) {
+        body = errorBody(e.what());
+        return 500;
+    }
+    body = out.str();
+    return 200;
+}
+
+bool QueryServer::serve(uint16_t port, std::ostream& log) {
+    SocketLibrary library;
+    SocketHandle listener = library.ready ? socket(AF_INET, SOCK_STREAM, IPPROTO_TCP) : INVALID_SOCKET_HANDLE;
+    if (listener == INVALID_SOCKET_HANDLE) {
+        std::cerr << "Query server error: could not create a socket." << std::endl;
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "Query server error: could not listen on 127.0.0.1:" << port << "." << std::endl;
+        closeSocket(listener);
+        return false;
+    }
+    log << "Serving " << events.size() << " events on http://127.0.0.1:" << port << "/ (GET /shutdown to stop)" << std::endl;
+
+    // This thread accepts connections and reads their request heads, polling all of them
+    // at once, so a slow client only waits out its own deadline. Only complete queries
+    // reach the scheduler, as tasks that answer them; without a worker to run the tasks
+    // they are answered inline.
+    std::mutex logMutex;
+    TaskGroup requests;
+    const bool runInline = getThreadCount() < 2;
+
+    auto respond = [this, &log, &logMutex](SocketHandle client, const std::string& target) {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::string body;
+        const int status = handle(target, body);
+        sendResponse(client, status, body);
+        closeSocket(client);
+        std::chrono::duration<double, std::milli> duration = std::chrono::high_resolution_clock::now() - start;
+
+        std::lock_guard<std::mutex> lock(logMutex);
+        log << "GET " << target << " -> " << status << " (" << std::fixed << std::setprecision(3) << duration.count() << " ms)" << std::endl;
+    };
+    auto reject = [](SocketHandle client, int status) {
+        sendResponse(client, status, errorBody(statusText(status)));
+        closeSocket(client);
+    };
+
+    std::vector<PendingRequest> pending;
+    std::vector<pollfd> sockets;
+    int acceptBackoffMs = 0;
+    bool running = true;
+    while (running) {
+        const auto now = std::chrono::steady_clock::now();
+        int timeoutMs = -1;
+        for (const auto& request : pending) {
+            const int left = static_cast<int>(std::max<int64_t>(0,
+                std::chrono::duration_cast<std::chrono::milliseconds>(request.deadline - now).count()));
+            if (timeoutMs < 0 || left < timeoutMs) timeoutMs = left;
+        }
+        const bool accepting = pending.size() < MAX_PENDING_CONNECTIONS;
+        sockets.clear();
+        for (const auto& request : pending) sockets.push_back({ request.client, POLLIN, 0 });
+        if (accepting) sockets.push_back({ listener, POLLIN, 0 });
+        if (pollSockets(sockets.data(), sockets.size(), timeoutMs) < 0) continue;
+
+        // Heads that arrived, failed or ran out of time leave the pending list.
+        const auto polled = std::chrono::steady_clock::now();
+        for (size_t i = pending.size(); i-- > 0;) {
+            PendingRequest& request = pending[i];
+            int status = 0;
+            if (sockets[i].revents != 0) {
+                char buffer[2048];
+                const int received = static_cast<int>(recv(request.client, buffer, sizeof(buffer), 0));
+                if (received <= 0) status = 400;
+                else request.head.append(buffer, static_cast<size_t>(received));
+                if (status == 0 && request.head.find("\r\n\r\n") != std::string::npos) status = 200;
+                else if (status == 0 && request.head.size() > MAX_REQUEST_BYTES) status = 431;
+            }
+            if (status == 0 && polled >= request.deadline) status = 408;
+            if (status == 0) continue;
+
+            std::string target;
+            if (status == 200) status = parseRequestHead(request.head, target);
+            const SocketHandle client = request.client;
+            pending[i] = std::move(pending.back());
+            pending.pop_back();
+            if (status != 200) {
+                reject(client, status);
+            }
+            else if (target == "/shutdown") {
+                sendResponse(client, 200, "{\"status\":\"stopping\"}");
+                closeSocket(client);
+                running = false;
+            }
+            else if (runInline) {
+                respond(client, target);
+            }
+            else {
+                requests.spawn([&respond, client, target]() { respond(client, target); });
+            }
+        }
+
+        if (!running || !accepting || sockets.back().revents == 0) continue;
+        SocketHandle client = accept(listener, nullptr, nullptr);
+        if (client == INVALID_SOCKET_HANDLE) {
+            // Persistent failures such as running out of descriptors would otherwise spin.
+            if (acceptBackoffMs == 0) std::cerr << "Query server error: accept failed; backing off." << std::endl;
+            acceptBackoffMs = std::min(MAX_ACCEPT_BACKOFF_MS, std::max(10, acceptBackoffMs * 2));
+            std::this_thread::sleep_for(std::chrono::milliseconds(acceptBackoffMs));
+            continue;
+        }
+        acceptBackoffMs = 0;
+        pending.push_back({ client, polled + std::chrono::milliseconds(REQUEST_DEADLINE_MS), std::string() });
+    }
+    for (const auto& request : pending) {
+        closeSocket(request.client);
+    }
+    requests.wait();
+    closeSocket(listener);
+    log << "Query server stopped." << std::endl;
+    return true;
+}
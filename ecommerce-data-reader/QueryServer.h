@@ -0,0 +1,52 @@
+#pragma once
+#include "Analyzer.h"
+#include "DataStructure.h"
+#include "EventIndex.h"
+#include "ZoneMap.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Keeps a parsed event store resident and answers read-only queries over localhost HTTP,
+// so each question costs one query instead of a process start and a full re-parse.
+//
+// Every endpoint is a GET returning a JSON object; errors return {"error": "..."} with a
+// 4xx status. Time bounds (from, to) are inclusive and accept epoch seconds or
+// YYYY-MM-DD[THH:MM:SS] in UTC.
+//
+//   /health                                  row count
+//   /summary[?from=&to=]                     event counts and revenue
+//   /top-products[?k=&metric=&minViews=&minPurchases=]
+//                                            metric: conversion, purchases or revenue
+//   /group-by?key=[&from=&to=&limit=]        key: category, brand, product, hour or day;
+//                                            groups ordered by revenue
+//   /product?id=   /user?id=                 drill-down through the row index
+//   /shutdown                                stops serve() after in-flight queries
+//
+// The serving thread accepts connections and reads request heads itself, polling them
+// with one deadline each, so slow or idle clients never occupy a worker. Each complete
+// query is answered by a task on the shared scheduler, so concurrent requests and the
+// parallel analyses inside them share its threads.
+class QueryServer {
+public:
+    // Builds the indexes once. The events, and the parser whose mappings they view, must
+    // outlive the server.
+    QueryServer(const std::vector<ECommerceEvent>& events, const EventColumns& columns);
+
+    // Answers one request target such as "/summary?from=2019-11-01"; returns the HTTP
+    // status and sets body to the JSON response.
+    int handle(std::string_view target, std::string& body) const;
+
+    // Serves 127.0.0.1:port until /shutdown. Returns false if the socket cannot be opened.
+    bool serve(uint16_t port, std::ostream& log);
+
+private:
+    const std::vector<ECommerceEvent>& events;
+    const EventColumns& columns;
+    EventIndex index;
+    ZoneMap zones;
+    ProductStatsMap productStats;
+};
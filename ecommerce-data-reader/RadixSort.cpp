@@ -0,0 +1,205 @@
+#include "RadixSort.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+    constexpr size_t RADIX_BITS = 11;
+    constexpr size_t RADIX = size_t{ 1 } << RADIX_BITS;
+    constexpr size_t DIGIT_COUNT = (64 + RADIX_BITS - 1) / RADIX_BITS;
+
+    using Histogram = std::array<size_t, RADIX>;
+
+    inline size_t digitOf(uint64_t key, size_t digit) {
+        return static_cast<size_t>((key >> (digit * RADIX_BITS)) & (RADIX - 1));
+    }
+
+    int bitWidth(uint64_t value) {
+        int width = 0;
+        while (value != 0) {
+            value >>= 1;
+            width++;
+        }
+        return width;
+    }
+
+    void checkRowCount(size_t rowCount) {
+        if (rowCount > std::numeric_limits<uint32_t>::max()) {
+            throw std::length_error("Radix sort supports at most 2^32 - 1 rows");
+        }
+    }
+
+    std::vector<uint32_t> rowsOf(const std::vector<SortEntry>& entries) {
+        std::vector<uint32_t> rows(entries.size());
+        parallelChunks(entries.size(), getThreadCount(), [&](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                rows[i] = entries[i].row;
+            }
+            });
+        return rows;
+    }
+
+    // Sorts the rows rowAt(0) .. rowAt(count - 1) of events.
+    template<typename RowAt>
+    std::vector<uint32_t> sortRowsByUserAndTime(const std::vector<ECommerceEvent>& events, size_t count, RowAt rowAt) {
+        if (count == 0) return {};
+        const size_t chunkCount = getThreadCount();
+
+        struct Range {
+            uint64_t minUser = std::numeric_limits<uint64_t>::max();
+            uint64_t maxUser = 0;
+            int64_t minTime = std::numeric_limits<int64_t>::max();
+            int64_t maxTime = std::numeric_limits<int64_t>::min();
+        };
+        std::vector<Range> ranges(chunkCount);
+        parallelChunks(count, chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+            Range range;
+            for (size_t i = begin; i < end; ++i) {
+                const ECommerceEvent& event = events[rowAt(i)];
+                range.minUser = std::min(range.minUser, event.userId);
+                range.maxUser = std::max(range.maxUser, event.userId);
+                range.minTime = std::min(range.minTime, event.timestamp);
+                range.maxTime = std::max(range.maxTime, event.timestamp);
+            }
+            ranges[chunk] = range;
+            });
+
+        Range total;
+        for (const auto& range : ranges) {
+            total.minUser = std::min(total.minUser, range.minUser);
+            total.maxUser = std::max(total.maxUser, range.maxUser);
+            total.minTime = std::min(total.minTime, range.minTime);
+            total.maxTime = std::max(total.maxTime, range.maxTime);
+        }
+
+        const int userBits = bitWidth(total.maxUser - total.minUser);
+        const int timeBits = bitWidth(static_cast<uint64_t>(total.maxTime - total.minTime));
+
+        checkRowCount(count);
+        std::vector<SortEntry> entries(count);
+        auto fillEntries = [&](auto keyOf) {
+            parallelChunks(count, chunkCount, [&](size_t, size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    const uint32_t row = rowAt(i);
+                    entries[i] = { keyOf(events[row]), row };
+                }
+                });
+        };
+
+        if (userBits + timeBits <= 64) {
+            fillEntries([&](const ECommerceEvent& event) {
+                const uint64_t user = event.userId - total.minUser;
+                const uint64_t time = static_cast<uint64_t>(event.timestamp - total.minTime);
+                return timeBits == 64 ? time : (user << timeBits) | time;
+                });
+            radixSort(entries);
+            return rowsOf(entries);
+        }
+
+        fillEntries([&](const ECommerceEvent& event) {
+            return static_cast<uint64_t>(event.timestamp - total.minTime);
+            });
+        radixSort(entries);
+
+        parallelChunks(count, chunkCount, [&](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                entries[i].key = events[entries[i].row].userId - total.minUser;
+            }
+            });
+        radixSort(entries);
+        return rowsOf(entries);
+    }
+
+}
+
+void radixSort(std::vector<SortEntry>& entries) {
+    const size_t count = entries.size();
+    if (count < 2) return;
+    const size_t chunkCount = getThreadCount();
+
+    // One read pass builds the global histogram of every digit, which tells us which
+    // passes would leave the order unchanged.
+    std::vector<std::array<Histogram, DIGIT_COUNT>> digitCounts(chunkCount);
+    parallelChunks(count, chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+        auto& local = digitCounts[chunk];
+        for (auto& histogram : local) histogram.fill(0);
+        for (size_t i = begin; i < end; ++i) {
+            const uint64_t key = entries[i].key;
+            for (size_t digit = 0; digit < DIGIT_COUNT; ++digit) {
+                local[digit][digitOf(key, digit)]++;
+            }
+        }
+        });
+
+    std::vector<SortEntry> buffer(count);
+    std::vector<SortEntry>* source = &entries;
+    std::vector<SortEntry>* target = &buffer;
+    std::vector<Histogram> offsets(chunkCount);
+
+    for (size_t digit = 0; digit < DIGIT_COUNT; ++digit) {
+        bool constantDigit = false;
+        for (size_t bucket = 0; bucket < RADIX && !constantDigit; ++bucket) {
+            size_t total = 0;
+            for (const auto& local : digitCounts) total += local[digit][bucket];
+            constantDigit = total == count;
+        }
+        if (constantDigit) continue;
+
+        // Each chunk counts its own rows for this digit, then scatters them into the slots
+        // reserved for it; chunks are laid out in order within a bucket, so it is stable.
+        parallelChunks(count, chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+            Histogram& local = offsets[chunk];
+            local.fill(0);
+            for (size_t i = begin; i < end; ++i) {
+                local[digitOf((*source)[i].key, digit)]++;
+            }
+            });
+
+        size_t running = 0;
+        for (size_t bucket = 0; bucket < RADIX; ++bucket) {
+            for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+                const size_t bucketCount = offsets[chunk][bucket];
+                offsets[chunk][bucket] = running;
+                running += bucketCount;
+            }
+        }
+
+        parallelChunks(count, chunkCount, [&](size_t chunk, size_t begin, size_t end) {
+            Histogram& cursor = offsets[chunk];
+            const SortEntry* from = source->data();
+            SortEntry* to = target->data();
+            for (size_t i = begin; i < end; ++i) {
+                to[cursor[digitOf(from[i].key, digit)]++] = from[i];
+            }
+            });
+
+        std::swap(source, target);
+    }
+
+    if (source != &entries) {
+        entries.swap(buffer);
+    }
+}
+
+std::vector<uint32_t> sortRowsByUserAndTime(const std::vector<ECommerceEvent>& events) {
+    checkRowCount(events.size());
+    return sortRowsByUserAndTime(events, events.size(), [](size_t i) { return static_cast<uint32_t>(i); });
+}
+
+std::vector<uint32_t> sortRowsByUserAndTime(const std::vector<ECommerceEvent>& events, const std::vector<uint32_t>& rows) {
+    return sortRowsByUserAndTime(events, rows.size(), [&rows](size_t i) { return rows[i]; });
+}
+
+std::vector<ECommerceEvent> applyPermutation(const std::vector<ECommerceEvent>& events, const std::vector<uint32_t>& order) {
+    std::vector<ECommerceEvent> reordered(order.size());
+    parallelChunks(order.size(), getThreadCount(), [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            reordered[i] = events[order[i]];
+        }
+        });
+    return reordered;
+}
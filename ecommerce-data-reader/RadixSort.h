@@ -0,0 +1,25 @@
+#pragma once
+#include "DataStructure.h"
+
+#include <cstdint>
+#include <vector>
+
+// Compact sort record: the 64-bit sort key and the row it came from.
+struct SortEntry {
+    uint64_t key;
+    uint32_t row;
+};
+
+// Stable parallel LSD radix sort on SortEntry::key, 11 bits per pass. Passes whose digit
+// is identical in every key are skipped, so narrow keys only pay for their real width.
+void radixSort(std::vector<SortEntry>& entries);
+
+// Row indices ordered by (userId, timestamp); rows that tie keep their file order.
+// When both ranges fit together into 64 bits they are packed into one key, otherwise
+// the rows are sorted by time and then stably by user.
+std::vector<uint32_t> sortRowsByUserAndTime(const std::vector<ECommerceEvent>& events);
+// The same order over a subset of the rows; ties keep their order in rows.
+std::vector<uint32_t> sortRowsByUserAndTime(const std::vector<ECommerceEvent>& events, const std::vector<uint32_t>& rows);
+
+// Returns the events physically reordered so that result[i] == events[order[i]].
+std::vector<ECommerceEvent> applyPermutation(const std::vector<ECommerceEvent>& events, const std::vector<uint32_t>& order);
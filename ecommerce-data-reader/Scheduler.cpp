@@ -0,0 +1,269 @@
+#include "Scheduler.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <iterator>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+    thread_local const Scheduler* currentScheduler = nullptr;
+    thread_local size_t currentSlot = 0;
+
+    std::mutex sharedMutex;
+    std::unique_ptr<Scheduler> sharedScheduler;
+
+    void pinToCpu(std::thread& thread, unsigned cpu) {
+#if defined(_WIN32)
+        SetThreadAffinityMask(thread.native_handle(), DWORD_PTR{ 1 } << (cpu % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu % CPU_SETSIZE, &set);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+        (void)thread;
+        (void)cpu;
+#endif
+    }
+
+}
+
+Scheduler::Scheduler(unsigned threadCount, bool pinThreads) : pinned(pinThreads) {
+    if (threadCount == 0) threadCount = 1;
+    slots.reserve(threadCount);
+    for (unsigned i = 0; i < threadCount; ++i) {
+        slots.push_back(std::make_unique<Slot>());
+    }
+
+    const unsigned cpuCount = std::max(1u, std::thread::hardware_concurrency());
+    workers.reserve(threadCount - 1);
+    for (size_t slot = 1; slot < threadCount; ++slot) {
+        workers.emplace_back([this, slot]() { workerLoop(slot); });
+        if (pinThreads) pinToCpu(workers.back(), static_cast<unsigned>(slot % cpuCount));
+    }
+}
+
+Scheduler::~Scheduler() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+Scheduler& Scheduler::instance() {
+    std::lock_guard<std::mutex> lock(sharedMutex);
+    if (!sharedScheduler) {
+        sharedScheduler = std::make_unique<Scheduler>(::getThreadCount(), ::getThreadPinning());
+    }
+    return *sharedScheduler;
+}
+
+void Scheduler::resetInstance() {
+    std::unique_ptr<Scheduler> previous;
+    {
+        std::lock_guard<std::mutex> lock(sharedMutex);
+        previous.swap(sharedScheduler);
+    }
+}
+
+void Scheduler::push(Task task) {
+    Slot& slot = *slots[currentScheduler == this ? currentSlot : 0];
+    {
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        slot.tasks.push_back(std::move(task));
+    }
+    queuedTasks.fetch_add(1, std::memory_order_release);
+    {
+        // Taking the lock orders this push before a worker that is about to sleep
+        // re-checks queuedTasks, so the notification cannot be lost.
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    // A paused worker would swallow a single notification and sleep on.
+    if (reservedWorkers.load(std::memory_order_acquire) != 0) wake.notify_all();
+    else wake.notify_one();
+}
+
+bool Scheduler::isReserved(size_t slot) const {
+    return slot + reservedWorkers.load(std::memory_order_acquire) >= slots.size();
+}
+
+void Scheduler::releaseWorkers(size_t count) {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        reservedWorkers.fetch_sub(count, std::memory_order_release);
+    }
+    wake.notify_all();
+}
+
+void Scheduler::runStages(size_t count, const std::function<void(size_t)>& stage) {
+    if (count == 0) return;
+
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    auto run = [&stage, &errorMutex, &error](size_t index) {
+        try {
+            stage(index);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error) error = std::current_exception();
+        }
+    };
+
+    size_t reserved = 0;
+    size_t firstReservedSlot = 0;
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        reserved = std::min(count - 1, workers.size() - reservedWorkers.load(std::memory_order_relaxed));
+        reservedWorkers.fetch_add(reserved, std::memory_order_release);
+        firstReservedSlot = slots.size() - reservedWorkers.load(std::memory_order_relaxed);
+    }
+
+    // Stage threads wait for one another to exist before any stage runs.
+    std::mutex startMutex;
+    std::condition_variable startSignal;
+    bool started = false;
+    bool aborted = false;
+    std::vector<std::thread> threads;
+    try {
+        threads.reserve(count - 1);
+        const unsigned cpuCount = std::max(1u, std::thread::hardware_concurrency());
+        for (size_t index = 1; index < count; ++index) {
+            threads.emplace_back([&, index]() {
+                {
+                    std::unique_lock<std::mutex> lock(startMutex);
+                    startSignal.wait(lock, [&]() { return started || aborted; });
+                    if (aborted) return;
+                }
+                run(index);
+            });
+            if (pinned && index <= reserved) {
+                pinToCpu(threads.back(), static_cast<unsigned>((firstReservedSlot + index - 1) % cpuCount));
+            }
+        }
+    }
+    catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(startMutex);
+            aborted = true;
+        }
+        startSignal.notify_all();
+        for (auto& thread : threads) thread.join();
+        releaseWorkers(reserved);
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(startMutex);
+        started = true;
+    }
+    startSignal.notify_all();
+    run(0);
+    for (auto& thread : threads) thread.join();
+    releaseWorkers(reserved);
+    if (error) std::rethrow_exception(error);
+}
+
+bool Scheduler::take(Task& task, const TaskGroup* group) {
+    if (queuedTasks.load(std::memory_order_acquire) == 0) return false;
+
+    // Newest own task first, for locality; otherwise the oldest task of another slot,
+    // which tends to be the largest piece of work left. A group's tasks are searched for
+    // in the same order.
+    auto matches = [group](const Task& candidate) { return group == nullptr || candidate.group == group; };
+    const size_t own = currentScheduler == this ? currentSlot : 0;
+    for (size_t i = 0; i < slots.size(); ++i) {
+        Slot& slot = *slots[(own + i) % slots.size()];
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        auto& tasks = slot.tasks;
+        std::deque<Task>::iterator found;
+        if (i == 0) {
+            auto newest = std::find_if(tasks.rbegin(), tasks.rend(), matches);
+            if (newest == tasks.rend()) continue;
+            found = std::prev(newest.base());
+        }
+        else {
+            found = std::find_if(tasks.begin(), tasks.end(), matches);
+            if (found == tasks.end()) continue;
+        }
+        task = std::move(*found);
+        tasks.erase(found);
+        queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+bool Scheduler::runOne(const TaskGroup* group) {
+    Task task;
+    if (!take(task, group)) return false;
+
+    std::exception_ptr taskError;
+    try {
+        task.fn();
+    }
+    catch (...) {
+        taskError = std::current_exception();
+    }
+    task.group->finish(taskError);
+    return true;
+}
+
+void Scheduler::workerLoop(size_t slot) {
+    currentScheduler = this;
+    currentSlot = slot;
+    for (;;) {
+        if (!isReserved(slot) && runOne()) continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this, slot]() {
+            return stopping || (!isReserved(slot) && queuedTasks.load(std::memory_order_acquire) != 0);
+            });
+        if (stopping) return;
+    }
+}
+
+TaskGroup::~TaskGroup() {
+    try {
+        wait();
+    }
+    catch (...) {
+    }
+}
+
+void TaskGroup::spawn(std::function<void()> fn) {
+    pending.fetch_add(1, std::memory_order_relaxed);
+    scheduler.push({ std::move(fn), this });
+}
+
+void TaskGroup::wait() {
+    while (pending.load(std::memory_order_acquire) != 0 && scheduler.runOne(this)) {
+    }
+    // Whatever is left is running on other threads. Waiting under the mutex also keeps
+    // the group alive until the last finish() has released it.
+    std::exception_ptr taskError;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this]() { return pending.load(std::memory_order_acquire) == 0; });
+        taskError.swap(error);
+    }
+    if (taskError) std::rethrow_exception(taskError);
+}
+
+void TaskGroup::finish(std::exception_ptr taskError) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (taskError && !error) error = taskError;
+    if (pending.fetch_sub(1, std::memory_order_release) == 1) finished.notify_all();
+}
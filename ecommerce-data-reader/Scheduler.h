@@ -0,0 +1,124 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGroup;
+
+// Work-stealing thread pool behind every parallel path in the project. Each worker owns a
+// deque: it pushes and pops its own tasks at the back while idle workers steal from the
+// front of the others, so when one chunk of a file turns out much denser than the rest
+// the remaining chunks move to whoever is free. Threads that are not workers (main, a
+// server connection) queue into a shared slot.
+//
+// A thread waiting on a TaskGroup runs that group's queued tasks itself, so nested
+// parallel calls never leave a thread blocked with its own work still queued. It never
+// picks up unrelated tasks, which could keep it busy long after its group finished, and
+// once none of its tasks is left in a queue it sleeps until the running ones finish.
+//
+// One shared instance sized by setThreadCount() keeps the process at a fixed number of
+// busy threads however many analyses run in parallel.
+class Scheduler {
+public:
+    // threadCount includes the thread that waits on tasks, so threadCount - 1 workers start.
+    // With pinThreads, worker i stays on logical CPU i; the calling thread is left alone.
+    explicit Scheduler(unsigned threadCount, bool pinThreads = false);
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    unsigned getThreadCount() const { return static_cast<unsigned>(slots.size()); }
+    bool isPinned() const { return pinned; }
+
+    // Runs stage(0) on the calling thread and stage(1) ... stage(count - 1) each on a thread
+    // of its own, all at once. This is for parts that block on each other, such as pipeline
+    // stages, which must never wait in a queue behind other tasks. One worker pauses for
+    // each extra thread while the stages run, so the process keeps its thread budget, and
+    // with pinning each stage thread takes over its worker's CPU. No stage starts unless
+    // every thread could be created. Rethrows the first exception a stage threw once all
+    // stages have finished.
+    void runStages(size_t count, const std::function<void(size_t)>& stage);
+
+    // The shared scheduler, created on first use from getThreadCount() and
+    // getThreadPinning(). Changing either setting replaces it, which must not happen while
+    // tasks are running.
+    static Scheduler& instance();
+    static void resetInstance();
+
+private:
+    friend class TaskGroup;
+
+    struct Task {
+        std::function<void()> fn;
+        TaskGroup* group;
+    };
+
+    struct alignas(64) Slot {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void push(Task task);
+    // True while the worker in this slot is paused for runStages.
+    bool isReserved(size_t slot) const;
+    void releaseWorkers(size_t count);
+    // Runs one queued task, or with a group one of that group's queued tasks. Returns false
+    // if there was none.
+    bool runOne(const TaskGroup* group = nullptr);
+    bool take(Task& task, const TaskGroup* group);
+    void workerLoop(size_t slot);
+
+    // Slot 0 is shared by every thread that is not a worker; worker i owns slot i.
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queuedTasks{ 0 };
+    // The workers in the highest slots pause; changed under sleepMutex.
+    std::atomic<size_t> reservedWorkers{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    bool pinned;
+};
+
+// Tasks spawned onto a scheduler that can be waited for together:
+//
+//     TaskGroup group;
+//     group.spawn([&] { left = sum(first); });
+//     group.spawn([&] { right = sum(second); });
+//     group.wait();
+//
+// Tasks must not wait on each other except through a nested TaskGroup.
+class TaskGroup {
+public:
+    explicit TaskGroup(Scheduler& scheduler = Scheduler::instance()) : scheduler(scheduler) {}
+    // Waits for unfinished tasks; their exceptions are dropped.
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void spawn(std::function<void()> fn);
+    // Runs this group's queued tasks on this thread and then sleeps until every spawned task
+    // has finished, then rethrows the first exception a task threw.
+    void wait();
+
+private:
+    friend class Scheduler;
+
+    void finish(std::exception_ptr taskError);
+
+    Scheduler& scheduler;
+    std::atomic<size_t> pending{ 0 };
+    // Guards error and orders the last finish() before a sleeping wait() re-checks pending.
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::exception_ptr error;
+};
@@ -0,0 +1,274 @@
+#include "Analyzer.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include "Partitioning.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+    constexpr int64_t NO_TIME = std::numeric_limits<int64_t>::max();
+
+    struct SessionFunnelState {
+        int64_t firstView = NO_TIME;
+        int64_t firstCart = NO_TIME;
+        int64_t firstPurchase = NO_TIME;
+        int64_t entryTime = NO_TIME;
+        uint32_t entryRow = 0;
+    };
+
+    struct FunnelAccumulator {
+        size_t sessionCount = 0;
+        size_t viewSessions = 0;
+        size_t cartSessions = 0;
+        size_t purchaseSessions = 0;
+        std::vector<int64_t> viewToCartSeconds;
+        std::vector<int64_t> cartToPurchaseSeconds;
+
+        void add(const SessionFunnelState& state) {
+            sessionCount++;
+            if (state.firstView == NO_TIME) return;
+            viewSessions++;
+            if (state.firstCart == NO_TIME) return;
+            cartSessions++;
+            viewToCartSeconds.push_back(std::max<int64_t>(0, state.firstCart - state.firstView));
+            if (state.firstPurchase == NO_TIME) return;
+            purchaseSessions++;
+            cartToPurchaseSeconds.push_back(std::max<int64_t>(0, state.firstPurchase - state.firstCart));
+        }
+
+        void merge(FunnelAccumulator& other) {
+            sessionCount += other.sessionCount;
+            viewSessions += other.viewSessions;
+            cartSessions += other.cartSessions;
+            purchaseSessions += other.purchaseSessions;
+            viewToCartSeconds.insert(viewToCartSeconds.end(), other.viewToCartSeconds.begin(), other.viewToCartSeconds.end());
+            cartToPurchaseSeconds.insert(cartToPurchaseSeconds.end(), other.cartToPurchaseSeconds.begin(), other.cartToPurchaseSeconds.end());
+        }
+
+        FunnelStats finish() {
+            FunnelStats stats;
+            stats.sessionCount = sessionCount;
+            stats.viewSessions = viewSessions;
+            stats.cartSessions = cartSessions;
+            stats.purchaseSessions = purchaseSessions;
+            stats.viewToCartDropOff = dropOff(viewSessions, cartSessions);
+            stats.cartToPurchaseDropOff = dropOff(cartSessions, purchaseSessions);
+            stats.medianViewToCartSeconds = median(viewToCartSeconds);
+            stats.medianCartToPurchaseSeconds = median(cartToPurchaseSeconds);
+            return stats;
+        }
+
+        static double dropOff(size_t reached, size_t advanced) {
+            return reached == 0 ? 0.0 : 1.0 - static_cast<double>(advanced) / reached;
+        }
+
+        static double median(std::vector<int64_t>& values) {
+            if (values.empty()) return 0.0;
+            auto middle = values.begin() + values.size() / 2;
+            std::nth_element(values.begin(), middle, values.end());
+            return static_cast<double>(*middle);
+        }
+    };
+
+    struct FunnelPartial {
+        FunnelAccumulator overall;
+        std::unordered_map<std::string_view, FunnelAccumulator> byCategory;
+        std::unordered_map<std::string_view, FunnelAccumulator> byBrand;
+    };
+
+    void recordFunnelEvent(SessionFunnelState& state, const ECommerceEvent& event, uint32_t row) {
+        const int64_t time = event.timestamp;
+        if (time < state.entryTime) {
+            state.entryTime = time;
+            state.entryRow = row;
+        }
+        switch (event.eventType) {
+        case EventType::VIEW:
+            state.firstView = std::min(state.firstView, time);
+            break;
+        case EventType::CART:
+            state.firstCart = std::min(state.firstCart, time);
+            break;
+        case EventType::PURCHASE:
+            state.firstPurchase = std::min(state.firstPurchase, time);
+            break;
+        case EventType::REMOVE_FROM_CART:
+        case EventType::UNKNOWN:
+            break;
+        }
+    }
+
+    // Hash-partitions sessions so that every session's events land on one thread, which
+    // then owns that session's state outright. No global sort is needed.
+    PartitionedRows partitionBySession(const std::vector<ECommerceEvent>& events, size_t partitionCount) {
+        const std::hash<std::string_view> sessionHash;
+        return partitionRows(events, partitionCount, [&](const ECommerceEvent& event) {
+            return sessionHash(event.userSession);
+            });
+    }
+
+    SessionRecord startSession(const ECommerceEvent& event) {
+        SessionRecord session;
+        session.sessionId = event.userSession;
+        session.userId = event.userId;
+        session.startTime = event.timestamp;
+        session.endTime = event.timestamp;
+        return session;
+    }
+
+    void recordSessionEvent(SessionRecord& session, const ECommerceEvent& event) {
+        session.startTime = std::min(session.startTime, event.timestamp);
+        session.endTime = std::max(session.endTime, event.timestamp);
+
+        switch (event.eventType) {
+        case EventType::VIEW:
+            session.viewCount++;
+            break;
+        case EventType::CART:
+            session.cartCount++;
+            session.cartValue += event.price;
+            break;
+        case EventType::REMOVE_FROM_CART:
+            session.removeCount++;
+            break;
+        case EventType::PURCHASE:
+            session.purchaseCount++;
+            session.purchaseValue += event.price;
+            session.converted = true;
+            break;
+        case EventType::UNKNOWN:
+            break;
+        }
+    }
+
+    template<typename Key>
+    std::unordered_map<Key, FunnelStats> finishGroups(std::vector<std::unordered_map<Key, FunnelAccumulator>*>& partials) {
+        std::unordered_map<Key, FunnelAccumulator> merged;
+        for (auto* partial : partials) {
+            for (auto& group : *partial) {
+                merged[group.first].merge(group.second);
+            }
+        }
+        std::unordered_map<Key, FunnelStats> result;
+        result.reserve(merged.size());
+        for (auto& group : merged) {
+            result.emplace(group.first, group.second.finish());
+        }
+        return result;
+    }
+
+}
+
+FunnelReport Analyzer::getSessionFunnel(const std::vector<ECommerceEvent>& events) {
+    METRIC_TIMER("analysis.funnel");
+    const size_t partitionCount = getThreadCount();
+    PartitionedRows rows = partitionBySession(events, partitionCount);
+
+    std::vector<FunnelPartial> partials(partitionCount);
+    parallelChunks(partitionCount, partitionCount, [&](size_t chunk, size_t begin, size_t end) {
+        for (size_t partition = begin; partition < end; ++partition) {
+            std::unordered_map<std::string_view, SessionFunnelState> sessions;
+            forEachPartitionRow(rows, partition, [&](uint32_t row) {
+                const ECommerceEvent& event = events[row];
+                recordFunnelEvent(sessions[event.userSession], event, row);
+                });
+
+            FunnelPartial& partial = partials[chunk];
+            for (const auto& session : sessions) {
+                const SessionFunnelState& state = session.second;
+                const ECommerceEvent& entry = events[state.entryRow];
+                partial.overall.add(state);
+                partial.byCategory[entry.categoryCode.code].add(state);
+                partial.byBrand[entry.brand].add(state);
+            }
+        }
+        });
+
+    FunnelReport report;
+    std::vector<std::unordered_map<std::string_view, FunnelAccumulator>*> categoryPartials;
+    std::vector<std::unordered_map<std::string_view, FunnelAccumulator>*> brandPartials;
+    FunnelAccumulator overall;
+    for (auto& partial : partials) {
+        overall.merge(partial.overall);
+        categoryPartials.push_back(&partial.byCategory);
+        brandPartials.push_back(&partial.byBrand);
+    }
+    report.overall = overall.finish();
+    report.byCategory = finishGroups(categoryPartials);
+    report.byBrand = finishGroups(brandPartials);
+    return report;
+}
+
+std::vector<SessionRecord> Analyzer::getSessions(const std::vector<ECommerceEvent>& events) {
+    METRIC_TIMER("analysis.sessions");
+    const size_t partitionCount = getThreadCount();
+    PartitionedRows rows = partitionBySession(events, partitionCount);
+
+    std::vector<std::vector<SessionRecord>> partials(partitionCount);
+    parallelChunks(partitionCount, partitionCount, [&](size_t chunk, size_t begin, size_t end) {
+        for (size_t partition = begin; partition < end; ++partition) {
+            std::vector<SessionRecord>& sessions = partials[chunk];
+            std::unordered_map<std::string_view, uint32_t> sessionIndex;
+            // (session, product) pairs of every view; sorted afterwards to count distinct products.
+            std::vector<std::pair<uint32_t, uint64_t>> viewedProducts;
+
+            forEachPartitionRow(rows, partition, [&](uint32_t row) {
+                const ECommerceEvent& event = events[row];
+                auto inserted = sessionIndex.try_emplace(event.userSession, static_cast<uint32_t>(sessions.size()));
+                if (inserted.second) {
+                    sessions.push_back(startSession(event));
+                }
+                const uint32_t index = inserted.first->second;
+                recordSessionEvent(sessions[index], event);
+                if (event.eventType == EventType::VIEW) {
+                    viewedProducts.emplace_back(index, event.prodId);
+                }
+                });
+
+            std::sort(viewedProducts.begin(), viewedProducts.end());
+            auto last = std::unique(viewedProducts.begin(), viewedProducts.end());
+            for (auto it = viewedProducts.begin(); it != last; ++it) {
+                sessions[it->first].distinctProductsViewed++;
+            }
+        }
+        });
+
+    std::vector<SessionRecord> sessions = std::move(partials[0]);
+    for (size_t chunk = 1; chunk < partials.size(); ++chunk) {
+        sessions.insert(sessions.end(), partials[chunk].begin(), partials[chunk].end());
+    }
+    return sessions;
+}
+
+bool Analyzer::exportSessionsCsv(const std::vector<SessionRecord>& sessions, const std::string& fileName) {
+    std::ofstream out(fileName, std::ios::binary);
+    if (!out) {
+        std::cerr << "Export error: could not open " << fileName << " for writing." << std::endl;
+        return false;
+    }
+
+    out << "user_session,user_id,start_time,end_time,duration_seconds,views,carts,removes,purchases,"
+        << "distinct_products_viewed,cart_value,purchase_value,converted\n";
+    char numberBuffer[64];
+    for (const auto& session : sessions) {
+        out << session.sessionId << ',' << session.userId << ','
+            << formatTimestamp(session.startTime) << ',' << formatTimestamp(session.endTime) << ','
+            << session.durationSeconds() << ','
+            << session.viewCount << ',' << session.cartCount << ',' << session.removeCount << ','
+            << session.purchaseCount << ',' << session.distinctProductsViewed << ',';
+        std::snprintf(numberBuffer, sizeof(numberBuffer), "%.2f,%.2f,", session.cartValue, session.purchaseValue);
+        out << numberBuffer << (session.converted ? 1 : 0) << '\n';
+    }
+
+    if (!out) {
+        std::cerr << "Export error: failed while writing " << fileName << "." << std::endl;
+        return false;
+    }
+    return true;
+}
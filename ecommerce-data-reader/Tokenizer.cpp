@@ -0,0 +1,204 @@
+#include "Tokenizer.h"
+#include "Hashing.h"
+
+#include <charconv>
+#include <cstring>
+
+#if defined(CPU_X86_64)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+    template<typename T>
+    void parseDigits(T& outValue, std::string_view text) {
+        if (text.empty()) {
+            outValue = 0;
+            return;
+        }
+        auto result = std::from_chars(text.data(), text.data() + text.size(), outValue);
+        if (result.ec != std::errc()) {
+            outValue = 0;
+        }
+    }
+
+    size_t findByteScalar(const char* data, size_t size, char target) {
+        const void* found = size == 0 ? nullptr : std::memchr(data, target, size);
+        return found == nullptr ? std::string_view::npos : static_cast<size_t>(static_cast<const char*>(found) - data);
+    }
+
+    // Finishes a vector search from position offset with the scalar code.
+    size_t findByteTail(const char* data, size_t size, char target, size_t offset) {
+        const size_t found = findByteScalar(data + offset, size - offset, target);
+        return found == std::string_view::npos ? found : offset + found;
+    }
+
+    // True only if the whole field is digits.
+    bool parseTimeField(int& outValue, std::string_view text) {
+        for (char c : text) {
+            if (c < '0' || c > '9') return false;
+        }
+        std::from_chars(text.data(), text.data() + text.size(), outValue);
+        return true;
+    }
+
+    // A timestamp with a field that is not all digits comes back as all zeros, which
+    // isEventValid rejects.
+    void parseTimestampScalar(PurchaseTime& outTime, std::string_view text) {
+        if (text.length() < 19 ||
+            !parseTimeField(outTime.year, text.substr(0, 4)) ||
+            !parseTimeField(outTime.month, text.substr(5, 2)) ||
+            !parseTimeField(outTime.day, text.substr(8, 2)) ||
+            !parseTimeField(outTime.hour, text.substr(11, 2)) ||
+            !parseTimeField(outTime.minute, text.substr(14, 2)) ||
+            !parseTimeField(outTime.second, text.substr(17, 2))) {
+            outTime = { 0,0,0,0,0,0 };
+        }
+    }
+
+    void parseUint64Scalar(uint64_t& outValue, std::string_view text) {
+        parseDigits(outValue, text);
+    }
+
+#if defined(CPU_X86_64)
+
+    CPU_TARGET("sse2")
+    size_t findByteSse2(const char* data, size_t size, char target) {
+        const __m128i needle = _mm_set1_epi8(target);
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            const uint32_t matches = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, needle)));
+            if (matches != 0) return i + countTrailingZeros64(matches);
+        }
+        return findByteTail(data, size, target, i);
+    }
+
+    CPU_TARGET("avx2")
+    size_t findByteAvx2(const char* data, size_t size, char target) {
+        const __m256i needle = _mm256_set1_epi8(target);
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            const uint32_t matches = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, needle)));
+            if (matches != 0) return i + countTrailingZeros64(matches);
+        }
+        return findByteTail(data, size, target, i);
+    }
+
+    // The last partial block uses a masked load, which cannot fault on the bytes it skips,
+    // so no scalar tail is needed.
+    CPU_TARGET("avx512f,avx512bw")
+    size_t findByteAvx512(const char* data, size_t size, char target) {
+        const __m512i needle = _mm512_set1_epi8(target);
+        for (size_t i = 0; i < size; i += 64) {
+            const size_t remaining = size - i;
+            const __mmask64 valid = remaining >= 64 ? ~__mmask64{ 0 } : (__mmask64{ 1 } << remaining) - 1;
+            const __m512i bytes = _mm512_maskz_loadu_epi8(valid, data + i);
+            const uint64_t matches = _mm512_mask_cmpeq_epi8_mask(valid, bytes, needle);
+            if (matches != 0) return i + countTrailingZeros64(matches);
+        }
+        return std::string_view::npos;
+    }
+
+    // Sets bit i of the result when byte i of values, already offset by '0', is not a digit.
+    CPU_TARGET("sse2")
+    inline uint32_t nonDigitMask(__m128i values) {
+        const __m128i nine = _mm_set1_epi8(9);
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(values, nine), nine))) ^ 0xFFFF;
+    }
+
+    // Gathers the twelve date and time digits of the first 16 bytes with one shuffle, then
+    // combines digit pairs with a multiply-add. The seconds lie past the first 16 bytes and
+    // are read directly. Anything that is not a digit goes to the scalar parser.
+    CPU_TARGET("ssse3")
+    void parseTimestampSsse3(PurchaseTime& outTime, std::string_view text) {
+        if (text.length() < 19) {
+            parseTimestampScalar(outTime, text);
+            return;
+        }
+        const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data()));
+        const __m128i digits = _mm_shuffle_epi8(_mm_sub_epi8(chars, _mm_set1_epi8('0')),
+            _mm_setr_epi8(0, 1, 2, 3, 5, 6, 8, 9, 11, 12, 14, 15, -1, -1, -1, -1));
+        const unsigned secondsTens = static_cast<unsigned char>(text[17] - '0');
+        const unsigned secondsOnes = static_cast<unsigned char>(text[18] - '0');
+        if (nonDigitMask(digits) != 0 || secondsTens > 9 || secondsOnes > 9) {
+            parseTimestampScalar(outTime, text);
+            return;
+        }
+
+        alignas(16) uint16_t pairs[8];
+        _mm_store_si128(reinterpret_cast<__m128i*>(pairs), _mm_maddubs_epi16(digits, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 0, 0, 0, 0)));
+        outTime.year = pairs[0] * 100 + pairs[1];
+        outTime.month = pairs[2];
+        outTime.day = pairs[3];
+        outTime.hour = pairs[4];
+        outTime.minute = pairs[5];
+        outTime.second = static_cast<int>(secondsTens * 10 + secondsOnes);
+    }
+
+    // Right-aligns up to 16 digits in a zero-padded block and reduces it in three
+    // multiply-add steps: digit pairs, groups of four, groups of eight.
+    CPU_TARGET("ssse3,sse4.1")
+    void parseUint64Sse41(uint64_t& outValue, std::string_view text) {
+        if (text.empty() || text.size() > 16) {
+            parseUint64Scalar(outValue, text);
+            return;
+        }
+        alignas(16) char block[16];
+        std::memset(block, '0', sizeof(block));
+        std::memcpy(block + sizeof(block) - text.size(), text.data(), text.size());
+
+        const __m128i digits = _mm_sub_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(block)), _mm_set1_epi8('0'));
+        if (nonDigitMask(digits) != 0) {
+            parseUint64Scalar(outValue, text);
+            return;
+        }
+        const __m128i pairs = _mm_maddubs_epi16(digits, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1));
+        const __m128i quads = _mm_madd_epi16(pairs, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+        const __m128i packed = _mm_packus_epi32(quads, quads);
+        const __m128i octets = _mm_madd_epi16(packed, _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1));
+        const uint64_t high = static_cast<uint32_t>(_mm_cvtsi128_si32(octets));
+        const uint64_t low = static_cast<uint32_t>(_mm_extract_epi32(octets, 1));
+        outValue = high * 100000000ull + low;
+    }
+
+#endif
+
+}
+
+FindByteFn selectFindByte(CpuLevel level) {
+#if defined(CPU_X86_64)
+    switch (level) {
+    case CpuLevel::AVX512:
+        return findByteAvx512;
+    case CpuLevel::AVX2:
+        return findByteAvx2;
+    case CpuLevel::SSE42:
+        return findByteSse2;
+    case CpuLevel::SCALAR:
+        break;
+    }
+#else
+    (void)level;
+#endif
+    return findByteScalar;
+}
+
+ParseTimestampFn selectParseTimestamp(CpuLevel level) {
+#if defined(CPU_X86_64)
+    if (level >= CpuLevel::SSE42) return parseTimestampSsse3;
+#else
+    (void)level;
+#endif
+    return parseTimestampScalar;
+}
+
+ParseUint64Fn selectParseUint64(CpuLevel level) {
+#if defined(CPU_X86_64)
+    if (level >= CpuLevel::SSE42) return parseUint64Sse41;
+#else
+    (void)level;
+#endif
+    return parseUint64Scalar;
+}
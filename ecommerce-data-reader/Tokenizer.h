@@ -0,0 +1,23 @@
+#pragma once
+#include "CpuFeatures.h"
+#include "DataStructure.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Text scanning and number parsing used by the CSV parser, with SIMD versions selected
+// through CpuDispatch. Every version returns exactly what the scalar one does; inputs
+// a fast path cannot handle are passed on to the scalar code.
+
+// Index of the first target byte in [data, data + size), or std::string_view::npos.
+using FindByteFn = size_t(*)(const char* data, size_t size, char target);
+// Parses "YYYY-MM-DD hh:mm:ss"; anything shorter yields all zeros.
+using ParseTimestampFn = void(*)(PurchaseTime& outTime, std::string_view text);
+// Parses a decimal id; empty, malformed or out-of-range text yields 0.
+using ParseUint64Fn = void(*)(uint64_t& outValue, std::string_view text);
+
+// Widest implementation that needs no more than the given level.
+FindByteFn selectFindByte(CpuLevel level);
+ParseTimestampFn selectParseTimestamp(CpuLevel level);
+ParseUint64Fn selectParseUint64(CpuLevel level);
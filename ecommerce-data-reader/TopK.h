@@ -0,0 +1,51 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Keeps the k largest values pushed into it using a bounded min-heap, so selecting
+// from n candidates costs O(n log k). Instances filled on different threads can be merged.
+template<typename T, typename Less = std::less<T>>
+class TopK {
+public:
+    explicit TopK(size_t k, Less less = Less()) : k(k), less(less) {
+        heap.reserve(k);
+    }
+
+    void push(const T& value) {
+        if (k == 0) return;
+        if (heap.size() < k) {
+            heap.push_back(value);
+            std::push_heap(heap.begin(), heap.end(), greater());
+        }
+        else if (less(heap.front(), value)) {
+            std::pop_heap(heap.begin(), heap.end(), greater());
+            heap.back() = value;
+            std::push_heap(heap.begin(), heap.end(), greater());
+        }
+    }
+
+    void merge(const TopK& other) {
+        for (const auto& value : other.heap) {
+            push(value);
+        }
+    }
+
+    size_t size() const { return heap.size(); }
+
+    std::vector<T> sortedDescending() const {
+        std::vector<T> result = heap;
+        std::sort(result.begin(), result.end(), [this](const T& a, const T& b) { return less(b, a); });
+        return result;
+    }
+
+private:
+    auto greater() const {
+        return [this](const T& a, const T& b) { return less(b, a); };
+    }
+
+    size_t k;
+    Less less;
+    std::vector<T> heap;
+};
@@ -0,0 +1,1290 @@
+#include "Parser.h"
+#include "AggregateState.h"
+#include "Analyzer.h"
+#include "Bitmap.h"
+#include "CommandLine.h"
+#include "BoundedQueue.h"
+#include "CountMinSketch.h"
+#include "CpuDispatch.h"
+#include "DataGenerator.h"
+#include "EventIndex.h"
+#include "FieldParsers.h"
+#include "GroupBy.h"
+#include "Hashing.h"
+#include "HyperLogLog.h"
+#include "Kernels.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include "QuantileSketch.h"
+#include "QueryServer.h"
+#include "RadixSort.h"
+#include "Scheduler.h"
+#include "TopK.h"
+#include "ZoneMap.h"
+
+#include <iostream>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Parser::runUnitTests lives here rather than in Parser.cpp because it covers every
+// module, not only the parser. Each group below returns its number of failures.
+
+namespace {
+
+    void expect(bool condition, const char* name, int& failedTests) {
+        if (condition) return;
+        std::cerr << "TEST FAILED: " << name << std::endl;
+        failedTests++;
+    }
+
+    ECommerceEvent makeEvent(int64_t timestamp, EventType type, uint64_t prodId, uint64_t userId, std::string_view session,
+        double price = 10.0, std::string_view category = {}, std::string_view brand = {}) {
+        ECommerceEvent event{};
+        event.purchaseTime = fromEpochSeconds(timestamp);
+        event.timestamp = timestamp;
+        event.eventType = type;
+        event.prodId = prodId;
+        event.categoryCode.code = category;
+        event.brand = brand;
+        event.price = price;
+        event.userId = userId;
+        event.userSession = session;
+        return event;
+    }
+
+    std::vector<uint64_t> productIds(const std::vector<RankedProduct>& products) {
+        std::vector<uint64_t> ids;
+        for (const auto& product : products) ids.push_back(product.prodId);
+        return ids;
+    }
+
+    int testTopProducts() {
+        int failedTests = 0;
+
+        TopK<int> left(3), right(3);
+        for (int value : { 5, 1, 9, 7 }) left.push(value);
+        for (int value : { 8, 2, 6 }) right.push(value);
+        left.merge(right);
+        expect(left.sortedDescending() == std::vector<int>{ 9, 8, 7 }, "TopK merge", failedTests);
+        TopK<int> none(0);
+        none.push(1);
+        expect(none.size() == 0, "TopK k = 0", failedTests);
+
+        // Thresholds are strict: exactly 100 views or 10 purchases is not enough.
+        ProductStatsMap stats;
+        stats[1] = { 100, 0, 50, 500.0 };
+        stats[2] = { 101, 0, 10, 100.0 };
+        stats[3] = { 101, 0, 11, 110.0 };
+        stats[4] = { 200, 0, 40, 40.0 };
+        stats[5] = { 1000, 0, 40, 4000.0 };
+        stats[6] = { 300, 0, 30, 30.0 };
+        Analyzer analyzer;
+        TopKOptions options;
+        options.k = 3;
+        expect(productIds(analyzer.getTopProducts(stats, options)) == std::vector<uint64_t>{ 4, 3, 6 },
+            "getTopProducts conversion rate", failedTests);
+        options.metric = RankMetric::PURCHASES;
+        // Products 4 and 5 tie on purchases; the lower id ranks first.
+        expect(productIds(analyzer.getTopProducts(stats, options)) == std::vector<uint64_t>{ 4, 5, 6 },
+            "getTopProducts purchases", failedTests);
+        options.metric = RankMetric::REVENUE;
+        options.k = 10;
+        expect(productIds(analyzer.getTopProducts(stats, options)) == std::vector<uint64_t>{ 5, 3, 4, 6 },
+            "getTopProducts revenue", failedTests);
+        options.viewThreshold = 0;
+        options.purchaseThreshold = 0;
+        expect(analyzer.getTopProducts(stats, options).size() == 6, "getTopProducts zero thresholds", failedTests);
+        return failedTests;
+    }
+
+
+    bool sameFunnel(const FunnelStats& stats, size_t sessions, size_t viewed, size_t carted, size_t purchased) {
+        return stats.sessionCount == sessions && stats.viewSessions == viewed && stats.cartSessions == carted && stats.purchaseSessions == purchased;
+    }
+
+    int testTimestampValidation() {
+        int failedTests = 0;
+        auto valid = [](const char* text) {
+            PurchaseTime time;
+            parseTimestamp(time, text);
+            return isTimeValid(time);
+        };
+        expect(valid("2019-11-30 23:59:59 UTC") && valid("2020-02-29 00:00:00 UTC"), "isTimeValid accepts real times", failedTests);
+        expect(!valid("") && !valid("2019-11-01") && !valid("0000-11-01 00:00:00 UTC") && !valid("2019-02-29 00:00:00 UTC")
+            && !valid("2019-13-01 00:00:00 UTC") && !valid("2019-11-31 00:00:00 UTC") && !valid("2019-11-01 24:00:00 UTC")
+            && !valid("2019-11-01 00:60:00 UTC") && !valid("2019-11-01 00:00:-1 UTC") && !valid("19x9-11-01 00:00:00 UTC"),
+            "isTimeValid rejects bad times", failedTests);
+        return failedTests;
+    }
+
+    int testTimeSeries() {
+        int failedTests = 0;
+        const int64_t day = 24 * 60 * 60;
+        const int64_t november = 1572566400;
+        std::vector<ECommerceEvent> events = {
+            makeEvent(november + 10, EventType::VIEW, 1, 1, "s"),
+            makeEvent(november + 3 * day + 5, EventType::PURCHASE, 1, 1, "s", 7.0),
+            makeEvent(november + 20, EventType::CART, 1, 1, "s"),
+        };
+        Analyzer analyzer;
+        TimeSeries series = analyzer.getTimeSeries(events, day);
+        expect(series.bucketStarts == std::vector<int64_t>{ november, november + 3 * day } && series.buckets.size() == 2
+            && series.buckets[0].viewCount == 1 && series.buckets[0].cartCount == 1 && series.buckets[1].totalRevenue == 7.0,
+            "getTimeSeries dense", failedTests);
+
+        // Decades of one-minute buckets take the sparse path and still list only used buckets.
+        events.push_back(makeEvent(60, EventType::VIEW, 1, 1, "s"));
+        series = analyzer.getTimeSeries(events, 60);
+        expect(series.bucketStarts == std::vector<int64_t>{ 60, november, november + 3 * day } && series.buckets[1].cartCount == 1,
+            "getTimeSeries sparse", failedTests);
+        return failedTests;
+    }
+
+    int testGroupBy() {
+        int failedTests = 0;
+        const std::vector<ECommerceEvent> events = {
+            makeEvent(0, EventType::VIEW, 1, 1, "s", 10.0, "", "a"),
+            makeEvent(10, EventType::PURCHASE, 1, 1, "s", 20.0, "", "a"),
+            makeEvent(3600, EventType::PURCHASE, 2, 2, "t", 40.0, "", "a"),
+            makeEvent(20, EventType::CART, 3, 2, "t", 5.0, "", "b"),
+        };
+        auto byBrand = groupBy<BrandKey, Count, SumIf<EventType::PURCHASE, Price>, Min<Price>, Max<Price>, Mean<Price>>(events);
+        expect(byBrand.size() == 2 && byBrand.at("a") == std::make_tuple(size_t{ 3 }, 60.0, 10.0, 40.0, 70.0 / 3)
+            && byBrand.at("b") == std::make_tuple(size_t{ 1 }, 0.0, 5.0, 5.0, 5.0), "groupBy aggregates", failedTests);
+
+        auto byBrandHour = groupBy<CompositeKey<BrandKey, TimeBucketKey>, CountIf<EventType::PURCHASE>>(events);
+        expect(byBrandHour.size() == 3 && std::get<0>(byBrandHour.at({ "a", 0 })) == 1 && std::get<0>(byBrandHour.at({ "a", 3600 })) == 1
+            && std::get<0>(byBrandHour.at({ "b", 0 })) == 0, "groupBy composite key", failedTests);
+
+        const std::vector<uint32_t> selected = { 0, 3 };
+        auto selectedUsers = GroupBy<UserKey, Sum<Price>>::runSelected(events, selected).results();
+        expect(selectedUsers.size() == 2 && std::get<0>(selectedUsers.at(1)) == 10.0 && std::get<0>(selectedUsers.at(2)) == 5.0,
+            "groupBy selected rows", failedTests);
+
+        GroupBy<ProductKey, Count> left, right;
+        left.update(events, 0, 2);
+        right.update(events, 2, 4);
+        right.update(events[0]);
+        left.merge(right);
+        auto merged = left.results();
+        expect(merged.size() == 3 && std::get<0>(merged.at(1)) == 3 && std::get<0>(merged.at(2)) == 1, "groupBy merge", failedTests);
+        return failedTests;
+    }
+
+    int testSessionFunnel() {
+        int failedTests = 0;
+        // Rows are deliberately out of time order; the entry event is the earliest one.
+        const std::vector<ECommerceEvent> events = {
+            makeEvent(40, EventType::PURCHASE, 1, 1, "s1", 10.0, "b", "y"),
+            makeEvent(0, EventType::VIEW, 1, 1, "s1", 10.0, "a", "x"),
+            makeEvent(10, EventType::CART, 1, 1, "s1", 10.0, "b", "y"),
+            makeEvent(100, EventType::VIEW, 2, 2, "s2", 10.0, "a", "y"),
+            makeEvent(130, EventType::CART, 2, 2, "s2", 10.0, "a", "y"),
+            makeEvent(200, EventType::VIEW, 3, 3, "s3", 10.0, "b", "x"),
+            makeEvent(300, EventType::CART, 3, 4, "s4", 10.0, "b", "x"),
+            makeEvent(520, EventType::PURCHASE, 4, 5, "s5", 10.0, "a", "x"),
+            makeEvent(500, EventType::VIEW, 4, 5, "s5", 10.0, "a", "x"),
+        };
+        Analyzer analyzer;
+        const FunnelReport report = analyzer.getSessionFunnel(events);
+        expect(sameFunnel(report.overall, 5, 4, 2, 1) && report.overall.viewToCartDropOff == 0.5
+            && report.overall.cartToPurchaseDropOff == 0.5, "getSessionFunnel overall", failedTests);
+        expect(report.overall.medianViewToCartSeconds == 30.0 && report.overall.medianCartToPurchaseSeconds == 30.0,
+            "getSessionFunnel medians", failedTests);
+        expect(report.byCategory.size() == 2 && sameFunnel(report.byCategory.at("a"), 3, 3, 2, 1)
+            && sameFunnel(report.byCategory.at("b"), 2, 1, 0, 0), "getSessionFunnel by category", failedTests);
+        expect(report.byBrand.size() == 2 && sameFunnel(report.byBrand.at("x"), 4, 3, 1, 1)
+            && sameFunnel(report.byBrand.at("y"), 1, 1, 1, 0), "getSessionFunnel by brand", failedTests);
+        expect(sameFunnel(analyzer.getSessionFunnel({}).overall, 0, 0, 0, 0), "getSessionFunnel empty", failedTests);
+        return failedTests;
+    }
+
+    int testHyperLogLog() {
+        int failedTests = 0;
+        constexpr uint64_t DISTINCT = 100000;
+        std::vector<uint64_t> hashes;
+        for (uint64_t value = 0; value < DISTINCT; ++value) hashes.push_back(hashUint64(value));
+
+        // Precision 12 has a standard error of about 1.6%; 5% is beyond three of them.
+        HyperLogLog scalar(12);
+        for (uint64_t hash : hashes) scalar.add(hash);
+        expect(std::abs(scalar.estimate() / DISTINCT - 1.0) < 0.05, "hyperLogLog estimate error", failedTests);
+
+        HyperLogLog batched(12);
+        batched.addAll(hashes.data(), hashes.size());
+        batched.addAll(hashes.data(), hashes.size() / 3);
+        expect(batched.estimate() == scalar.estimate(), "hyperLogLog addAll matches add", failedTests);
+
+        // Overlapping halves merge to exactly the sketch of the union.
+        HyperLogLog left(12);
+        HyperLogLog right(12);
+        left.addAll(hashes.data(), DISTINCT * 2 / 3);
+        right.addAll(hashes.data() + DISTINCT / 3, DISTINCT - DISTINCT / 3);
+        left.merge(right);
+        expect(left.estimate() == scalar.estimate(), "hyperLogLog merge", failedTests);
+        bool mismatchThrew = false;
+        try { left.merge(HyperLogLog(10)); }
+        catch (const std::invalid_argument&) { mismatchThrew = true; }
+        expect(mismatchThrew, "hyperLogLog merge precision mismatch", failedTests);
+
+        std::stringstream stream;
+        scalar.save(stream);
+        HyperLogLog loaded(4);
+        expect(loaded.load(stream) && loaded.getPrecision() == 12 && loaded.estimate() == scalar.estimate(),
+            "hyperLogLog save/load", failedTests);
+        std::stringstream truncated(stream.str().substr(0, 20));
+        expect(!loaded.load(truncated) && loaded.estimate() == scalar.estimate(), "hyperLogLog load truncated", failedTests);
+
+        // Small cardinalities go through linear counting and are close to exact.
+        std::vector<ECommerceEvent> events;
+        const std::array<std::string, 3> sessions = { "a", "b", "c" };
+        for (uint64_t row = 0; row < 1000; ++row) {
+            events.push_back(makeEvent(0, EventType::VIEW, 1, row % 50, sessions[row % 3]));
+        }
+        const DistinctCounts counts = Analyzer().getDistinctCounts(events, 12);
+        expect(std::round(counts.users) == 50 && std::round(counts.sessions) == 3, "getDistinctCounts small", failedTests);
+        return failedTests;
+    }
+
+    // True rank of each value is value / count, since the stream is a permutation of 0..count-1.
+    bool withinRankError(const QuantileSketch& sketch, uint64_t count, double epsilon) {
+        for (double rank : { 0.01, 0.05, 0.1, 0.25, 0.5, 0.75, 0.9, 0.95, 0.99 }) {
+            if (std::abs(sketch.quantile(rank) / static_cast<double>(count) - rank) > epsilon) return false;
+        }
+        return true;
+    }
+
+    int testQuantileSketch() {
+        int failedTests = 0;
+        constexpr uint64_t COUNT = 100000;
+        // 7919 is coprime to COUNT, so this visits every value once in a scrambled order.
+        auto valueAt = [](uint64_t i) { return static_cast<double>(i * 7919 % COUNT); };
+
+        QuantileSketch sketch(200, 1);
+        for (uint64_t i = 0; i < COUNT; ++i) sketch.add(valueAt(i));
+        expect(sketch.count() == COUNT && sketch.minValue() == 0.0 && sketch.maxValue() == COUNT - 1,
+            "quantileSketch count and range", failedTests);
+        expect(withinRankError(sketch, COUNT, 0.0165), "quantileSketch rank error", failedTests);
+        expect(sketch.retainedItems() < 1000, "quantileSketch bounded memory", failedTests);
+
+        std::vector<QuantileSketch> parts;
+        for (uint64_t part = 0; part < 4; ++part) parts.emplace_back(200, part + 10);
+        for (uint64_t i = 0; i < COUNT; ++i) parts[i % parts.size()].add(valueAt(i));
+        for (size_t part = 1; part < parts.size(); ++part) parts[0].merge(parts[part]);
+        expect(parts[0].count() == COUNT && parts[0].minValue() == 0.0 && parts[0].maxValue() == COUNT - 1,
+            "quantileSketch merge count and range", failedTests);
+        expect(withinRankError(parts[0], COUNT, 0.0165), "quantileSketch merge rank error", failedTests);
+
+        std::stringstream stream;
+        sketch.save(stream);
+        QuantileSketch loaded(8, 0);
+        expect(loaded.load(stream) && loaded.count() == COUNT && loaded.quantile(0.5) == sketch.quantile(0.5),
+            "quantileSketch save/load", failedTests);
+        expect(std::isnan(QuantileSketch().quantile(0.5)), "quantileSketch empty", failedTests);
+
+        // Default-constructed sketches get different seeds, which save() writes out.
+        std::stringstream first;
+        std::stringstream second;
+        QuantileSketch().save(first);
+        QuantileSketch().save(second);
+        expect(first.str() != second.str(), "quantileSketch per-instance seed", failedTests);
+        return failedTests;
+    }
+
+    int testCountMinSketch() {
+        int failedTests = 0;
+        // A wide sketch with a few keys has no collisions, so estimates are exact.
+        CountMinSketch wide;
+        for (uint64_t key = 1; key <= 100; ++key) wide.add(hashUint64(key), key);
+        bool exact = true;
+        for (uint64_t key = 1; key <= 100; ++key) exact = exact && wide.estimate(hashUint64(key)) == key;
+        expect(exact && wide.estimate(hashUint64(1000)) == 0, "countMin exact without collisions", failedTests);
+
+        // A narrow one collides, but never undercounts nor overcounts beyond the total.
+        CountMinSketch narrow(8, 2);
+        uint64_t total = 0;
+        for (uint64_t key = 1; key <= 100; ++key) {
+            narrow.add(hashUint64(key), key);
+            total += key;
+        }
+        bool bounded = true;
+        for (uint64_t key = 1; key <= 100; ++key) {
+            const uint64_t estimate = narrow.estimate(hashUint64(key));
+            bounded = bounded && estimate >= key && estimate <= total;
+        }
+        expect(bounded, "countMin never undercounts", failedTests);
+
+        CountMinSketch other;
+        other.add(hashUint64(1), 5);
+        wide.merge(other);
+        expect(wide.estimate(hashUint64(1)) == 6 && wide.estimate(hashUint64(2)) == 2, "countMin merge", failedTests);
+        bool mismatchThrew = false;
+        try { wide.merge(narrow); }
+        catch (const std::invalid_argument&) { mismatchThrew = true; }
+        expect(mismatchThrew, "countMin merge shape mismatch", failedTests);
+
+        std::stringstream stream;
+        wide.save(stream);
+        CountMinSketch loaded(8, 1);
+        expect(loaded.load(stream) && loaded.getWidth() == wide.getWidth() && loaded.getDepth() == wide.getDepth()
+            && loaded.estimate(hashUint64(1)) == 6 && loaded.estimate(hashUint64(100)) == 100, "countMin save/load", failedTests);
+
+        // Key k occurs 1000 / k times, interleaved so the leaders are not simply the first keys seen.
+        using Leaders = std::vector<std::pair<uint64_t, uint64_t>>;
+        const Leaders expected = { { 1, 1000 }, { 2, 500 }, { 3, 333 }, { 4, 250 }, { 5, 200 } };
+        HeavyHitters hitters(20);
+        HeavyHitters firstHalf(20);
+        HeavyHitters secondHalf(20);
+        for (uint64_t round = 0; round < 1000; ++round) {
+            for (uint64_t key = 1; key <= 500; ++key) {
+                if (round >= 1000 / key) continue;
+                hitters.add(key);
+                (round % 2 == 0 ? firstHalf : secondHalf).add(key);
+            }
+        }
+        expect(hitters.top(5) == expected, "heavyHitters top", failedTests);
+        firstHalf.merge(secondHalf);
+        expect(firstHalf.top(5) == expected, "heavyHitters merge", failedTests);
+        std::stringstream hitterStream;
+        hitters.save(hitterStream);
+        HeavyHitters loadedHitters(1);
+        expect(loadedHitters.load(hitterStream) && loadedHitters.top(5) == expected, "heavyHitters save/load", failedTests);
+        expect(HeavyHitters(0).top(5).empty(), "heavyHitters zero capacity", failedTests);
+
+        std::vector<ECommerceEvent> events;
+        for (uint64_t prodId = 1; prodId <= 4; ++prodId) {
+            for (uint64_t i = 0; i < prodId; ++i) {
+                events.push_back(makeEvent(0, EventType::VIEW, prodId, 10 + i, "s"));
+                if (prodId % 2 == 0) events.push_back(makeEvent(0, EventType::PURCHASE, prodId, 10, "s"));
+            }
+        }
+        const HeavyHitterReport report = Analyzer().getHeavyHitters(events, 2);
+        expect(report.topViewedProducts == Leaders{ { 4, 4 }, { 3, 3 } } && report.topCartedProducts.empty()
+            && report.topPurchasedProducts == Leaders{ { 4, 4 }, { 2, 2 } } && report.mostActiveUsers == Leaders{ { 10, 10 }, { 11, 3 } },
+            "getHeavyHitters", failedTests);
+        return failedTests;
+    }
+
+    int testRadixSort() {
+        int failedTests = 0;
+        // Keys drawn from a small range repeat often, which exposes any loss of stability;
+        // the top bits vary too, so the high digit passes are not all skipped.
+        uint64_t state = 12345;
+        auto nextRandom = [&state]() {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        };
+        std::vector<SortEntry> entries;
+        for (uint32_t row = 0; row < 50000; ++row) {
+            const uint64_t random = nextRandom();
+            entries.push_back({ (random % 1000) | (random & (uint64_t{ 3 } << 62)), row });
+        }
+        std::vector<SortEntry> expected = entries;
+        std::stable_sort(expected.begin(), expected.end(), [](const SortEntry& a, const SortEntry& b) { return a.key < b.key; });
+        radixSort(entries);
+        bool same = entries.size() == expected.size();
+        for (size_t i = 0; same && i < entries.size(); ++i) {
+            same = entries[i].key == expected[i].key && entries[i].row == expected[i].row;
+        }
+        expect(same, "radixSort matches stable_sort", failedTests);
+
+        // Narrow ids pack user and time into one key; ids spread over 64 bits take the
+        // two-pass path. Both must equal a stable sort by (user, time).
+        for (uint64_t userScale : { uint64_t{ 1 }, uint64_t{ 1 } << 50 }) {
+            std::vector<ECommerceEvent> events;
+            for (uint32_t row = 0; row < 5000; ++row) {
+                events.push_back(makeEvent(1572566400 + static_cast<int64_t>(nextRandom() % 500), EventType::VIEW, row,
+                    (nextRandom() % 40) * userScale, "s"));
+            }
+            std::vector<uint32_t> byUserTime(events.size());
+            for (uint32_t row = 0; row < byUserTime.size(); ++row) byUserTime[row] = row;
+            std::stable_sort(byUserTime.begin(), byUserTime.end(), [&events](uint32_t a, uint32_t b) {
+                return events[a].userId != events[b].userId ? events[a].userId < events[b].userId : events[a].timestamp < events[b].timestamp;
+                });
+            expect(sortRowsByUserAndTime(events) == byUserTime,
+                userScale == 1 ? "sortRowsByUserAndTime packed" : "sortRowsByUserAndTime two passes", failedTests);
+
+            std::vector<uint32_t> oddRows;
+            for (uint32_t row = 1; row < events.size(); row += 2) oddRows.push_back(row);
+            std::vector<uint32_t> oddExpected;
+            std::copy_if(byUserTime.begin(), byUserTime.end(), std::back_inserter(oddExpected), [](uint32_t row) { return row % 2 == 1; });
+            expect(sortRowsByUserAndTime(events, oddRows) == oddExpected, "sortRowsByUserAndTime subset", failedTests);
+
+            const std::vector<ECommerceEvent> reordered = applyPermutation(events, byUserTime);
+            expect(reordered.size() == events.size() && reordered.front().prodId == byUserTime.front()
+                && reordered.back().prodId == byUserTime.back(), "applyPermutation", failedTests);
+        }
+        return failedTests;
+    }
+
+    int testSessionExport() {
+        int failedTests = 0;
+        expect(formatTimestamp(1572566400) == "2019-11-01 00:00:00 UTC" && formatTimestamp(-1) == "1969-12-31 23:59:59 UTC",
+            "formatTimestamp", failedTests);
+
+        constexpr int64_t START = 1572566400;
+        const std::vector<ECommerceEvent> events = {
+            makeEvent(START + 3600, EventType::VIEW, 3, 8, "s2"),
+            makeEvent(START, EventType::VIEW, 1, 7, "s1"),
+            makeEvent(START + 30, EventType::VIEW, 1, 7, "s1"),
+            makeEvent(START + 60, EventType::VIEW, 2, 7, "s1"),
+            makeEvent(START + 90, EventType::CART, 2, 7, "s1", 12.5),
+            makeEvent(START + 125, EventType::PURCHASE, 2, 7, "s1", 12.5),
+        };
+        Analyzer analyzer;
+        const char* fileName = "self-test-sessions.csv";
+        const bool exported = analyzer.exportSessionsCsv(analyzer.getSessions(events), fileName);
+
+        std::ifstream in(fileName);
+        std::string header;
+        std::getline(in, header);
+        std::vector<std::string> lines;
+        for (std::string line; std::getline(in, line);) lines.push_back(line);
+        in.close();
+        std::remove(fileName);
+        // Sessions come back in partition order, which depends on the thread count.
+        std::sort(lines.begin(), lines.end());
+
+        expect(exported && header == "user_session,user_id,start_time,end_time,duration_seconds,views,carts,removes,purchases,"
+            "distinct_products_viewed,cart_value,purchase_value,converted", "exportSessionsCsv header", failedTests);
+        expect(lines == std::vector<std::string>{
+            "s1,7,2019-11-01 00:00:00 UTC,2019-11-01 00:02:05 UTC,125,3,1,0,1,2,12.50,12.50,1",
+            "s2,8,2019-11-01 01:00:00 UTC,2019-11-01 01:00:00 UTC,0,1,0,0,0,1,0.00,0.00,0" },
+            "exportSessionsCsv rows", failedTests);
+        return failedTests;
+    }
+
+    int testEventIndex() {
+        int failedTests = 0;
+        // Skewed keys: a few products and users own most rows, many own one.
+        std::vector<ECommerceEvent> events;
+        for (uint32_t row = 0; row < 20000; ++row) {
+            const uint64_t prodId = row % 7 == 0 ? 1000 + row : row % 13;
+            const uint64_t userId = (row * 2654435761u) % 997;
+            events.push_back(makeEvent(row, EventType::VIEW, prodId, userId, "s"));
+        }
+        EventIndex index;
+        index.build(events);
+
+        auto scan = [&events](auto matches) {
+            std::vector<uint32_t> rows;
+            for (uint32_t row = 0; row < events.size(); ++row) {
+                if (matches(events[row])) rows.push_back(row);
+            }
+            return rows;
+        };
+        auto asVector = [](RowRange range) { return std::vector<uint32_t>(range.begin(), range.end()); };
+
+        bool productsMatch = true;
+        for (uint64_t prodId : { uint64_t{ 0 }, uint64_t{ 5 }, uint64_t{ 12 }, uint64_t{ 1007 }, uint64_t{ 19991 } }) {
+            productsMatch = productsMatch
+                && asVector(index.rowsForProduct(prodId)) == scan([prodId](const ECommerceEvent& event) { return event.prodId == prodId; });
+        }
+        expect(productsMatch, "eventIndex rowsForProduct", failedTests);
+        bool usersMatch = true;
+        for (uint64_t userId = 0; userId < 997; userId += 37) {
+            usersMatch = usersMatch
+                && asVector(index.rowsForUser(userId)) == scan([userId](const ECommerceEvent& event) { return event.userId == userId; });
+        }
+        expect(usersMatch, "eventIndex rowsForUser", failedTests);
+        expect(index.rowsForProduct(999).empty() && index.productIndex().keyCount() == 13 + 20000 / 7 + 1
+            && index.userIndex().keyCount() == 997, "eventIndex missing keys and key counts", failedTests);
+        expect(index.productIndex().rowsForAny({ 3, 1007, 3, 999 })
+            == scan([](const ECommerceEvent& event) { return event.prodId == 3 || event.prodId == 1007; }), "eventIndex rowsForAny", failedTests);
+
+        EventIndex empty;
+        empty.build({});
+        expect(empty.rowsForUser(1).empty() && empty.userIndex().keyCount() == 0, "eventIndex empty", failedTests);
+        return failedTests;
+    }
+
+    int testBitmaps() {
+        int failedTests = 0;
+        // Four 2^16-row containers covering every pairing of array and bitset containers:
+        // a is dense in the first two and sparse after; b alternates dense and sparse.
+        constexpr uint32_t ROW_COUNT = 200000;
+        auto inA = [](uint32_t row) { return row < 140000 ? row % 3 == 0 : row % 1000 == 0; };
+        auto inB = [](uint32_t row) { return (row >> 16) % 2 == 0 ? row % 7 == 0 : row % 50 == 0; };
+        RowBitmap a;
+        RowBitmap b;
+        for (uint32_t row = 0; row < ROW_COUNT; ++row) {
+            if (inA(row)) a.add(row);
+            if (inB(row)) b.add(row);
+        }
+        auto expected = [](auto keep) {
+            std::vector<uint32_t> rows;
+            for (uint32_t row = 0; row < ROW_COUNT; ++row) {
+                if (keep(row)) rows.push_back(row);
+            }
+            return rows;
+        };
+
+        const std::vector<uint32_t> rowsA = expected(inA);
+        expect(a.toRows() == rowsA && a.cardinality() == rowsA.size(), "rowBitmap add and toRows", failedTests);
+        expect(a.contains(0) && a.contains(139998) && !a.contains(139999) && a.contains(199000) && !a.contains(199001)
+            && !a.contains(ROW_COUNT + 5), "rowBitmap contains", failedTests);
+        expect((a & b).toRows() == expected([&](uint32_t row) { return inA(row) && inB(row); }), "rowBitmap intersect", failedTests);
+        expect((a | b).toRows() == expected([&](uint32_t row) { return inA(row) || inB(row); }), "rowBitmap unite", failedTests);
+        expect((a - b).toRows() == expected([&](uint32_t row) { return inA(row) && !inB(row); }), "rowBitmap subtract", failedTests);
+        const RowBitmap notA = RowBitmap::complement(a, ROW_COUNT);
+        expect(notA.toRows() == expected([&](uint32_t row) { return !inA(row); }) && notA.cardinality() == ROW_COUNT - rowsA.size(),
+            "rowBitmap complement", failedTests);
+        expect((a & RowBitmap()).cardinality() == 0 && (a | RowBitmap()).toRows() == rowsA, "rowBitmap with empty", failedTests);
+
+        std::vector<ECommerceEvent> events;
+        const std::array<EventType, 3> types = { EventType::VIEW, EventType::CART, EventType::PURCHASE };
+        const std::array<std::string_view, 3> brands = { "x", "y", "" };
+        const std::array<std::string_view, 2> categories = { "electronics", "apparel" };
+        BitmapIndex index;
+        for (uint32_t row = 0; row < 10000; ++row) {
+            events.push_back(makeEvent(row, types[row % 3], row, row, "s", 10.0, categories[row % 2], brands[row / 10 % 3]));
+            index.add(row, events.back());
+        }
+        auto scan = [&events](auto keep) {
+            std::vector<uint32_t> rows;
+            for (uint32_t row = 0; row < events.size(); ++row) {
+                if (keep(events[row])) rows.push_back(row);
+            }
+            return rows;
+        };
+        const std::vector<uint32_t> purchasedElectronics = (index.eventType(EventType::PURCHASE) & index.topCategory("electronics")).toRows();
+        expect(purchasedElectronics == scan([](const ECommerceEvent& event) {
+            return event.eventType == EventType::PURCHASE && event.categoryCode.code == "electronics";
+            }), "bitmapIndex event type and category", failedTests);
+        expect((index.brand("y") | index.brand("")).toRows() == scan([](const ECommerceEvent& event) { return event.brand != "x"; })
+            && index.brand("z").cardinality() == 0 && index.rowCount() == events.size(), "bitmapIndex brands", failedTests);
+
+        const AnalysisSummary filtered = Analyzer().getSummary(events, purchasedElectronics);
+        expect(filtered.purchaseCount == purchasedElectronics.size() && filtered.viewCount == 0
+            && filtered.totalRevenue == 10.0 * purchasedElectronics.size(), "getSummary over a selection", failedTests);
+        return failedTests;
+    }
+
+    bool sameZones(const ZoneMap& a, const ZoneMap& b) {
+        if (a.getBlockRows() != b.getBlockRows() || a.getRowCount() != b.getRowCount() || a.blockCount() != b.blockCount()) return false;
+        for (size_t block = 0; block < a.blockCount(); ++block) {
+            const BlockZone& x = a.zone(block);
+            const BlockZone& y = b.zone(block);
+            if (x.minTime != y.minTime || x.maxTime != y.maxTime || x.minPrice != y.minPrice || x.maxPrice != y.maxPrice
+                || x.minProduct != y.minProduct || x.maxProduct != y.maxProduct || x.minUser != y.minUser || x.maxUser != y.maxUser) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int testZoneMap() {
+        int failedTests = 0;
+        // Time rises with the row, as in the exports; price and product do not.
+        std::vector<ECommerceEvent> events;
+        for (uint32_t row = 0; row < 1050; ++row) {
+            events.push_back(makeEvent(1000 + row * 10, EventType::PURCHASE, row * 7919 % 500, row % 40, "s", static_cast<double>(row % 97)));
+        }
+        ZoneMap zoneMap;
+        zoneMap.build(events, 100);
+        expect(zoneMap.blockCount() == 11 && zoneMap.zone(10).minTime == 11000 && zoneMap.zone(10).maxTime == 11490,
+            "zoneMap build", failedTests);
+        std::vector<ECommerceEvent> late = events;
+        late[550].timestamp = 5;
+        ZoneMap lateMap;
+        lateMap.build(late, 100);
+        expect(zoneMap.minTime() == 1000 && lateMap.minTime() == 5 && ZoneMap().minTime() == std::numeric_limits<int64_t>::max(),
+            "zoneMap minTime", failedTests);
+
+        RangePredicate byTime;
+        byTime.minTime = 3500;
+        byTime.maxTime = 5000;
+        RangePredicate byPriceAndProduct;
+        byPriceAndProduct.minPrice = 95.0;
+        byPriceAndProduct.maxProduct = 100;
+        RangePredicate none;
+        none.minTime = 20000;
+        RangePredicate everything;
+        Analyzer analyzer;
+        for (const RangePredicate* predicate : { &byTime, &byPriceAndProduct, &none, &everything }) {
+            // Every block holding a matching row must be a candidate, and the summary over
+            // the candidates must equal a full scan.
+            std::vector<size_t> matchingBlocks;
+            std::vector<uint32_t> matchingRows;
+            for (uint32_t row = 0; row < events.size(); ++row) {
+                if (!predicate->matches(events[row])) continue;
+                matchingRows.push_back(row);
+                if (matchingBlocks.empty() || matchingBlocks.back() != row / 100) matchingBlocks.push_back(row / 100);
+            }
+            const std::vector<size_t> candidates = zoneMap.candidateBlocks(*predicate);
+            const AnalysisSummary summary = analyzer.getSummary(events, zoneMap, *predicate);
+            expect(std::includes(candidates.begin(), candidates.end(), matchingBlocks.begin(), matchingBlocks.end())
+                && summary.purchaseCount == matchingRows.size()
+                && summary.totalRevenue == analyzer.getSummary(events, matchingRows).totalRevenue, "zoneMap candidateBlocks", failedTests);
+        }
+        // Time is sorted, so a time range prunes to exactly the blocks it overlaps.
+        expect(zoneMap.candidateBlocks(byTime) == std::vector<size_t>{ 2, 3, 4 } && zoneMap.candidateBlocks(none).empty(),
+            "zoneMap prunes by time", failedTests);
+
+        std::stringstream stream;
+        zoneMap.save(stream);
+        ZoneMap loaded;
+        expect(loaded.load(stream) && sameZones(loaded, zoneMap), "zoneMap save/load", failedTests);
+        std::stringstream truncated(stream.str().substr(0, stream.str().size() - 8));
+        expect(!loaded.load(truncated) && sameZones(loaded, zoneMap), "zoneMap load truncated", failedTests);
+
+        const char* fileName = "self-test-zones.bin";
+        ZoneMap fromFile;
+        expect(zoneMap.saveToFile(fileName) && fromFile.loadFromFile(fileName) && sameZones(fromFile, zoneMap),
+            "zoneMap saveToFile/loadFromFile", failedTests);
+        std::remove(fileName);
+        return failedTests;
+    }
+
+    int testCohortRetention() {
+        int failedTests = 0;
+        auto at = [](int year, int month, int day) { return toEpochSeconds(PurchaseTime{ year, month, day, 12, 0, 0 }); };
+        // User 1 buys in its first month twice, then one and three months later; user 2
+        // only views before its first purchase; user 3 comes back 64 months later, which
+        // makes the matrix 65 months wide.
+        std::vector<ECommerceEvent> events = {
+            makeEvent(at(2020, 2, 3), EventType::PURCHASE, 1, 1, "a"),
+            makeEvent(at(2019, 12, 24), EventType::PURCHASE, 1, 2, "b"),
+            makeEvent(at(2019, 11, 5), EventType::PURCHASE, 1, 1, "a"),
+            makeEvent(at(2025, 3, 1), EventType::PURCHASE, 1, 3, "c"),
+            makeEvent(at(2019, 10, 1), EventType::VIEW, 1, 2, "b"),
+            makeEvent(at(2019, 11, 30), EventType::PURCHASE, 1, 1, "a"),
+            makeEvent(at(2019, 12, 1), EventType::PURCHASE, 1, 1, "a"),
+            makeEvent(at(2019, 11, 20), EventType::PURCHASE, 1, 3, "c"),
+        };
+        // A row whose timestamp failed to parse is left out.
+        events.push_back(makeEvent(0, EventType::PURCHASE, 1, 4, "d"));
+        events.back().purchaseTime = PurchaseTime{ 0, 0, 0, 0, 0, 0 };
+
+        const CohortRetention retention = Analyzer().getCohortRetention(events);
+        std::vector<size_t> firstCohort(65, 0);
+        firstCohort[0] = 2;
+        firstCohort[1] = 1;
+        firstCohort[3] = 1;
+        firstCohort[64] = 1;
+        std::vector<size_t> secondCohort(64, 0);
+        secondCohort[0] = 1;
+        bool othersEmpty = retention.activeUsers.size() == 65;
+        for (size_t cohort = 2; othersEmpty && cohort < retention.activeUsers.size(); ++cohort) {
+            const auto& row = retention.activeUsers[cohort];
+            othersEmpty = row.size() == 65 - cohort && std::all_of(row.begin(), row.end(), [](size_t users) { return users == 0; });
+        }
+        expect(retention.firstYear == 2019 && retention.firstMonth == 11 && othersEmpty
+            && retention.activeUsers[0] == firstCohort && retention.activeUsers[1] == secondCohort, "getCohortRetention matrix", failedTests);
+        expect(retention.retentionRate(0, 1) == 0.5 && retention.cohortSize(1) == 1, "getCohortRetention rates", failedTests);
+        expect(Analyzer().getCohortRetention({ makeEvent(0, EventType::VIEW, 1, 1, "a") }).activeUsers.empty(),
+            "getCohortRetention without purchases", failedTests);
+
+        // A cohort in the second word of the month bitset returning in the third word.
+        const CohortRetention wide = Analyzer().getCohortRetention({
+            makeEvent(at(2019, 11, 1), EventType::PURCHASE, 1, 5, "e"),
+            makeEvent(at(2031, 7, 1), EventType::PURCHASE, 1, 6, "f"),
+            makeEvent(at(2025, 9, 1), EventType::PURCHASE, 1, 6, "f"),
+            makeEvent(at(2025, 9, 2), EventType::PURCHASE, 1, 6, "f") });
+        expect(wide.activeUsers.size() == 141 && wide.activeUsers[0][0] == 1 && wide.cohortSize(70) == 1
+            && wide.activeUsers[70].size() == 71 && wide.activeUsers[70][70] == 1
+            && std::accumulate(wide.activeUsers[70].begin(), wide.activeUsers[70].end(), size_t{ 0 }) == 2,
+            "getCohortRetention across bitset words", failedTests);
+        return failedTests;
+    }
+
+    bool samePartners(const CoOccurrenceReport& report, uint64_t prodId, const std::vector<std::pair<uint64_t, uint32_t>>& expected) {
+        auto it = report.partners.find(prodId);
+        if (it == report.partners.end()) return expected.empty();
+        std::vector<std::pair<uint64_t, uint32_t>> actual;
+        for (const auto& partner : it->second) actual.emplace_back(partner.prodId, partner.sessions);
+        return actual == expected;
+    }
+
+    int testCoOccurrence() {
+        int failedTests = 0;
+        // s1 carts four distinct products, so a cap of three drops product 40, its last new
+        // one; views never count.
+        const std::vector<ECommerceEvent> events = {
+            makeEvent(0, EventType::CART, 10, 1, "s1"),
+            makeEvent(1, EventType::CART, 20, 2, "s2"),
+            makeEvent(2, EventType::PURCHASE, 10, 1, "s1"),
+            makeEvent(3, EventType::CART, 20, 1, "s1"),
+            makeEvent(4, EventType::PURCHASE, 30, 3, "s3"),
+            makeEvent(5, EventType::CART, 30, 1, "s1"),
+            makeEvent(6, EventType::CART, 10, 2, "s2"),
+            makeEvent(7, EventType::CART, 40, 1, "s1"),
+            makeEvent(8, EventType::VIEW, 50, 1, "s1"),
+            makeEvent(9, EventType::CART, 20, 3, "s3"),
+        };
+        Analyzer analyzer;
+        CoOccurrenceOptions options;
+        options.maxProductsPerSession = 3;
+        options.topPartnersPerProduct = 2;
+        options.minSessions = 1;
+        const CoOccurrenceReport capped = analyzer.getCoOccurrence(events, options);
+        expect(capped.sessionCount == 3 && capped.cappedSessions == 1 && capped.distinctPairs == 3, "coOccurrence capped counts", failedTests);
+        expect(samePartners(capped, 10, { { 20, 2 }, { 30, 1 } }) && samePartners(capped, 20, { { 10, 2 }, { 30, 2 } })
+            && samePartners(capped, 30, { { 20, 2 }, { 10, 1 } }) && samePartners(capped, 40, {}) && samePartners(capped, 50, {}),
+            "coOccurrence capped partners", failedTests);
+
+        // Ties on sessions go to the smaller product id; single-session pairs are dropped.
+        options.topPartnersPerProduct = 1;
+        options.minSessions = 2;
+        const CoOccurrenceReport frequent = analyzer.getCoOccurrence(events, options);
+        expect(samePartners(frequent, 20, { { 10, 2 } }) && samePartners(frequent, 10, { { 20, 2 } })
+            && samePartners(frequent, 30, { { 20, 2 } }) && frequent.partners.size() == 3, "coOccurrence min sessions and ties", failedTests);
+
+        const CoOccurrenceReport uncapped = analyzer.getCoOccurrence(events, CoOccurrenceOptions{ 30, 5, 1 });
+        expect(uncapped.cappedSessions == 0 && uncapped.distinctPairs == 6 && samePartners(uncapped, 40, { { 10, 1 }, { 20, 1 }, { 30, 1 } }),
+            "coOccurrence uncapped", failedTests);
+        return failedTests;
+    }
+
+    // Parses a command line given as the arguments after the program name.
+    bool parseArguments(std::vector<std::string> arguments, CommandLineOptions& options) {
+        std::vector<char*> argv = { const_cast<char*>("data_analyzer") };
+        for (auto& argument : arguments) argv.push_back(&argument[0]);
+        std::string error;
+        return parseCommandLine(static_cast<int>(argv.size()), argv.data(), options, error);
+    }
+
+    int testCommandLine() {
+        int failedTests = 0;
+        CommandLineOptions options;
+        expect(parseArguments({}, options) && options.analyses.count() == 2 && options.wants(AnalysisKind::SUMMARY)
+            && options.wants(AnalysisKind::TOP_PRODUCTS), "commandLine default analyses", failedTests);
+        expect(parseArguments({ "--analyses=all" }, options) && options.analyses.count() == ANALYSIS_KIND_COUNT - 1
+            && !options.wants(AnalysisKind::KERNEL_BENCHMARK), "commandLine all leaves out kernels", failedTests);
+        expect(parseArguments({ "--analyses=all,kernels" }, options) && options.analyses.all(), "commandLine kernels by name", failedTests);
+        expect(parseArguments({ "--analyses=cohorts" }, options) && options.analyses.count() == 1 && options.wants(AnalysisKind::COHORTS),
+            "commandLine single analysis", failedTests);
+        expect(!parseArguments({ "--analyses=everything" }, options), "commandLine unknown analysis", failedTests);
+        return failedTests;
+    }
+
+    int testScheduler() {
+        int failedTests = 0;
+        // Without workers every task runs on a waiting thread, and a waiter runs only the
+        // tasks of the group it waits on.
+        Scheduler single(1);
+        bool ranFirst = false;
+        bool ranSecond = false;
+        TaskGroup first(single);
+        TaskGroup second(single);
+        second.spawn([&ranSecond]() { ranSecond = true; });
+        first.spawn([&ranFirst]() { ranFirst = true; });
+        first.wait();
+        expect(ranFirst && !ranSecond, "taskGroup waits only on its own tasks", failedTests);
+        second.wait();
+        expect(ranSecond, "taskGroup runs its queued tasks", failedTests);
+
+        // Nested groups on workers, with waiters that sleep while other threads finish.
+        Scheduler pool(4);
+        std::atomic<uint64_t> total{ 0 };
+        TaskGroup outer(pool);
+        for (uint64_t task = 0; task < 16; ++task) {
+            outer.spawn([&pool, &total, task]() {
+                TaskGroup inner(pool);
+                for (uint64_t item = 0; item < 8; ++item) {
+                    inner.spawn([&total, task, item]() {
+                        std::this_thread::sleep_for(std::chrono::microseconds(100));
+                        total.fetch_add(task * 8 + item, std::memory_order_relaxed);
+                        });
+                }
+                inner.wait();
+                });
+        }
+        outer.wait();
+        expect(total.load() == 127 * 128 / 2, "taskGroup nested waits", failedTests);
+
+        // Stages only finish once all of them run at the same time, also on a scheduler
+        // without workers to pause, and tasks still run on the workers left over.
+        for (Scheduler* scheduler : { &single, &pool }) {
+            std::atomic<size_t> arrived{ 0 };
+            std::atomic<uint64_t> taskTotal{ 0 };
+            scheduler->runStages(3, [scheduler, &arrived, &taskTotal](size_t stage) {
+                arrived.fetch_add(1);
+                while (arrived.load() < 3) std::this_thread::yield();
+                if (stage != 0) return;
+                TaskGroup group(*scheduler);
+                for (uint64_t item = 1; item <= 10; ++item) group.spawn([&taskTotal, item]() { taskTotal.fetch_add(item); });
+                group.wait();
+                });
+            expect(arrived.load() == 3 && taskTotal.load() == 55, "runStages runs stages together", failedTests);
+        }
+
+        std::atomic<size_t> finishedStages{ 0 };
+        bool stageErrorRethrown = false;
+        try {
+            pool.runStages(4, [&finishedStages](size_t stage) {
+                if (stage == 2) throw std::runtime_error("stage failure");
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                finishedStages.fetch_add(1);
+                });
+        }
+        catch (const std::runtime_error&) {
+            stageErrorRethrown = finishedStages.load() == 3;
+        }
+        expect(stageErrorRethrown, "runStages rethrows after every stage finished", failedTests);
+        return failedTests;
+    }
+
+    int testQueryServer() {
+        int failedTests = 0;
+        constexpr int64_t DAY = 24 * 60 * 60;
+        constexpr int64_t NOV_1 = 1572566400;
+        const std::vector<ECommerceEvent> events = {
+            makeEvent(NOV_1, EventType::VIEW, 1, 7, "s1", 100.0, "electronics", "apple"),
+            makeEvent(NOV_1 + 60, EventType::CART, 1, 7, "s1", 100.0, "electronics", "apple"),
+            makeEvent(NOV_1 + 120, EventType::PURCHASE, 1, 7, "s1", 100.0, "electronics", "apple"),
+            makeEvent(NOV_1 + 180, EventType::PURCHASE, 2, 8, "s2", 50.0, "electronics", "samsung"),
+            makeEvent(NOV_1 + DAY, EventType::VIEW, 2, 8, "s3", 50.0, "electronics", "samsung"),
+            makeEvent(NOV_1 + DAY + 60, EventType::PURCHASE, 2, 8, "s3", 50.0, "electronics", "samsung"),
+            makeEvent(NOV_1 + DAY + 120, EventType::PURCHASE, 3, 9, "s4", 20.0, "kids"),
+        };
+        EventColumns columns;
+        for (const auto& event : events) {
+            columns.eventTypes.push_back(static_cast<uint8_t>(event.eventType));
+            columns.prices.push_back(event.price);
+        }
+        const QueryServer server(events, columns);
+        auto query = [&server](const char* target, std::string& body) { return server.handle(target, body); };
+        auto contains = [](const std::string& body, const char* text) { return body.find(text) != std::string::npos; };
+
+        std::string body;
+        expect(query("/summary", body) == 200 && contains(body, "\"views\":2") && contains(body, "\"purchases\":4")
+            && contains(body, "\"revenue\":220"), "queryServer summary", failedTests);
+        expect(query("/summary?from=2019-11-02&to=2019-11-02", body) == 200 && contains(body, "\"views\":1")
+            && contains(body, "\"purchases\":2") && contains(body, "\"revenue\":70"), "queryServer summary day range", failedTests);
+        expect(query("/summary?from=1572566400&to=2019-11-01T00:02:00", body) == 200 && contains(body, "\"purchases\":1")
+            && contains(body, "\"carts\":1") && contains(body, "\"revenue\":100"), "queryServer summary epoch and time bounds", failedTests);
+
+        expect(query("/group-by?key=brand", body) == 200 && contains(body, "\"groupCount\":3")
+            && body.find("\"key\":\"apple\"") < body.find("\"key\":\"samsung\""), "queryServer group-by brand", failedTests);
+        expect(query("/group-by?key=brand&from=2019-11-02&limit=1", body) == 200 && contains(body, "\"groupCount\":2")
+            && contains(body, "\"key\":\"samsung\"") && !contains(body, "\"key\":\"\""), "queryServer group-by range and limit", failedTests);
+        expect(query("/group-by?key=day", body) == 200 && contains(body, "\"groupCount\":2"), "queryServer group-by day", failedTests);
+
+        const char* badRequests[] = { "/summary?from=yesterday", "/summary?to=2019-13-01", "/group-by", "/group-by?key=color",
+            "/group-by?key=brand&limit=-1", "/top-products?k=ten", "/top-products?metric=clicks", "/product", "/user?id=x", "/summary?from=%zz" };
+        bool allRejected = true;
+        for (const char* target : badRequests) {
+            allRejected = allRejected && query(target, body) == 400 && contains(body, "\"error\"");
+        }
+        expect(allRejected, "queryServer bad parameters return 400", failedTests);
+        expect(query("/unknown", body) == 404 && contains(body, "\"error\"") && query("/shutdown", body) == 404,
+            "queryServer unknown path returns 404", failedTests);
+        return failedTests;
+    }
+
+    int testBoundedQueue() {
+        int failedTests = 0;
+        bool capacityChecked = false;
+        try {
+            BoundedQueue<int> odd(6);
+        }
+        catch (const std::invalid_argument&) {
+            capacityChecked = true;
+        }
+        expect(capacityChecked, "boundedQueue rejects capacity", failedTests);
+
+        BoundedQueue<int> small(2);
+        int value = 0;
+        expect(!small.tryPop(value) && small.tryPush(1) && small.tryPush(2) && !small.tryPush(3), "boundedQueue full and empty", failedTests);
+        small.close();
+        expect(small.pop(value) && value == 1 && small.pop(value) && value == 2 && !small.pop(value), "boundedQueue drains after close", failedTests);
+
+        // A small queue keeps producers and consumers wrapping around it. Every value must
+        // arrive exactly once, and each producer's values in the order it pushed them.
+        constexpr uint64_t PRODUCERS = 4;
+        constexpr uint64_t CONSUMERS = 4;
+        constexpr uint64_t PER_PRODUCER = 50000;
+        BoundedQueue<uint64_t> queue(8);
+        std::vector<std::vector<uint64_t>> received(CONSUMERS);
+        std::atomic<uint64_t> activeProducers{ PRODUCERS };
+        std::vector<std::thread> threads;
+        for (uint64_t producer = 0; producer < PRODUCERS; ++producer) {
+            threads.emplace_back([&queue, &activeProducers, producer] {
+                for (uint64_t i = 0; i < PER_PRODUCER; ++i) queue.push(producer * PER_PRODUCER + i);
+                if (activeProducers.fetch_sub(1) == 1) queue.close();
+                });
+        }
+        for (uint64_t consumer = 0; consumer < CONSUMERS; ++consumer) {
+            threads.emplace_back([&queue, &received, consumer] {
+                for (uint64_t item; queue.pop(item);) received[consumer].push_back(item);
+                });
+        }
+        for (auto& thread : threads) thread.join();
+
+        bool ordered = true;
+        std::vector<uint64_t> all;
+        for (const auto& items : received) {
+            std::vector<uint64_t> last(PRODUCERS, 0);
+            std::vector<bool> seen(PRODUCERS, false);
+            for (uint64_t item : items) {
+                const uint64_t producer = item / PER_PRODUCER;
+                ordered = ordered && (!seen[producer] || item > last[producer]);
+                seen[producer] = true;
+                last[producer] = item;
+            }
+            all.insert(all.end(), items.begin(), items.end());
+        }
+        std::sort(all.begin(), all.end());
+        bool exactlyOnce = all.size() == PRODUCERS * PER_PRODUCER;
+        for (uint64_t i = 0; exactlyOnce && i < all.size(); ++i) exactlyOnce = all[i] == i;
+        expect(exactlyOnce, "boundedQueue stress delivers each value once", failedTests);
+        expect(ordered, "boundedQueue stress keeps producer order", failedTests);
+        return failedTests;
+    }
+
+    struct PipelineTotals {
+        uint64_t rows = 0;
+        uint64_t views = 0;
+        uint64_t carts = 0;
+        uint64_t purchases = 0;
+        uint64_t priceCents = 0;
+        uint64_t prodIdSum = 0;
+        uint64_t userIdSum = 0;
+
+        void add(const ECommerceEvent& event) {
+            rows++;
+            views += event.eventType == EventType::VIEW;
+            carts += event.eventType == EventType::CART;
+            purchases += event.eventType == EventType::PURCHASE;
+            priceCents += static_cast<uint64_t>(std::llround(event.price * 100));
+            prodIdSum += event.prodId;
+            userIdSum += event.userId;
+        }
+
+        void merge(const PipelineTotals& other) {
+            rows += other.rows;
+            views += other.views;
+            carts += other.carts;
+            purchases += other.purchases;
+            priceCents += other.priceCents;
+            prodIdSum += other.prodIdSum;
+            userIdSum += other.userIdSum;
+        }
+
+        bool operator==(const PipelineTotals& other) const {
+            return rows == other.rows && views == other.views && carts == other.carts && purchases == other.purchases
+                && priceCents == other.priceCents && prodIdSum == other.prodIdSum && userIdSum == other.userIdSum;
+        }
+    };
+
+    PipelineTotals pipelinedTotals(const std::string& fileName, const PipelineOptions& options, PipelineStats& stats) {
+        std::vector<PipelineTotals> partials(getThreadCount());
+        stats = Parser().parseFilePipelined(fileName, options, [&partials](size_t consumer, const std::vector<ECommerceEvent>& batch) {
+            for (const auto& event : batch) partials[consumer].add(event);
+            });
+        PipelineTotals totals;
+        for (const auto& partial : partials) totals.merge(partial);
+        return totals;
+    }
+
+    int testPipelinedParse() {
+        int failedTests = 0;
+        GeneratorOptions generatorOptions;
+        generatorOptions.rows = 30000;
+        generatorOptions.productCount = 500;
+        generatorOptions.brandCount = 40;
+        generatorOptions.categoryCount = 30;
+        generatorOptions.userCount = 2000;
+        const std::string fileName = "self-test-pipeline.csv";
+        const bool written = DataGenerator(generatorOptions).writeCsv(fileName);
+
+        Parser parser;
+        parser.setProgressOutput(nullptr);
+        parser.parseFile(fileName);
+        PipelineTotals expected;
+        for (const auto& event : parser.getEventVector()) expected.add(event);
+
+        // Default sizes, then tiny batches through a tiny queue so that parsers and
+        // consumers wait on each other.
+        PipelineStats defaults;
+        const PipelineTotals defaultTotals = pipelinedTotals(fileName, PipelineOptions{}, defaults);
+        PipelineStats crowded;
+        const PipelineTotals crowdedTotals = pipelinedTotals(fileName, PipelineOptions{ 2, 2, 64, 2 }, crowded);
+
+        expect(written && expected.rows == generatorOptions.rows, "pipeline test input", failedTests);
+        expect(defaultTotals == expected && defaults.rows == expected.rows, "pipelined totals equal parseFile", failedTests);
+        expect(crowdedTotals == expected && crowded.rows == expected.rows && crowded.batches >= expected.rows / 64,
+            "pipelined totals with a small queue", failedTests);
+
+        // A consumer that throws stops every stage and the error is reported, not fatal.
+        std::atomic<size_t> calls{ 0 };
+        std::ostringstream errors;
+        std::streambuf* const errorBuffer = std::cerr.rdbuf(errors.rdbuf());
+        const PipelineStats failedRun = Parser().parseFilePipelined(fileName, PipelineOptions{ 2, 2, 64, 2 },
+            [&calls](size_t, const std::vector<ECommerceEvent>&) {
+                if (calls.fetch_add(1) == 2) throw std::runtime_error("consumer failure");
+            });
+        std::cerr.rdbuf(errorBuffer);
+        expect(failedRun.rows == 0 && calls.load() < expected.rows / 64 && errors.str().find("consumer failure") != std::string::npos,
+            "pipeline stops on a consumer exception", failedTests);
+        std::remove(fileName.c_str());
+        return failedTests;
+    }
+
+    bool sameState(const AggregateState& a, const AggregateState& b) {
+        const AnalysisSummary& x = a.summary();
+        const AnalysisSummary& y = b.summary();
+        const DistinctCounts distinctA = a.distinctCounts();
+        const DistinctCounts distinctB = b.distinctCounts();
+        return a.rowCount() == b.rowCount() && x.viewCount == y.viewCount && x.cartCount == y.cartCount
+            && x.purchaseCount == y.purchaseCount && std::abs(x.totalRevenue - y.totalRevenue) < 1e-9
+            && a.productStats().size() == b.productStats().size() && a.timeSeries().buckets.size() == b.timeSeries().buckets.size()
+            && distinctA.users == distinctB.users && distinctA.sessions == distinctB.sessions
+            && a.purchasePrices().count() == b.purchasePrices().count();
+    }
+
+    int testAggregateState() {
+        int failedTests = 0;
+        std::vector<ECommerceEvent> events;
+        for (uint64_t i = 0; i < 500; ++i) {
+            static const char* sessions[] = { "s1", "s2", "s3", "s4", "s5" };
+            const EventType type = i % 7 == 0 ? EventType::PURCHASE : (i % 3 == 0 ? EventType::CART : EventType::VIEW);
+            events.push_back(makeEvent(1572566400 + static_cast<int64_t>(i) * 600, type, i % 40, i % 25, sessions[i % 5], 1.0 + i % 13));
+        }
+
+        AggregateState whole;
+        whole.add(events);
+        AggregateState first;
+        AggregateState second;
+        first.add(events, 0, 200, "first.csv");
+        second.add(events, 200, events.size(), "second.csv");
+        AggregateState merged = first;
+        merged.merge(second);
+        expect(sameState(whole, merged) && whole.rowCount() == 500, "aggregateState merge equals one add", failedTests);
+        expect(merged.sources() == std::vector<std::string>{ "first.csv", "second.csv" } && whole.sources().empty(),
+            "aggregateState merged sources", failedTests);
+
+        bool rangeChecked = false;
+        try {
+            first.add(events, 400, 600);
+        }
+        catch (const std::out_of_range&) {
+            rangeChecked = true;
+        }
+        expect(rangeChecked && first.rowCount() == 200, "aggregateState rejects bad range", failedTests);
+
+        std::stringstream saved;
+        merged.save(saved);
+        AggregateState loaded;
+        expect(loaded.load(saved) && sameState(loaded, merged) && loaded.sources() == merged.sources(),
+            "aggregateState save/load round trip", failedTests);
+        std::stringstream truncated(saved.str().substr(0, saved.str().size() / 2));
+        expect(!loaded.load(truncated) && sameState(loaded, merged), "aggregateState truncated load keeps state", failedTests);
+
+        expect(AggregateState::sourceNameFor("./x.csv") == AggregateState::sourceNameFor("x.csv")
+            && AggregateState::sourceNameFor("dir/../x.csv") == AggregateState::sourceNameFor("x.csv"),
+            "aggregateState canonical source names", failedTests);
+        AggregateState named;
+        named.add(events, 0, 10, AggregateState::sourceNameFor("./x.csv"));
+        named.addSource("");
+        expect(named.hasSource(AggregateState::sourceNameFor("x.csv")) && !named.hasSource(AggregateState::sourceNameFor("y.csv"))
+            && named.sources().size() == 1, "aggregateState hasSource", failedTests);
+        return failedTests;
+    }
+
+}
+
+bool Parser::runUnitTests(std::ostream& out) {
+    out << "--- Running Unit Tests ---" << std::endl;
+
+    int failedTests = 0;
+
+    int intVal;
+    parseNumeric(intVal, "123");
+    if (intVal != 123) { std::cerr << "TEST FAILED: parseNumeric basic int" << std::endl; failedTests++; }
+    parseNumeric(intVal, "");
+    if (intVal != 0) { std::cerr << "TEST FAILED: parseNumeric empty int" << std::endl; failedTests++; }
+
+    double doubleVal;
+    parseNumeric(doubleVal, "45.67");
+    if (abs(doubleVal - 45.67) > 1e-9) { std::cerr << "TEST FAILED: parseNumeric basic double" << std::endl; failedTests++; }
+
+    if (parseEventType("view") != EventType::VIEW) { std::cerr << "TEST FAILED: parseEventType view" << std::endl; failedTests++; }
+    if (parseEventType("invalid") != EventType::UNKNOWN) { std::cerr << "TEST FAILED: parseEventType unknown" << std::endl; failedTests++; }
+
+    PurchaseTime pt;
+    parseTimestamp(pt, "2025-06-16 21:15:30 UTC");
+    if (pt.year != 2025 || pt.month != 6 || pt.day != 16 || pt.hour != 21 || pt.minute != 15 || pt.second != 30) {
+        std::cerr << "TEST FAILED: parseTimestamp" << std::endl; failedTests++;
+    }
+    if (toEpochSeconds(pt) != 1750108530) { std::cerr << "TEST FAILED: toEpochSeconds" << std::endl; failedTests++; }
+    PurchaseTime roundTrip = fromEpochSeconds(1750108530);
+    if (roundTrip.year != 2025 || roundTrip.month != 6 || roundTrip.day != 16 || roundTrip.hour != 21 || roundTrip.minute != 15 || roundTrip.second != 30) {
+        std::cerr << "TEST FAILED: fromEpochSeconds" << std::endl; failedTests++;
+    }
+
+    CategoryCode cc;
+    parseCategoryCode(cc, "electronics.smartphone.apple");
+    if (cc.code != "electronics" || cc.subcode != "smartphone" || cc.secondarySubcode != "apple") {
+        std::cerr << "TEST FAILED: parseCategoryCode full" << std::endl; failedTests++;
+    }
+    parseCategoryCode(cc, "apparel.shoes");
+    if (cc.code != "apparel" || cc.subcode != "shoes" || !cc.secondarySubcode.empty()) {
+        std::cerr << "TEST FAILED: parseCategoryCode partial" << std::endl; failedTests++;
+    }
+
+    // Test: splitFields
+    std::array<std::string_view, NUM_COLUMNS> fields;
+    if (splitFields("a,,c", cpuDispatch(), fields) != 3 || fields[0] != "a" || !fields[1].empty() || fields[2] != "c") {
+        std::cerr << "TEST FAILED: splitFields" << std::endl; failedTests++;
+    }
+
+    ECommerceEvent validEvent = { { 2019,11,1,0,0,0 }, 0, EventType::VIEW, 1,1,{},"",10.0,1,{} };
+    ECommerceEvent invalidEvent = { { 2019,11,1,0,0,0 }, 0, EventType::VIEW, 1,1,{},"",-1.0,1,{} };
+    if (!isEventValid(validEvent)) { std::cerr << "TEST FAILED: isEventValid positive case" << std::endl; failedTests++; }
+    if (isEventValid(invalidEvent)) { std::cerr << "TEST FAILED: isEventValid negative case" << std::endl; failedTests++; }
+
+    RowBitmap evens, threes;
+    for (uint32_t row = 0; row < 200000; row += 2) evens.add(row);
+    for (uint32_t row = 0; row < 200000; row += 3) threes.add(row);
+    RowBitmap sixes = evens & threes;
+    if (sixes.cardinality() != 33334 || !sixes.contains(199998) || sixes.contains(199997)) {
+        std::cerr << "TEST FAILED: RowBitmap intersect" << std::endl; failedTests++;
+    }
+    if ((evens | threes).cardinality() != 133333 || (evens - threes).cardinality() != 66666) {
+        std::cerr << "TEST FAILED: RowBitmap union/difference" << std::endl; failedTests++;
+    }
+    RowBitmap odds = RowBitmap::complement(evens, 200000);
+    if (odds.cardinality() != 100000 || !odds.contains(199999) || odds.toRows().front() != 1) {
+        std::cerr << "TEST FAILED: RowBitmap complement" << std::endl; failedTests++;
+    }
+
+    // Odd length so every kernel also runs its scalar tail; whole-dollar prices sum exactly.
+    std::vector<uint8_t> kernelTypes(100003);
+    std::vector<double> kernelPrices(kernelTypes.size());
+    for (size_t row = 0; row < kernelTypes.size(); ++row) {
+        kernelTypes[row] = static_cast<uint8_t>(row % 5);
+        kernelPrices[row] = static_cast<double>(row % 7);
+    }
+    const EventTypeCounts expectedCounts = countEventTypes(kernelTypes.data(), kernelTypes.size(), CpuLevel::SCALAR);
+    const double expectedRevenue = sumPurchaseRevenue(kernelTypes.data(), kernelPrices.data(), kernelTypes.size(), CpuLevel::SCALAR);
+    if (expectedCounts[EventType::PURCHASE] != 20000 || expectedCounts[EventType::UNKNOWN] != 20000) {
+        std::cerr << "TEST FAILED: countEventTypes scalar" << std::endl; failedTests++;
+    }
+    // Every level the CPU supports must agree with the scalar code, including the inputs
+    // its fast paths hand back to the scalar code.
+    const std::string scanText = std::string(70, 'a') + ",b" + std::string(40, 'c') + "\n";
+    for (int index = 0; index <= static_cast<int>(getSupportedCpuLevel()); ++index) {
+        const CpuLevel level = static_cast<CpuLevel>(index);
+        const CpuDispatch& cpu = cpuDispatch(level);
+        const std::string name = cpuLevelName(level);
+
+        const EventTypeCounts counts = cpu.countEventTypes(kernelTypes.data(), kernelTypes.size());
+        if (!std::equal(std::begin(counts.counts), std::end(counts.counts), std::begin(expectedCounts.counts))
+            || cpu.sumPurchaseRevenue(kernelTypes.data(), kernelPrices.data(), kernelTypes.size()) != expectedRevenue) {
+            std::cerr << "TEST FAILED: " << name << " kernels" << std::endl; failedTests++;
+        }
+        if (cpu.findByte(scanText.data(), scanText.size(), ',') != 70 || cpu.findByte(scanText.data(), scanText.size(), '\n') != 112
+            || cpu.findByte(scanText.data(), 70, ',') != std::string_view::npos || cpu.findByte(scanText.data(), 0, 'a') != std::string_view::npos) {
+            std::cerr << "TEST FAILED: " << name << " findByte" << std::endl; failedTests++;
+        }
+        PurchaseTime levelTime;
+        cpu.parseTimestamp(levelTime, "2019-11-01 00:00:09 UTC");
+        if (toEpochSeconds(levelTime) != 1572566409) { std::cerr << "TEST FAILED: " << name << " parseTimestamp" << std::endl; failedTests++; }
+        cpu.parseTimestamp(levelTime, "2019-1x-01 00:00:09 UTC");
+        if (levelTime.year != 0 || isTimeValid(levelTime)) {
+            std::cerr << "TEST FAILED: " << name << " parseTimestamp fallback" << std::endl; failedTests++;
+        }
+        uint64_t id = 1;
+        cpu.parseUint64(id, "512386086");
+        const bool digitsOk = id == 512386086;
+        cpu.parseUint64(id, "9999999999999999");
+        const bool sixteenOk = id == 9999999999999999ull;
+        cpu.parseUint64(id, "18446744073709551615");
+        const bool maxOk = id == 18446744073709551615ull;
+        cpu.parseUint64(id, "42x");
+        const bool partialOk = id == 42;
+        cpu.parseUint64(id, "-5");
+        if (!digitsOk || !sixteenOk || !maxOk || !partialOk || id != 0) {
+            std::cerr << "TEST FAILED: " << name << " parseUint64" << std::endl; failedTests++;
+        }
+    }
+
+    // Test: scheduler helpers, including a nested parallel call and a throwing task
+    const uint64_t reduced = parallelReduce(size_t{ 0 }, size_t{ 100000 }, uint64_t{ 0 },
+        [](size_t begin, size_t end) {
+            uint64_t sum = 0;
+            for (size_t i = begin; i < end; ++i) sum += i;
+            return sum;
+        },
+        [](uint64_t a, uint64_t b) { return a + b; }, 997);
+    if (reduced != 4999950000ull) { std::cerr << "TEST FAILED: parallelReduce" << std::endl; failedTests++; }
+
+    std::atomic<size_t> visited{ 0 };
+    parallelFor(0, 64, [&visited](size_t begin, size_t end) {
+        parallelChunks(end - begin, 4, [&visited](size_t, size_t innerBegin, size_t innerEnd) { visited += innerEnd - innerBegin; });
+        }, 3);
+    if (visited != 64) { std::cerr << "TEST FAILED: nested parallelFor" << std::endl; failedTests++; }
+
+    bool rethrown = false;
+    try {
+        parallelChunks(8, 8, [](size_t chunk, size_t, size_t) {
+            if (chunk == 5) throw std::runtime_error("task failure");
+            });
+    }
+    catch (const std::runtime_error&) {
+        rethrown = true;
+    }
+    if (!rethrown) { std::cerr << "TEST FAILED: task exception propagation" << std::endl; failedTests++; }
+
+    // Test: metrics registry
+    const size_t counterId = registerMetric("selfTest.counter", MetricKind::COUNTER);
+    const uint64_t before = [counterId] { return snapshotMetrics()[counterId].count; }();
+    parallelFor(0, 1000, [counterId](size_t begin, size_t end) { addCounter(counterId, end - begin); }, 10);
+    bool kindChecked = false;
+    try {
+        registerMetric("selfTest.counter", MetricKind::TIMER);
+    }
+    catch (const std::invalid_argument&) {
+        kindChecked = true;
+    }
+    if (registerMetric("selfTest.counter", MetricKind::COUNTER) != counterId || snapshotMetrics()[counterId].count != before + 1000 || !kindChecked) {
+        std::cerr << "TEST FAILED: metrics registry" << std::endl; failedTests++;
+    }
+
+    failedTests += testTopProducts();
+    failedTests += testTimestampValidation();
+    failedTests += testTimeSeries();
+    failedTests += testGroupBy();
+    failedTests += testSessionFunnel();
+    failedTests += testHyperLogLog();
+    failedTests += testQuantileSketch();
+    failedTests += testCountMinSketch();
+    failedTests += testRadixSort();
+    failedTests += testSessionExport();
+    failedTests += testEventIndex();
+    failedTests += testBitmaps();
+    failedTests += testZoneMap();
+    failedTests += testCohortRetention();
+    failedTests += testCoOccurrence();
+    failedTests += testAggregateState();
+    failedTests += testCommandLine();
+    failedTests += testScheduler();
+    failedTests += testBoundedQueue();
+    failedTests += testPipelinedParse();
+    failedTests += testQueryServer();
+
+    if (failedTests == 0) {
+        out << "All unit tests passed!" << std::endl;
+    }
+    else {
+        out << failedTests << " unit tests FAILED." << std::endl;
+    }
+    out << "--------------------------" << std::endl << std::endl;
+    return failedTests == 0;
+}
@@ -0,0 +1,128 @@
+#include "ZoneMap.h"
+#include "BinaryIO.h"
+#include "Metrics.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace {
+    const char ZONE_MAP_TAG[5] = "ZMAP";
+    constexpr uint32_t ZONE_MAP_VERSION = 1;
+}
+
+bool RangePredicate::matches(const ECommerceEvent& event) const {
+    return event.timestamp >= minTime && event.timestamp <= maxTime &&
+        event.price >= minPrice && event.price <= maxPrice &&
+        event.prodId >= minProduct && event.prodId <= maxProduct &&
+        event.userId >= minUser && event.userId <= maxUser;
+}
+
+bool RangePredicate::mayMatch(const BlockZone& zone) const {
+    return zone.maxTime >= minTime && zone.minTime <= maxTime &&
+        zone.maxPrice >= minPrice && zone.minPrice <= maxPrice &&
+        zone.maxProduct >= minProduct && zone.minProduct <= maxProduct &&
+        zone.maxUser >= minUser && zone.minUser <= maxUser;
+}
+
+bool RangePredicate::coversAll(const BlockZone& zone) const {
+    return zone.minTime >= minTime && zone.maxTime <= maxTime &&
+        zone.minPrice >= minPrice && zone.maxPrice <= maxPrice &&
+        zone.minProduct >= minProduct && zone.maxProduct <= maxProduct &&
+        zone.minUser >= minUser && zone.maxUser <= maxUser;
+}
+
+void ZoneMap::build(const std::vector<ECommerceEvent>& events, size_t blockRows) {
+    METRIC_TIMER("zoneMap.build");
+    this->blockRows = std::max<size_t>(1, blockRows);
+    rowCount = events.size();
+    const size_t count = (rowCount + this->blockRows - 1) / this->blockRows;
+    zones.assign(count, BlockZone{});
+
+    parallelChunks(count, getThreadCount(), [&](size_t, size_t begin, size_t end) {
+        for (size_t block = begin; block < end; ++block) {
+            const size_t first = block * this->blockRows;
+            const size_t last = std::min(rowCount, first + this->blockRows);
+            BlockZone zone{ events[first].timestamp, events[first].timestamp,
+                events[first].price, events[first].price,
+                events[first].prodId, events[first].prodId,
+                events[first].userId, events[first].userId };
+            for (size_t row = first + 1; row < last; ++row) {
+                const ECommerceEvent& event = events[row];
+                zone.minTime = std::min(zone.minTime, event.timestamp);
+                zone.maxTime = std::max(zone.maxTime, event.timestamp);
+                zone.minPrice = std::min(zone.minPrice, event.price);
+                zone.maxPrice = std::max(zone.maxPrice, event.price);
+                zone.minProduct = std::min(zone.minProduct, event.prodId);
+                zone.maxProduct = std::max(zone.maxProduct, event.prodId);
+                zone.minUser = std::min(zone.minUser, event.userId);
+                zone.maxUser = std::max(zone.maxUser, event.userId);
+            }
+            zones[block] = zone;
+        }
+        });
+}
+
+std::vector<size_t> ZoneMap::candidateBlocks(const RangePredicate& predicate) const {
+    std::vector<size_t> blocks;
+    for (size_t block = 0; block < zones.size(); ++block) {
+        if (predicate.mayMatch(zones[block])) {
+            blocks.push_back(block);
+        }
+    }
+    return blocks;
+}
+
+int64_t ZoneMap::minTime() const {
+    int64_t earliest = std::numeric_limits<int64_t>::max();
+    for (const auto& zone : zones) {
+        earliest = std::min(earliest, zone.minTime);
+    }
+    return earliest;
+}
+
+void ZoneMap::save(std::ostream& out) const {
+    writeHeader(out, ZONE_MAP_TAG, ZONE_MAP_VERSION);
+    writeValue(out, static_cast<uint64_t>(blockRows));
+    writeValue(out, static_cast<uint64_t>(rowCount));
+    writeVector(out, zones);
+}
+
+bool ZoneMap::load(std::istream& in) {
+    uint64_t storedBlockRows = 0;
+    uint64_t storedRowCount = 0;
+    std::vector<BlockZone> storedZones;
+    if (!readHeader(in, ZONE_MAP_TAG, ZONE_MAP_VERSION) ||
+        !readValue(in, storedBlockRows) ||
+        !readValue(in, storedRowCount) ||
+        !readVector(in, storedZones)) {
+        return false;
+    }
+    if (storedBlockRows == 0 || storedZones.size() != (storedRowCount + storedBlockRows - 1) / storedBlockRows) {
+        return false;
+    }
+    blockRows = static_cast<size_t>(storedBlockRows);
+    rowCount = static_cast<size_t>(storedRowCount);
+    zones = std::move(storedZones);
+    return true;
+}
+
+bool ZoneMap::saveToFile(const std::string& fileName) const {
+    std::ofstream out(fileName, std::ios::binary);
+    save(out);
+    if (!out) {
+        std::cerr << "Zone map error: could not write " << fileName << "." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ZoneMap::loadFromFile(const std::string& fileName) {
+    std::ifstream in(fileName, std::ios::binary);
+    if (!in || !load(in)) {
+        std::cerr << "Zone map error: could not read " << fileName << "." << std::endl;
+        return false;
+    }
+    return true;
+}
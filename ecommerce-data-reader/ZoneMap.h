@@ -0,0 +1,68 @@
+#pragma once
+#include "DataStructure.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Min/max metadata of one fixed-size block of consecutive rows.
+struct BlockZone {
+    int64_t minTime;
+    int64_t maxTime;
+    double minPrice;
+    double maxPrice;
+    uint64_t minProduct;
+    uint64_t maxProduct;
+    uint64_t minUser;
+    uint64_t maxUser;
+};
+
+// Inclusive range filter on the zone-mapped columns; the defaults match every row.
+struct RangePredicate {
+    int64_t minTime = std::numeric_limits<int64_t>::min();
+    int64_t maxTime = std::numeric_limits<int64_t>::max();
+    double minPrice = -std::numeric_limits<double>::infinity();
+    double maxPrice = std::numeric_limits<double>::infinity();
+    uint64_t minProduct = 0;
+    uint64_t maxProduct = std::numeric_limits<uint64_t>::max();
+    uint64_t minUser = 0;
+    uint64_t maxUser = std::numeric_limits<uint64_t>::max();
+
+    bool matches(const ECommerceEvent& event) const;
+    // False when no row of the block can match, so the block can be skipped.
+    bool mayMatch(const BlockZone& zone) const;
+    // True when every row of the block matches, so per-row checks can be skipped.
+    bool coversAll(const BlockZone& zone) const;
+};
+
+// Per-block zone maps over the event vector. The CSV exports are roughly time-ordered,
+// so a narrow time range touches only a handful of blocks.
+class ZoneMap {
+public:
+    static constexpr size_t DEFAULT_BLOCK_ROWS = 64 * 1024;
+
+    void build(const std::vector<ECommerceEvent>& events, size_t blockRows = DEFAULT_BLOCK_ROWS);
+
+    std::vector<size_t> candidateBlocks(const RangePredicate& predicate) const;
+    // Earliest timestamp of any row, from the block zones alone; INT64_MAX without rows.
+    int64_t minTime() const;
+
+    size_t getBlockRows() const { return blockRows; }
+    size_t getRowCount() const { return rowCount; }
+    size_t blockCount() const { return zones.size(); }
+    const BlockZone& zone(size_t block) const { return zones[block]; }
+
+    void save(std::ostream& out) const;
+    bool load(std::istream& in);
+    bool saveToFile(const std::string& fileName) const;
+    bool loadFromFile(const std::string& fileName);
+
+private:
+    size_t blockRows = DEFAULT_BLOCK_ROWS;
+    size_t rowCount = 0;
+    std::vector<BlockZone> zones;
+};
@@ -1,6 +1,15 @@
 #include "Parser.h"
+#include "AggregateState.h"
 #include "Analyzer.h"
+#include "CommandLine.h"
+#include "CpuDispatch.h"
 #include "DataStructure.h"
+#include "JsonReport.h"
+#include "JsonWriter.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include "PerfCounters.h"
+#include "QueryServer.h"
 
 #include <iostream>
 #include <chrono>
@@ -8,6 +17,8 @@
 #include <vector>
 #include <algorithm>
 #include <iomanip>
+#include <cstdio>
+#include <fstream>
 
 void printSummary(const AnalysisSummary& summary) {
     std::cout << "--- Analysis Summary ---" << std::endl;
@@ -20,86 +31,868 @@ void printSummary(const AnalysisSummary& summary) {
     std::cout << "--------------------------" << std::endl;
 }
 
-void printTopProducts(const ProductStatsMap& stats, size_t topN) {
-    std::cout << "\n--- Top " << topN << " Products by Purchase-to-View Rate ---" << std::endl;
-
-    std::vector<std::pair<double, uint64_t>> productsByRate;
-    for (const auto& pair : stats) {
-        uint64_t productId = pair.first;
-        size_t views = pair.second.first;
-        size_t purchases = pair.second.second;
-
-        if (views > 100 && purchases > 10) { // Only consider products with significant activity
-            double conversionRate = static_cast<double>(purchases) / views * 100.0;
-            productsByRate.push_back({ conversionRate, productId });
-        }
+const char* rankMetricLabel(RankMetric metric) {
+    switch (metric) {
+    case RankMetric::CONVERSION_RATE: return "Purchase-to-View Rate";
+    case RankMetric::PURCHASES: return "Purchases";
+    case RankMetric::REVENUE: return "Revenue";
     }
+    return "";
+}
 
-    // Sort products by conversion rate in descending order
-    std::sort(productsByRate.rbegin(), productsByRate.rend());
+void printTopProducts(const std::vector<RankedProduct>& topProducts, const TopKOptions& options) {
+    std::cout << "\n--- Top " << options.k << " Products by " << rankMetricLabel(options.metric) << " ---" << std::endl;
 
     std::cout << std::left << std::setw(15) << "Product ID"
         << std::setw(15) << "Views"
         << std::setw(15) << "Purchases"
+        << std::setw(15) << "Revenue"
         << std::setw(15) << "Conv. Rate (%)" << std::endl;
-    std::cout << "------------------------------------------------------------" << std::endl;
+    std::cout << "---------------------------------------------------------------------------" << std::endl;
+
+    for (const auto& product : topProducts) {
+        const ProductStats& productStats = product.stats;
+        double conversionRate = productStats.viewCount == 0 ? 0.0
+            : static_cast<double>(productStats.purchaseCount) / productStats.viewCount * 100.0;
+        std::cout << std::left << std::setw(15) << product.prodId
+            << std::setw(15) << productStats.viewCount
+            << std::setw(15) << productStats.purchaseCount
+            << std::fixed << std::setprecision(2) << std::setw(15) << productStats.revenue
+            << std::setprecision(4) << conversionRate << "%" << std::endl;
+    }
+    std::cout << "---------------------------------------------------------------------------" << std::endl;
+}
+
+void printDistinctCounts(const DistinctCounts& counts) {
+    std::cout << "\n--- Distinct Counts (HyperLogLog estimates) ---" << std::endl;
+    std::cout << std::fixed << std::setprecision(0);
+    std::cout << "  Unique Users:    ~" << counts.users << std::endl;
+    std::cout << "  Unique Sessions: ~" << counts.sessions << std::endl;
+    std::cout << "--------------------------" << std::endl;
+}
+
+constexpr size_t PRICE_BRAND_ROWS = 10;
+
+// Groups with the most purchases first, at most `limit` of them.
+void printPriceQuantileTable(const char* label, const std::unordered_map<std::string_view, PriceQuantiles>& quantiles, size_t limit) {
+    std::cout << std::left << std::setw(25) << label
+        << std::setw(12) << "Purchases"
+        << std::setw(12) << "p50"
+        << std::setw(12) << "p90"
+        << "p99" << std::endl;
+    std::cout << "--------------------------------------------------------------------" << std::endl;
+
+    std::vector<std::pair<std::string_view, PriceQuantiles>> rows(quantiles.begin(), quantiles.end());
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+        return a.second.purchaseCount > b.second.purchaseCount;
+        });
+    rows.resize(std::min(rows.size(), limit));
+    for (const auto& row : rows) {
+        std::cout << std::left << std::setw(25) << (row.first.empty() ? std::string_view("(none)") : row.first)
+            << std::setw(12) << row.second.purchaseCount
+            << std::fixed << std::setprecision(2)
+            << std::setw(12) << row.second.p50
+            << std::setw(12) << row.second.p90
+            << row.second.p99 << std::endl;
+    }
+    std::cout << "--------------------------------------------------------------------" << std::endl;
+}
+
+void printPriceQuantiles(const std::unordered_map<std::string_view, PriceQuantiles>& categoryPrices,
+    const std::unordered_map<std::string_view, PriceQuantiles>& brandPrices) {
+    std::cout << "\n--- Purchase Price Percentiles ---" << std::endl;
+    printPriceQuantileTable("Category", categoryPrices, categoryPrices.size());
+    printPriceQuantileTable("Brand", brandPrices, PRICE_BRAND_ROWS);
+}
+
+void printHeavyHitterList(const char* title, const std::vector<std::pair<uint64_t, uint64_t>>& entries) {
+    std::cout << "  " << title << ":" << std::endl;
+    for (const auto& entry : entries) {
+        std::cout << "    " << std::left << std::setw(15) << entry.first << "~" << entry.second << std::endl;
+    }
+}
+
+void printHeavyHitters(const HeavyHitterReport& report) {
+    std::cout << "\n--- Heavy Hitters (Count-Min estimates) ---" << std::endl;
+    printHeavyHitterList("Most viewed products", report.topViewedProducts);
+    printHeavyHitterList("Most carted products", report.topCartedProducts);
+    printHeavyHitterList("Most purchased products", report.topPurchasedProducts);
+    printHeavyHitterList("Most active users", report.mostActiveUsers);
+    std::cout << "--------------------------" << std::endl;
+}
+
+struct DrillDown {
+    uint64_t prodId = 0;
+    size_t rows = 0;
+    double micros = 0.0;
+    AnalysisSummary summary;
+};
+
+DrillDown runProductDrillDown(Analyzer& analyzer, const std::vector<ECommerceEvent>& events, const EventIndex& index, uint64_t prodId) {
+    auto start = std::chrono::high_resolution_clock::now();
+    RowRange rows = index.rowsForProduct(prodId);
+    AnalysisSummary summary = analyzer.getSummary(events, rows);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::micro> duration = end - start;
+    return { prodId, rows.size(), duration.count(), summary };
+}
+
+void printProductDrillDown(const DrillDown& drillDown) {
+    const AnalysisSummary& summary = drillDown.summary;
+    std::cout << "\n--- Drill-down: Product " << drillDown.prodId << " (" << drillDown.rows << " events, "
+        << std::fixed << std::setprecision(1) << drillDown.micros << " us) ---" << std::endl;
+    std::cout << std::setprecision(2);
+    std::cout << "  Views: " << summary.viewCount << "  Carts: " << summary.cartCount
+        << "  Removes: " << summary.removeCount << "  Purchases: " << summary.purchaseCount
+        << "  Revenue: $" << summary.totalRevenue << std::endl;
+    std::cout << "--------------------------" << std::endl;
+}
+
+struct BitmapFilter {
+    std::string_view category;
+    size_t rows = 0;
+    double millis = 0.0;
+    AnalysisSummary summary;
+};
+
+BitmapFilter runBitmapFilter(Analyzer& analyzer, const std::vector<ECommerceEvent>& events, const BitmapIndex& bitmaps,
+    EventType type, std::string_view category) {
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<uint32_t> selection = (bitmaps.eventType(type) & bitmaps.topCategory(category)).toRows();
+    AnalysisSummary summary = analyzer.getSummary(events, selection);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> duration = end - start;
+    return { category, selection.size(), duration.count(), summary };
+}
+
+void printFilteredSummary(const BitmapFilter& filter) {
+    std::cout << "\n--- Bitmap Filter: purchases in '" << filter.category << "' (" << filter.rows << " rows, "
+        << std::fixed << std::setprecision(3) << filter.millis << " ms) ---" << std::endl;
+    std::cout << std::setprecision(2) << "  Revenue: $" << filter.summary.totalRevenue << std::endl;
+    std::cout << "--------------------------" << std::endl;
+}
+
+struct DayRange {
+    int64_t dayStart = 0;
+    size_t blocksScanned = 0;
+    size_t blockCount = 0;
+    double millis = 0.0;
+    AnalysisSummary summary;
+};
+
+DayRange runDayRange(Analyzer& analyzer, const std::vector<ECommerceEvent>& events, const ZoneMap& zones, int64_t dayStart) {
+    RangePredicate predicate;
+    predicate.minTime = dayStart;
+    predicate.maxTime = dayStart + 24 * 60 * 60 - 1;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    AnalysisSummary summary = analyzer.getSummary(events, zones, predicate);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> duration = end - start;
+    return { dayStart, zones.candidateBlocks(predicate).size(), zones.blockCount(), duration.count(), summary };
+}
+
+void printDayRangeSummary(const DayRange& range) {
+    const AnalysisSummary& summary = range.summary;
+    std::cout << "\n--- Zone-Mapped Range: " << formatTimestamp(range.dayStart).substr(0, 10) << " ("
+        << range.blocksScanned << " of " << range.blockCount << " blocks scanned, "
+        << std::fixed << std::setprecision(3) << range.millis << " ms) ---" << std::endl;
+    std::cout << std::setprecision(2);
+    std::cout << "  Views: " << summary.viewCount << "  Purchases: " << summary.purchaseCount
+        << "  Revenue: $" << summary.totalRevenue << std::endl;
+    std::cout << "--------------------------" << std::endl;
+}
+
+constexpr int KERNEL_BENCHMARK_RUNS = 5;
+
+struct KernelTiming {
+    const char* label = "";
+    // Bytes each variant has to stream per row.
+    double bytesPerRow = 0.0;
+    double seconds = 0.0;
+    double revenue = 0.0;
+};
+
+// Single-threaded comparison of the event-type switch loop with each supported kernel
+// level. Bytes per row are whole events for the switch loop, one type byte plus one price
+// for the column kernels.
+std::vector<KernelTiming> runKernelBenchmark(Analyzer& analyzer, const std::vector<ECommerceEvent>& events, const EventColumns& columns) {
+    std::vector<KernelTiming> timings;
+    // Best of several runs, so the first run's page faults do not count.
+    auto bestOf = [](auto&& fn) {
+        double best = 0.0;
+        for (int run = 0; run < KERNEL_BENCHMARK_RUNS; ++run) {
+            auto start = std::chrono::high_resolution_clock::now();
+            fn();
+            std::chrono::duration<double> duration = std::chrono::high_resolution_clock::now() - start;
+            if (run == 0 || duration.count() < best) best = duration.count();
+        }
+        return best;
+    };
+
+    AnalysisSummary switchSummary;
+    double seconds = bestOf([&]() { switchSummary = analyzer.getSummary(events); });
+    timings.push_back({ "switch loop", sizeof(ECommerceEvent), seconds, switchSummary.totalRevenue });
+
+    // SSE4.2 has no kernels of its own, so it would only repeat the scalar numbers.
+    for (CpuLevel level : { CpuLevel::SCALAR, CpuLevel::AVX2, CpuLevel::AVX512 }) {
+        if (level > getSupportedCpuLevel()) break;
+        const CpuDispatch& cpu = cpuDispatch(level);
+        EventTypeCounts counts;
+        double revenue = 0.0;
+        seconds = bestOf([&]() {
+            counts = cpu.countEventTypes(columns.eventTypes.data(), columns.size());
+            revenue = cpu.sumPurchaseRevenue(columns.eventTypes.data(), columns.prices.data(), columns.size());
+            });
+        if (counts[EventType::VIEW] != switchSummary.viewCount || counts[EventType::PURCHASE] != switchSummary.purchaseCount) {
+            std::cerr << "Kernel mismatch at level " << cpuLevelName(level) << std::endl;
+        }
+        timings.push_back({ cpuLevelName(level), sizeof(uint8_t) + sizeof(double), seconds, revenue });
+    }
+    return timings;
+}
+
+void printKernelBenchmark(const std::vector<KernelTiming>& timings, size_t rowCount) {
+    const double rows = static_cast<double>(rowCount);
+    std::cout << "\n--- Event Type Kernels (" << rowCount << " rows, 1 thread, best of " << KERNEL_BENCHMARK_RUNS << ") ---" << std::endl;
+    for (const auto& timing : timings) {
+        const double seconds = timing.seconds;
+        std::cout << "  " << std::left << std::setw(12) << timing.label << std::right << std::fixed << std::setprecision(3)
+            << std::setw(9) << seconds * 1000.0 << " ms" << std::setprecision(1)
+            << std::setw(9) << (seconds > 0.0 ? rows / seconds / 1'000'000.0 : 0.0) << " M rows/s"
+            << std::setprecision(2) << std::setw(8) << (seconds > 0.0 ? rows * timing.bytesPerRow / seconds / 1e9 : 0.0) << " GB/s"
+            << "  revenue $" << timing.revenue << std::endl;
+    }
+    std::cout << "  Active level: " << cpuLevelName(getCpuLevel()) << std::endl;
+    std::cout << "--------------------------" << std::endl;
+}
+
+void printTimeSeries(const TimeSeries& series) {
+    std::cout << "\n--- Time Series (" << series.bucketSeconds << "s buckets, " << series.buckets.size() << " with events) ---" << std::endl;
+    std::cout << std::left << std::setw(20) << "Bucket Start"
+        << std::setw(12) << "Views"
+        << std::setw(12) << "Carts"
+        << std::setw(12) << "Purchases"
+        << std::setw(16) << "Revenue"
+        << "Conv. Rate (%)" << std::endl;
+    std::cout << "---------------------------------------------------------------------------------------" << std::endl;
+
+    for (size_t i = 0; i < series.buckets.size(); ++i) {
+        const AnalysisSummary& bucket = series.buckets[i];
+        double conversionRate = bucket.viewCount == 0 ? 0.0
+            : static_cast<double>(bucket.purchaseCount) / bucket.viewCount * 100.0;
+        // Seconds are only shown for buckets that do not start on a minute.
+        std::cout << std::left << std::setw(20) << formatTimestamp(series.bucketStarts[i]).substr(0, series.bucketSeconds % 60 == 0 ? 16 : 19)
+            << std::setw(12) << bucket.viewCount
+            << std::setw(12) << bucket.cartCount
+            << std::setw(12) << bucket.purchaseCount
+            << std::fixed << std::setprecision(2) << std::setw(16) << bucket.totalRevenue
+            << std::setprecision(4) << conversionRate << std::endl;
+    }
+    std::cout << "---------------------------------------------------------------------------------------" << std::endl;
+}
+
+struct SessionOverview {
+    size_t sessions = 0;
+    size_t converted = 0;
+    double averageDurationSeconds = 0.0;
+    double averageEvents = 0.0;
+};
+
+SessionOverview summarizeSessions(const std::vector<SessionRecord>& sessions) {
+    SessionOverview overview;
+    double totalDuration = 0.0;
+    double totalEvents = 0.0;
+    for (const auto& session : sessions) {
+        overview.converted += session.converted ? 1 : 0;
+        totalDuration += static_cast<double>(session.durationSeconds());
+        totalEvents += static_cast<double>(session.viewCount + session.cartCount + session.removeCount + session.purchaseCount);
+    }
+    const double sessionCount = sessions.empty() ? 1.0 : static_cast<double>(sessions.size());
+    overview.sessions = sessions.size();
+    overview.averageDurationSeconds = totalDuration / sessionCount;
+    overview.averageEvents = totalEvents / sessionCount;
+    return overview;
+}
+
+void printSessionOverview(const SessionOverview& overview) {
+    const double sessionCount = overview.sessions == 0 ? 1.0 : static_cast<double>(overview.sessions);
+    std::cout << "\n--- Sessions ---" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "  Sessions:              " << overview.sessions << std::endl;
+    std::cout << "  Avg Duration (s):      " << overview.averageDurationSeconds << std::endl;
+    std::cout << "  Avg Events/Session:    " << overview.averageEvents << std::endl;
+    std::cout << "  Converted Sessions:    " << overview.converted << " (" << overview.converted / sessionCount * 100.0 << "%)" << std::endl;
+    std::cout << "--------------------------" << std::endl;
+}
+
+void printCohortRetention(const CohortRetention& retention) {
+    std::cout << "\n--- Purchase Cohorts (share of cohort purchasing N months later) ---" << std::endl;
+    if (retention.activeUsers.empty()) {
+        std::cout << "  No purchases." << std::endl;
+        std::cout << "--------------------------" << std::endl;
+        return;
+    }
+    const size_t monthCount = retention.activeUsers.size();
+    std::cout << std::left << std::setw(10) << "Cohort" << std::setw(10) << "Users";
+    for (size_t monthsLater = 0; monthsLater < monthCount; ++monthsLater) {
+        std::cout << std::setw(9) << ("M+" + std::to_string(monthsLater));
+    }
+    std::cout << std::endl << std::string(20 + 9 * monthCount, '-') << std::endl;
+
+    char label[16];
+    for (size_t cohort = 0; cohort < monthCount; ++cohort) {
+        const int month = retention.firstYear * 12 + retention.firstMonth - 1 + static_cast<int>(cohort);
+        std::snprintf(label, sizeof(label), "%04d-%02d", month / 12, month % 12 + 1);
+        std::cout << std::left << std::setw(10) << label << std::setw(10) << retention.cohortSize(cohort);
+        for (size_t monthsLater = 0; monthsLater < retention.activeUsers[cohort].size(); ++monthsLater) {
+            std::snprintf(label, sizeof(label), "%.1f%%", retention.retentionRate(cohort, monthsLater) * 100.0);
+            std::cout << std::setw(9) << label;
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::right << "--------------------------" << std::endl;
+}
+
+void printCoOccurrence(const CoOccurrenceReport& report, const std::vector<uint64_t>& products) {
+    std::cout << "\n--- Carted or Bought Together (" << report.sessionCount << " sessions, "
+        << report.cappedSessions << " capped, " << report.distinctPairs << " distinct pairs) ---" << std::endl;
+    for (uint64_t prodId : products) {
+        auto it = report.partners.find(prodId);
+        std::cout << "  " << prodId << ":";
+        if (it == report.partners.end()) {
+            std::cout << " (no frequent partners)";
+        }
+        else {
+            for (const auto& partner : it->second) {
+                std::cout << "  " << partner.prodId << " (" << partner.sessions << ")";
+            }
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "--------------------------" << std::endl;
+}
+
+void printFunnelRow(const std::string_view& label, const FunnelStats& stats) {
+    std::cout << std::left << std::setw(25) << (label.empty() ? std::string_view("(none)") : label)
+        << std::setw(12) << stats.sessionCount
+        << std::setw(12) << stats.viewSessions
+        << std::setw(12) << stats.cartSessions
+        << std::setw(12) << stats.purchaseSessions
+        << std::fixed << std::setprecision(4)
+        << std::setw(14) << stats.viewToCartDropOff
+        << std::setw(14) << stats.cartToPurchaseDropOff
+        << std::setprecision(0)
+        << std::setw(14) << stats.medianViewToCartSeconds
+        << stats.medianCartToPurchaseSeconds << std::endl;
+}
+
+constexpr size_t FUNNEL_BRAND_ROWS = 10;
 
-    size_t count = 0;
-    for (const auto& product : productsByRate) {
-        if (count >= topN) break;
-        uint64_t productId = product.second;
-        const auto& productStats = stats.at(productId);
-        std::cout << std::left << std::setw(15) << productId
-            << std::setw(15) << productStats.first
-            << std::setw(15) << productStats.second
-            << std::fixed << std::setprecision(4) << product.first << "%" << std::endl;
-        count++;
+void printFunnelHeader(const char* label) {
+    std::cout << std::left << std::setw(25) << label
+        << std::setw(12) << "Sessions"
+        << std::setw(12) << "Viewed"
+        << std::setw(12) << "Carted"
+        << std::setw(12) << "Purchased"
+        << std::setw(14) << "View Drop"
+        << std::setw(14) << "Cart Drop"
+        << std::setw(14) << "Med V->C (s)"
+        << "Med C->P (s)" << std::endl;
+    std::cout << "----------------------------------------------------------------------------------------------------------------------" << std::endl;
+}
+
+// Groups with the most sessions first, at most `limit` of them.
+void printFunnelGroups(const std::unordered_map<std::string_view, FunnelStats>& groups, size_t limit) {
+    std::vector<std::pair<std::string_view, FunnelStats>> rows(groups.begin(), groups.end());
+    std::sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+        return a.second.sessionCount > b.second.sessionCount;
+        });
+    rows.resize(std::min(rows.size(), limit));
+    for (const auto& row : rows) {
+        printFunnelRow(row.first, row.second);
+    }
+}
+
+void printFunnel(const FunnelReport& report) {
+    std::cout << "\n--- Session Funnel (view -> cart -> purchase) ---" << std::endl;
+    printFunnelHeader("Entry Category");
+    printFunnelRow("All sessions", report.overall);
+    printFunnelGroups(report.byCategory, report.byCategory.size());
+    std::cout << "----------------------------------------------------------------------------------------------------------------------" << std::endl;
+    printFunnelHeader("Entry Brand");
+    printFunnelGroups(report.byBrand, FUNNEL_BRAND_ROWS);
+    std::cout << "----------------------------------------------------------------------------------------------------------------------" << std::endl;
+}
+
+// The rows one input file contributed to the parsed events.
+struct ParsedInput {
+    std::string sourceName;
+    size_t firstRow = 0;
+    size_t endRow = 0;
+};
+
+// What one run changed in the saved aggregate state.
+struct StateUpdate {
+    uint64_t loadedRows = 0;
+    uint64_t addedRows = 0;
+    double addMillis = 0.0;
+    std::vector<std::string> skippedSources;
+};
+
+// Starts from the saved state when the file exists.
+bool loadAggregateState(const std::string& statePath, AggregateState& state) {
+    return !std::ifstream(statePath, std::ios::binary) || state.loadFromFile(statePath);
+}
+
+void printAggregateState(const std::string& statePath, const AggregateState& state, const StateUpdate& update,
+    int64_t bucketSeconds, std::ostream& out) {
+    out << "\n--- Aggregate State (" << statePath << ") ---" << std::endl;
+    out << "  Inputs: " << state.sources().size() << "  Rows: " << state.rowCount()
+        << " (" << update.loadedRows << " loaded, " << update.addedRows << " added in "
+        << std::fixed << std::setprecision(3) << update.addMillis << " ms)" << std::endl;
+    for (const auto& sourceName : update.skippedSources) {
+        out << "  Skipped " << sourceName << ": already included" << std::endl;
     }
-    std::cout << "------------------------------------------------------------" << std::endl;
+
+    const AnalysisSummary& summary = state.summary();
+    const DistinctCounts distinct = state.distinctCounts();
+    // The series width is rounded up to a multiple of the width the state was built with.
+    const int64_t stateBucketSeconds = state.getBucketSeconds();
+    const TimeSeries series = state.timeSeries((bucketSeconds + stateBucketSeconds - 1) / stateBucketSeconds * stateBucketSeconds);
+    out << std::fixed << std::setprecision(2);
+    out << "  Revenue: $" << summary.totalRevenue << "  Purchases: " << summary.purchaseCount
+        << "  Products: " << state.productStats().size() << "  Active " << series.bucketSeconds << "s buckets: " << series.buckets.size() << std::endl;
+    out << std::setprecision(0) << "  Users: ~" << distinct.users << "  Sessions: ~" << distinct.sessions
+        << std::setprecision(2) << "  Median purchase: $" << state.purchasePrices().quantile(0.5) << std::endl;
+    out << "--------------------------" << std::endl;
 }
 
+// Folds each input file into the saved state unless the state already includes it. A
+// file that yielded no rows, for example because it could not be read, is not recorded,
+// so a later run picks it up.
+bool updateAggregateState(const std::string& statePath, const std::vector<ECommerceEvent>& events, const std::vector<ParsedInput>& inputs,
+    int64_t bucketSeconds, std::ostream& out) {
+    AggregateState state;
+    if (!loadAggregateState(statePath, state)) {
+        return false;
+    }
+    StateUpdate update;
+    update.loadedRows = state.rowCount();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const auto& input : inputs) {
+        if (state.hasSource(input.sourceName)) {
+            update.skippedSources.push_back(input.sourceName);
+        }
+        else if (input.endRow > input.firstRow) {
+            state.add(events, input.firstRow, input.endRow, input.sourceName);
+            update.addedRows += input.endRow - input.firstRow;
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    update.addMillis = std::chrono::duration<double, std::milli>(end - start).count();
+
+    printAggregateState(statePath, state, update, bucketSeconds, out);
+    return update.addedRows == 0 || state.saveToFile(statePath);
+}
+
+// Parses and aggregates concurrently: parser threads stream event batches to consumer
+// threads that each fold them into their own aggregate state. Returns the merged state.
+AggregateState runPipeline(const std::string& filePath, std::ostream& out) {
+    PipelineOptions options;
+    Parser parser;
+    std::vector<AggregateState> partials(std::max<size_t>(1, getThreadCount()));
+
+    out << "--- Pipelined Parse + Aggregate ---" << std::endl;
+    out << "Processing file: " << filePath << std::endl;
+    const PipelineStats stats = parser.parseFilePipelined(filePath, options, [&partials](size_t consumer, const std::vector<ECommerceEvent>& batch) {
+        for (const auto& event : batch) {
+            partials[consumer].add(event);
+        }
+        });
+
+    AggregateState state;
+    for (const auto& partial : partials) {
+        state.merge(partial);
+    }
+    const AnalysisSummary& summary = state.summary();
+    const DistinctCounts distinct = state.distinctCounts();
+    out << std::fixed << std::setprecision(3);
+    out << "  Rows: " << stats.rows << " in " << stats.batches << " batches, "
+        << stats.parserThreads << " parser and " << stats.consumerThreads << " consumer threads" << std::endl;
+    out << "  Parse busy: " << stats.parseSeconds << " s  Aggregate busy: " << stats.consumeSeconds
+        << " s  Sum: " << stats.parseSeconds + stats.consumeSeconds << " s  Wall: " << stats.wallSeconds << " s" << std::endl;
+    out << std::setprecision(2) << "  Revenue: $" << summary.totalRevenue << "  Purchases: " << summary.purchaseCount
+        << "  Products: " << state.productStats().size() << std::endl;
+    out << std::setprecision(0) << "  Users: ~" << distinct.users << "  Sessions: ~" << distinct.sessions << std::endl;
+    out << "-----------------------------------" << std::endl;
+    return state;
+}
+
+// With a state file, inputs the state already includes are not even parsed.
+bool runPipelines(const CommandLineOptions& options, PerfCounters& perf, std::ostream& out) {
+    const bool useState = !options.statePath.empty();
+    AggregateState state;
+    if (useState && !loadAggregateState(options.statePath, state)) {
+        return false;
+    }
+    StateUpdate update;
+    update.loadedRows = state.rowCount();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const auto& filePath : options.inputFiles) {
+        const std::string sourceName = AggregateState::sourceNameFor(filePath);
+        if (useState && state.hasSource(sourceName)) {
+            update.skippedSources.push_back(sourceName);
+            continue;
+        }
+        PerfStage stage(perf, "pipeline");
+        const AggregateState fileState = runPipeline(filePath, out);
+        stage.setRows(fileState.rowCount());
+        if (useState && fileState.rowCount() > 0) {
+            state.merge(fileState);
+            state.addSource(sourceName);
+            update.addedRows += fileState.rowCount();
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    update.addMillis = std::chrono::duration<double, std::milli>(end - start).count();
+
+    if (!useState) return true;
+    printAggregateState(options.statePath, state, update, options.bucketSeconds, out);
+    return update.addedRows == 0 || state.saveToFile(options.statePath);
+}
+
+// Everything one run computed; only the selected analyses are filled in.
+struct RunReport {
+    size_t rows = 0;
+    double parseSeconds = 0.0;
+    double analysisSeconds = 0.0;
+    AnalysisSummary summary;
+    TopKOptions topOptions;
+    std::vector<RankedProduct> topProducts;
+    bool hasDrillDown = false;
+    DrillDown drillDown;
+    DistinctCounts distinctCounts;
+    bool hasDayRange = false;
+    DayRange dayRange;
+    BitmapFilter bitmapFilter;
+    std::vector<KernelTiming> kernelTimings;
+    HeavyHitterReport heavyHitters;
+    std::unordered_map<std::string_view, PriceQuantiles> categoryPrices;
+    std::unordered_map<std::string_view, PriceQuantiles> brandPrices;
+    TimeSeries dailySeries;
+    FunnelReport funnel;
+    SessionOverview sessions;
+    CohortRetention cohorts;
+    CoOccurrenceReport coOccurrence;
+};
+
+constexpr size_t CO_OCCURRENCE_PRODUCTS = 3;
+
+// Partners are reported for the three best-ranked products. Without a ranking, when
+// co-occurrence runs without top products or drill-down, they are reported for the three
+// products with the most partner sessions, ties going to the smaller product id.
+std::vector<uint64_t> coOccurrenceProducts(const RunReport& report) {
+    std::vector<uint64_t> products;
+    if (!report.topProducts.empty()) {
+        for (size_t i = 0; i < std::min(CO_OCCURRENCE_PRODUCTS, report.topProducts.size()); ++i) {
+            products.push_back(report.topProducts[i].prodId);
+        }
+        return products;
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> strongest;
+    for (const auto& entry : report.coOccurrence.partners) {
+        uint64_t sessions = 0;
+        for (const auto& partner : entry.second) sessions += partner.sessions;
+        strongest.emplace_back(sessions, entry.first);
+    }
+    const size_t count = std::min(CO_OCCURRENCE_PRODUCTS, strongest.size());
+    std::partial_sort(strongest.begin(), strongest.begin() + count, strongest.end(), [](const auto& a, const auto& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+    for (size_t i = 0; i < count; ++i) products.push_back(strongest[i].second);
+    return products;
+}
+
+// Text report in the order the analyses have always been printed. Co-occurrence comes
+// last, after the aggregate state, and is printed by main.
+void printReport(const CommandLineOptions& options, const RunReport& report) {
+    if (options.wants(AnalysisKind::SUMMARY)) printSummary(report.summary);
+    if (options.wants(AnalysisKind::TOP_PRODUCTS)) printTopProducts(report.topProducts, report.topOptions);
+    if (report.hasDrillDown) printProductDrillDown(report.drillDown);
+    if (options.wants(AnalysisKind::DISTINCT_COUNTS)) printDistinctCounts(report.distinctCounts);
+    if (report.hasDayRange) printDayRangeSummary(report.dayRange);
+    if (options.wants(AnalysisKind::BITMAP_FILTER)) printFilteredSummary(report.bitmapFilter);
+    if (options.wants(AnalysisKind::KERNEL_BENCHMARK)) printKernelBenchmark(report.kernelTimings, report.rows);
+    if (options.wants(AnalysisKind::HEAVY_HITTERS)) printHeavyHitters(report.heavyHitters);
+    if (options.wants(AnalysisKind::PRICE_QUANTILES)) printPriceQuantiles(report.categoryPrices, report.brandPrices);
+    if (options.wants(AnalysisKind::TIME_SERIES)) printTimeSeries(report.dailySeries);
+    if (options.wants(AnalysisKind::FUNNEL)) printFunnel(report.funnel);
+    if (options.wants(AnalysisKind::SESSIONS)) printSessionOverview(report.sessions);
+    if (options.wants(AnalysisKind::COHORTS)) printCohortRetention(report.cohorts);
+}
+
+// One JSON object with a member per selected analysis, named as on the command line.
+void writeJsonReport(std::ostream& out, const CommandLineOptions& options, const RunReport& report) {
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("inputs").beginArray();
+    for (const auto& filePath : options.inputFiles) json.value(filePath);
+    json.endArray();
+    json.field("rows", report.rows)
+        .field("parseSeconds", report.parseSeconds)
+        .field("analysisSeconds", report.analysisSeconds)
+        .field("cpuLevel", cpuLevelName(getCpuLevel()))
+        .field("threads", getThreadCount());
+
+    auto wants = [&options, &json](AnalysisKind kind) {
+        if (!options.wants(kind)) return false;
+        json.key(analysisName(kind));
+        return true;
+    };
+    if (wants(AnalysisKind::SUMMARY)) writeJson(json, report.summary);
+    if (wants(AnalysisKind::TOP_PRODUCTS)) writeJson(json, report.topProducts);
+    if (wants(AnalysisKind::DRILL_DOWN)) {
+        if (!report.hasDrillDown) json.null();
+        else {
+            json.beginObject().field("prodId", report.drillDown.prodId).field("rows", report.drillDown.rows)
+                .field("micros", report.drillDown.micros).key("summary");
+            writeJson(json, report.drillDown.summary);
+            json.endObject();
+        }
+    }
+    if (wants(AnalysisKind::DISTINCT_COUNTS)) writeJson(json, report.distinctCounts);
+    if (wants(AnalysisKind::DAY_RANGE)) {
+        if (!report.hasDayRange) json.null();
+        else {
+            json.beginObject().field("dayStart", report.dayRange.dayStart).field("blocksScanned", report.dayRange.blocksScanned)
+                .field("blockCount", report.dayRange.blockCount).field("millis", report.dayRange.millis).key("summary");
+            writeJson(json, report.dayRange.summary);
+            json.endObject();
+        }
+    }
+    if (wants(AnalysisKind::BITMAP_FILTER)) {
+        json.beginObject().field("eventType", "purchase").field("category", report.bitmapFilter.category)
+            .field("rows", report.bitmapFilter.rows).field("millis", report.bitmapFilter.millis).key("summary");
+        writeJson(json, report.bitmapFilter.summary);
+        json.endObject();
+    }
+    if (wants(AnalysisKind::KERNEL_BENCHMARK)) {
+        json.beginArray();
+        for (const auto& timing : report.kernelTimings) {
+            json.beginObject().field("variant", timing.label).field("seconds", timing.seconds)
+                .field("bytesPerRow", timing.bytesPerRow).field("revenue", timing.revenue).endObject();
+        }
+        json.endArray();
+    }
+    if (wants(AnalysisKind::HEAVY_HITTERS)) writeJson(json, report.heavyHitters);
+    if (wants(AnalysisKind::PRICE_QUANTILES)) {
+        json.beginObject().key("byCategory");
+        writeJson(json, report.categoryPrices, "category");
+        json.key("byBrand");
+        writeJson(json, report.brandPrices, "brand");
+        json.endObject();
+    }
+    if (wants(AnalysisKind::TIME_SERIES)) writeJson(json, report.dailySeries);
+    if (wants(AnalysisKind::FUNNEL)) writeJson(json, report.funnel);
+    if (wants(AnalysisKind::SESSIONS)) {
+        json.beginObject().field("sessions", report.sessions.sessions).field("converted", report.sessions.converted)
+            .field("averageDurationSeconds", report.sessions.averageDurationSeconds)
+            .field("averageEvents", report.sessions.averageEvents).endObject();
+    }
+    if (wants(AnalysisKind::COHORTS)) writeJson(json, report.cohorts);
+    if (wants(AnalysisKind::CO_OCCURRENCE)) {
+        writeJson(json, report.coOccurrence, coOccurrenceProducts(report));
+    }
+    json.endObject();
+}
+
+// Writes the stage metrics if --metrics was given.
+bool exportMetrics(const CommandLineOptions& options, std::ostream& log) {
+    if (options.metricsPath.empty()) return true;
+    if (!saveMetrics(options.metricsPath, options.metricsFormat)) return false;
+    log << "Stage metrics written to " << options.metricsPath << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    CommandLineOptions options;
+    std::string error;
+    if (!parseCommandLine(argc, argv, options, error)) {
+        std::cerr << error << std::endl;
+        printUsage(std::cerr, argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (options.showHelp) {
+        printUsage(std::cout, argv[0]);
+        return EXIT_SUCCESS;
+    }
+    // Opened before the scheduler starts its workers, so they are counted too.
+    PerfCounters perf;
+    if (options.profile) {
+        if (!perf.open(error)) std::cerr << "Profiling disabled: " << error << std::endl;
+        else if (!error.empty()) std::cerr << "Hardware counters " << error << std::endl;
+    }
+    if (options.threadCount != 0) setThreadCount(options.threadCount);
+    if (options.pinThreads) setThreadPinning(true);
+    if (options.cpuLevelSet) setCpuLevel(options.cpuLevel);
+    if (options.inputFiles.empty() && !options.selfTest) options.inputFiles.push_back("2019-Nov.csv");
+
+    // With JSON, stdout carries only the report; progress and timings go to stderr.
+    const bool json = options.format == OutputFormat::JSON;
+    std::ostream& log = json ? std::cerr : std::cout;
+    log << "CPU dispatch level: " << cpuLevelName(getCpuLevel())
+        << " (supported: " << cpuLevelName(getSupportedCpuLevel()) << ")" << std::endl;
+    log << "Scheduler threads: " << getThreadCount() << (getThreadPinning() ? " (pinned)" : "") << std::endl << std::endl;
 
-int main() {
     // --- 1. Parsing Stage ---
     Parser parser;
-    parser.runUnitTests();
+    if (options.selfTest && !parser.runUnitTests(log)) {
+        return EXIT_FAILURE;
+    }
+    if (options.inputFiles.empty()) {
+        return EXIT_SUCCESS;
+    }
 
-    std::cout << "--- Running Performance Test ---" << std::endl;
-    const std::string filePath = "2019-Nov.csv";
+    if (options.pipeline) {
+        const bool pipelined = runPipelines(options, perf, log);
+        if (perf.isOpen()) perf.printStages(log);
+        return exportMetrics(options, log) && pipelined ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-    std::cout << "Processing file: " << filePath << std::endl;
+    log << "--- Running Performance Test ---" << std::endl;
+    parser.setProgressOutput(&log);
+    parser.setBitmapIndexEnabled(options.servePort == 0 && options.wants(AnalysisKind::BITMAP_FILTER));
 
+    std::vector<ParsedInput> inputs;
     auto start = std::chrono::high_resolution_clock::now();
-    parser.parseFile(filePath);
+    {
+        PerfStage stage(perf, "parse");
+        for (const auto& filePath : options.inputFiles) {
+            log << "Processing file: " << filePath << std::endl;
+            const size_t firstRow = parser.getEventVector().size();
+            parser.parseFile(filePath);
+            inputs.push_back({ AggregateState::sourceNameFor(filePath), firstRow, parser.getEventVector().size() });
+        }
+        stage.setRows(parser.getEventVector().size());
+    }
     auto end = std::chrono::high_resolution_clock::now();
 
     const auto& events = parser.getEventVector();
     std::chrono::duration<double> duration = end - start;
 
-    std::cout << "\nPerformance Results:" << std::endl;
-    std::cout << "  Parsed " << events.size() << " valid records in " << duration.count() << " seconds." << std::endl;
+    log << "\nPerformance Results:" << std::endl;
+    log << "  Parsed " << events.size() << " valid records in " << duration.count() << " seconds." << std::endl;
     if (duration.count() > 0.0) {
-        std::cout << "  Processing speed: " << (static_cast<double>(events.size()) / 1'000'000.0) / duration.count()
+        log << "  Processing speed: " << (static_cast<double>(events.size()) / 1'000'000.0) / duration.count()
             << " million records/sec." << std::endl;
     }
-    std::cout << "------------------------------" << std::endl << std::endl;
+    log << "------------------------------" << std::endl << std::endl;
+
+    if (options.servePort != 0) {
+        if (perf.isOpen()) perf.printStages(log);
+        QueryServer server(events, parser.getEventColumns());
+        const bool served = server.serve(options.servePort, log);
+        return exportMetrics(options, log) && served ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Indexes are only built for the analyses that query them.
+    EventIndex eventIndex;
+    if (options.wants(AnalysisKind::DRILL_DOWN)) {
+        auto indexStart = std::chrono::high_resolution_clock::now();
+        {
+            PerfStage stage(perf, "index", events.size());
+            eventIndex.build(events);
+        }
+        auto indexEnd = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> indexDuration = indexEnd - indexStart;
+        log << "Built product/user index (" << eventIndex.productIndex().keyCount() << " products, "
+            << eventIndex.userIndex().keyCount() << " users) in " << indexDuration.count() << " seconds." << std::endl << std::endl;
+    }
+    ZoneMap zoneMap;
+    if (options.wants(AnalysisKind::DAY_RANGE)) {
+        PerfStage stage(perf, "zone-map", events.size());
+        zoneMap.build(events);
+    }
 
     // --- 2. Analysis Stage ---
     Analyzer analyzer;
+    RunReport report;
+    report.rows = events.size();
+    report.parseSeconds = duration.count();
+    // Drill-down looks at the best-ranked product; co-occurrence falls back to its own
+    // strongest products when nothing else needs a ranking.
+    const bool needProducts = options.wants(AnalysisKind::TOP_PRODUCTS) || options.wants(AnalysisKind::DRILL_DOWN);
 
     auto analysisStart = std::chrono::high_resolution_clock::now();
 
-    AnalysisSummary summary = analyzer.getSummary(events);
-    ProductStatsMap productStats = analyzer.getProductStats(events);
+    // Each analysis is its own profiling stage; without --profile this only checks a flag.
+    auto profiled = [&perf, &events](AnalysisKind kind, auto&& run) {
+        PerfStage stage(perf, analysisName(kind), events.size());
+        run();
+    };
+    if (options.wants(AnalysisKind::SUMMARY)) profiled(AnalysisKind::SUMMARY, [&]() { report.summary = analyzer.getSummary(parser.getEventColumns()); });
+    if (needProducts) profiled(AnalysisKind::TOP_PRODUCTS, [&]() { report.topProducts = analyzer.getTopProducts(analyzer.getProductStats(events), report.topOptions); });
+    if (options.wants(AnalysisKind::DISTINCT_COUNTS)) profiled(AnalysisKind::DISTINCT_COUNTS, [&]() { report.distinctCounts = analyzer.getDistinctCounts(events); });
+    if (options.wants(AnalysisKind::HEAVY_HITTERS)) profiled(AnalysisKind::HEAVY_HITTERS, [&]() { report.heavyHitters = analyzer.getHeavyHitters(events, 5); });
+    if (options.wants(AnalysisKind::PRICE_QUANTILES)) profiled(AnalysisKind::PRICE_QUANTILES, [&]() {
+        report.categoryPrices = analyzer.getPriceQuantilesByCategory(events);
+        report.brandPrices = analyzer.getPriceQuantilesByBrand(events);
+        });
+    if (options.wants(AnalysisKind::TIME_SERIES)) profiled(AnalysisKind::TIME_SERIES, [&]() { report.dailySeries = analyzer.getTimeSeries(events, options.bucketSeconds); });
+    if (options.wants(AnalysisKind::FUNNEL)) profiled(AnalysisKind::FUNNEL, [&]() { report.funnel = analyzer.getSessionFunnel(events); });
+    std::vector<SessionRecord> sessions;
+    if (options.wants(AnalysisKind::SESSIONS) || !options.sessionsCsvPath.empty()) profiled(AnalysisKind::SESSIONS, [&]() {
+        sessions = analyzer.getSessions(events);
+        report.sessions = summarizeSessions(sessions);
+        });
+    if (options.wants(AnalysisKind::COHORTS)) profiled(AnalysisKind::COHORTS, [&]() { report.cohorts = analyzer.getCohortRetention(events); });
+    if (options.wants(AnalysisKind::CO_OCCURRENCE)) profiled(AnalysisKind::CO_OCCURRENCE, [&]() { report.coOccurrence = analyzer.getCoOccurrence(events); });
 
     auto analysisEnd = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> analysisDuration = analysisEnd - analysisStart;
+    report.analysisSeconds = analysisDuration.count();
+
+    log << "Analysis phase took " << analysisDuration.count() << " seconds." << std::endl;
+    if (perf.isOpen()) perf.printStages(log);
 
-    std::cout << "Analysis phase took " << analysisDuration.count() << " seconds." << std::endl;
+    // Index-backed lookups and the kernel benchmark are timed on their own.
+    report.hasDrillDown = options.wants(AnalysisKind::DRILL_DOWN) && !report.topProducts.empty();
+    if (report.hasDrillDown) {
+        report.drillDown = runProductDrillDown(analyzer, events, eventIndex, report.topProducts.front().prodId);
+    }
+    // The first day comes from the zone map, which holds every block's earliest timestamp.
+    report.hasDayRange = options.wants(AnalysisKind::DAY_RANGE) && !events.empty();
+    if (report.hasDayRange) {
+        report.dayRange = runDayRange(analyzer, events, zoneMap, floorToBucket(zoneMap.minTime(), 24 * 60 * 60));
+    }
+    if (options.wants(AnalysisKind::BITMAP_FILTER)) {
+        report.bitmapFilter = runBitmapFilter(analyzer, events, parser.getBitmapIndex(), EventType::PURCHASE, "electronics");
+    }
+    if (options.wants(AnalysisKind::KERNEL_BENCHMARK)) {
+        report.kernelTimings = runKernelBenchmark(analyzer, events, parser.getEventColumns());
+    }
 
     // --- 3. Output Stage ---
-    printSummary(summary);
-    printTopProducts(productStats, 10);
+    if (json) {
+        writeJsonReport(std::cout, options, report);
+    }
+    else {
+        printReport(options, report);
+    }
+    if (!options.sessionsCsvPath.empty()) {
+        if (!analyzer.exportSessionsCsv(sessions, options.sessionsCsvPath)) return EXIT_FAILURE;
+        log << "Exported " << sessions.size() << " sessions to " << options.sessionsCsvPath << "." << std::endl;
+    }
+    if (!options.statePath.empty() && !updateAggregateState(options.statePath, events, inputs, options.bucketSeconds, log)) {
+        return EXIT_FAILURE;
+    }
+    if (!json && options.wants(AnalysisKind::CO_OCCURRENCE)) {
+        printCoOccurrence(report.coOccurrence, coOccurrenceProducts(report));
+    }
 
-    return EXIT_SUCCESS;
+    return exportMetrics(options, log) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
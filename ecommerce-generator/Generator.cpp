@@ -0,0 +1,144 @@
+#include "DataGenerator.h"
+#include "Parallel.h"
+
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Writes a synthetic CSV in the Kaggle schema for load tests that cannot download the
+// real data. The same options and seed always produce the same file.
+
+namespace {
+
+    struct GeneratorCommandLine {
+        GeneratorOptions generator;
+        std::string outputFile = "synthetic.csv";
+        // Non-zero picks the row count that gives a file of about this many bytes.
+        uint64_t targetBytes = 0;
+        unsigned threadCount = 0;
+        bool showHelp = false;
+    };
+
+    template<typename T>
+    bool parseValue(std::string_view text, T& value) {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == std::errc() && result.ptr == text.data() + text.size();
+    }
+
+    // "500M", "9G" and plain byte counts.
+    bool parseByteSize(std::string_view text, uint64_t& bytes) {
+        uint64_t scale = 1;
+        if (!text.empty()) {
+            switch (text.back()) {
+            case 'K': case 'k': scale = 1ull << 10; break;
+            case 'M': case 'm': scale = 1ull << 20; break;
+            case 'G': case 'g': scale = 1ull << 30; break;
+            default: break;
+            }
+            if (scale != 1) text.remove_suffix(1);
+        }
+        if (!parseValue(text, bytes) || bytes == 0) return false;
+        bytes *= scale;
+        return true;
+    }
+
+    void printUsage(std::ostream& out, const char* program) {
+        out << "Usage: " << program << " [options]\n"
+            << "\n"
+            << "  --output=<file>        CSV to write (default: synthetic.csv).\n"
+            << "  --rows=<n>             Rows to generate (default: 1000000).\n"
+            << "  --size=<n>[K|M|G]      Generate about this many bytes instead of a row count.\n"
+            << "  --seed=<n>             Random seed (default: 42).\n"
+            << "  --products=<n>         Catalog sizes (defaults: 200000 products, 3000 brands,\n"
+            << "  --brands=<n>           600 categories, 1000000 users).\n"
+            << "  --categories=<n>\n"
+            << "  --users=<n>\n"
+            << "  --product-skew=<s>     Zipf exponents for product and brand popularity\n"
+            << "  --brand-skew=<s>       (defaults: 1.1 and 1.2; 0 is uniform).\n"
+            << "  --session-events=<n>   Mean events per session (default: 6).\n"
+            << "  --threads=<n>          Generator threads; the output does not depend on it.\n"
+            << "  --help                 Show this message.\n";
+    }
+
+    bool parseOptions(int argc, char* argv[], GeneratorCommandLine& options) {
+        GeneratorOptions& generator = options.generator;
+        for (int i = 1; i < argc; ++i) {
+            const std::string_view argument = argv[i];
+            const size_t equals = argument.find('=');
+            const std::string_view name = argument.substr(0, equals);
+            const std::string_view value = equals == std::string_view::npos ? std::string_view() : argument.substr(equals + 1);
+            bool valid = true;
+            if (argument == "--help" || argument == "-h") options.showHelp = true;
+            else if (name == "--output") {
+                options.outputFile = std::string(value);
+                valid = !value.empty();
+            }
+            else if (name == "--rows") valid = parseValue(value, generator.rows);
+            else if (name == "--size") valid = parseByteSize(value, options.targetBytes);
+            else if (name == "--seed") valid = parseValue(value, generator.seed);
+            else if (name == "--products") valid = parseValue(value, generator.productCount);
+            else if (name == "--brands") valid = parseValue(value, generator.brandCount);
+            else if (name == "--categories") valid = parseValue(value, generator.categoryCount);
+            else if (name == "--users") valid = parseValue(value, generator.userCount);
+            else if (name == "--product-skew") valid = parseValue(value, generator.productSkew);
+            else if (name == "--brand-skew") valid = parseValue(value, generator.brandSkew);
+            else if (name == "--session-events") valid = parseValue(value, generator.meanSessionEvents);
+            else if (name == "--threads") valid = parseValue(value, options.threadCount) && options.threadCount != 0;
+            else valid = false;
+            if (!valid) {
+                std::cerr << "Invalid argument '" << argument << "'." << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Average row length of the first chunk, which the catalog and seed fully determine.
+    double measureRowBytes(GeneratorOptions options) {
+        options.rows = 1 << 16;
+        DataGenerator probe(options);
+        std::string text;
+        probe.generateChunk(0, text);
+        return static_cast<double>(text.size()) / options.rows;
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+    GeneratorCommandLine options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(std::cerr, argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (options.showHelp) {
+        printUsage(std::cout, argv[0]);
+        return EXIT_SUCCESS;
+    }
+    if (options.threadCount != 0) setThreadCount(options.threadCount);
+
+    try {
+        if (options.targetBytes != 0) {
+            options.generator.rows = static_cast<size_t>(options.targetBytes / measureRowBytes(options.generator));
+        }
+        std::cout << "Generating " << options.generator.rows << " rows into " << options.outputFile
+            << " (seed " << options.generator.seed << ", " << getThreadCount() << " threads)" << std::endl;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        DataGenerator generator(options.generator);
+        if (!generator.writeCsv(options.outputFile, &std::cout)) {
+            return EXIT_FAILURE;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> duration = end - start;
+        std::cout << "Done in " << duration.count() << " seconds." << std::endl;
+    }
+    catch (const std::invalid_argument& e) {
+        std::cerr << "Generator error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}